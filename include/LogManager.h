@@ -45,6 +45,9 @@ class LogManager {
 		// See the descriptions of LogLevel above.  Normally you want INFO.
 		void log_message(LogLevel level, std::string message);
 
+		// Lets callers skip building messages that would not be output.
+		LogLevel get_output_level() const { return output_level; };
+
 		// This helper function will convert a linux errno to a std::string.
 		static std::string stdstrerror(int en) {
 			char err[512];
@@ -13,6 +13,7 @@
 /*! \fn unsigned int fw_version_check(const char* caller_name, localArgs *la)
  *  \brief Returns AMC FW version
  *  in case FW version is not 1.X or 3.X sets an error string in response
+ *  \details The version comes from getFirmwareIdentity, which reads the registers once per firmware and address table
  *  \param caller_name Name of methods which called the FW version check
  *  \param la Local arguments structure
  */
@@ -46,11 +47,11 @@ void getOHVFATMaskMultiLink(const RPCMsg *request, RPCMsg *response);
  *  \details The SBIT Monitor stores the 8 SBITs that are sent from the OH (they are all sent at the same time and correspond to the same clock cycle). Each SBIT clusters readout from the SBIT Monitor is a 16 bit word with bits [0:10] being the sbit address and bits [12:14] being the sbit size, bits 11 and 15 are not used.
  *  \details The possible values of the SBIT Address are [0,1535].  Clusters with address less than 1536 are considered valid (e.g. there was an sbit); otherwise an invalid (no sbit) cluster is returned.  The SBIT address maps to a given trigger pad following the equation \f$sbit = addr % 64\f$.  There are 64 such trigger pads per VFAT.  Each trigger pad corresponds to two VFAT channels.  The SBIT to channel mapping follows \f$sbit=floor(chan/2)\f$.  You can determine the VFAT position of the sbit via the equation \f$vfatPos=7-int(addr/192)+int((addr%192)/64)*8\f$.
  *  \details The SBIT size represents the number of adjacent trigger pads are part of this cluster.  The SBIT address always reports the lowest trigger pad number in the cluster.  The sbit size takes values [0,7].  So an sbit cluster with address 13 and with size of 2 includes 3 trigger pads for a total of 6 vfat channels and starts at channel \f$13*2=26\f$ and continues to channel \f$(2*15)+1=31\f$.
- *  \details The output vector will always be of size N * 8 where N is the number of readouts of the SBIT Monitor.  For each readout the SBIT Monitor will be reset and then readout after 4095 clock cycles (~102.4 microseconds).  The SBIT clusters will only be added to the output vector if at least one of them was valid.  The SBIT clusters stored in the SBIT Monitor will not be over-written until a module reset is sent.  The readout will stop before acquireTime finishes if the size of the returned vector approaches the max TCP/IP size (~65000 btyes) and sets maxNetworkSize to true.
+ *  \details The output vector will always be of size N * 8 where N is the number of readouts of the SBIT Monitor.  For each readout the SBIT Monitor will be reset and then readout after 4095 clock cycles (~102.4 microseconds).  The SBIT clusters will only be added to the output vector if at least one of them was valid.  The SBIT clusters stored in the SBIT Monitor will not be over-written until a module reset is sent.  The readout will stop before acquireTime finishes if the size of the returned vector approaches the max TCP/IP size (~65000 btyes) and sets maxNetworkSize to true; longer acquisitions are done with the streaming capture (see amc/sbit_capture.h).
  *  \details Each element of the output vector will be a 32 bit word.  Bits [0,10] will the address of the SBIT Cluster, bits [11:13] will be the cluster size, and bits [14:26] will be the difference between the SBIT and the input L1A (if any) in clock cycles.  While the SBIT Monitor stores the difference between the SBIT and input L1A as a 32 bit number (0xFFFFFFFF) any value higher 0xFFF (12 bits) will be truncated to 0xFFF.  This matches the time between readouts of 4095 clock cycles.
  *  \param la Local arguments structure
  *  \param ohN Optical link
- *  \param acquireTime acquisition time on the wall clock in seconds
+ *  \param acquireTime acquisition time in seconds, measured on the monotonic clock
  *  \param maxNetworkSize pointer to a boolean, set to true if the returned vector reaches a byte count of 65000
  */
 std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, bool *maxNetworkSizeReached);
@@ -62,4 +63,33 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
  */
 void sbitReadOut(const RPCMsg *request, RPCMsg *response);
 
+/*! \struct sbitHistograms
+ *  Histograms of the SBIT monitor clusters, filled by sbitHistogramLocal
+ */
+struct sbitHistograms {
+    std::vector<uint32_t> occupancy;   ///< number of clusters covering each of the 1536 sbit addresses
+    std::vector<uint32_t> clusterSize; ///< number of clusters per cluster size, 8 bins
+    std::vector<uint32_t> l1aDelay;    ///< number of clusters per L1A delay, 4096 bins, the last one holding the overflows
+    uint32_t nReadouts;                ///< readouts of the SBIT monitor
+    uint32_t liveTimeMs;               ///< acquisition time on the monotonic clock
+};
+
+/*! \fn void sbitHistogramLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, sbitHistograms & histos)
+ *  \brief Reads out the SBIT monitor of optohybrid ohN for acquireTime seconds, as sbitReadOutLocal, and histograms the clusters on the board
+ *  \details The clusters are decoded with the layout of sbitReadOutLocal. A cluster of address addr and size n counts once in the occupancy of the addresses addr to addr+n.
+ *  \param la Local arguments structure
+ *  \param ohN Optical link
+ *  \param acquireTime acquisition time in seconds, measured on the monotonic clock
+ *  \param histos Histograms, reset at the start
+ */
+void sbitHistogramLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, sbitHistograms & histos);
+
+/*! \fn void sbitHistogram(const RPCMsg *request, RPCMsg *response)
+ *  \brief Histograms the sbits seen by the SBIT Monitor.  See the local callable methods documentation for details.
+ *  \details Keys are "ohN" and "acquireTime". Returned are "occupancy", "clusterSize", "l1aDelay", "nReadouts" and "liveTimeMs".
+ *  \param request RPC response message
+ *  \param response RPC response message
+ */
+void sbitHistogram(const RPCMsg *request, RPCMsg *response);
+
 #endif
@@ -0,0 +1,73 @@
+/*! \file amc/sbit_capture.h
+ *  \brief Streaming capture of the SBIT monitor
+ *
+ *  sbitReadOut collects the clusters in memory and returns them in a single response, so it is
+ *  limited to ~65000 bytes. The streaming capture instead runs in a detached worker process that
+ *  reads the SBIT monitor at its native rate (one readout every 4095 BX) and appends the packed
+ *  clusters to a ring buffer in a memory mapped file. The client fetches chunks by offset while
+ *  the capture continues; the producer never blocks, so a client that falls behind by more than
+ *  the ring size loses the oldest words, which it sees as a jump of the returned offset.
+ *
+ *  The ring is written by a single producer and published with an atomic word counter, readers
+ *  validate their copy against the counter afterwards, so no lock is taken on the data path.
+ *  Only one capture runs at a time.
+ */
+
+#ifndef AMC_SBIT_CAPTURE_H
+#define AMC_SBIT_CAPTURE_H
+
+#include "utils.h"
+
+/*!
+ * \defgroup sbitcapture Streaming SBIT monitor capture
+ */
+
+const uint32_t SBIT_CAPTURE_DEFAULT_WORDS = 4*1024*1024; ///< 16 MB ring
+const uint32_t SBIT_CAPTURE_MAX_CHUNK     = 65536;       ///< words per fetchSbitCapture call
+
+/** Locally executed methods */
+/*!
+ * \brief Resolved SBIT monitor registers of one readout
+ */
+struct sbitMonitorRegs {
+  uint32_t reset;        ///< GEM_AMC.TRIGGER.SBIT_MONITOR.RESET address
+  uint32_t readout[9];   ///< GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY and CLUSTER0 to CLUSTER7 addresses
+};
+
+/*!
+ * \brief Selects the OH of the SBIT monitor and resolves its registers
+ * \returns false, with the error set in the response, if a register could not be resolved
+ */
+bool setupSbitMonitorLocal(localArgs* la, uint32_t ohN, sbitMonitorRegs& regs);
+
+/*!
+ * \brief Reads the L1A delay and the 8 clusters latched since the last reset with one block read, and packs them
+ * \details The packing is the one of sbitReadOutLocal: bits [0,10] cluster address, bits [11:13] cluster size, bits [14:26] L1A delay, truncated to 4095
+ * \param packed Array of 8 words to hold the packed clusters
+ * \returns true if at least one cluster is valid
+ */
+bool readSbitMonitorLocal(localArgs* la, sbitMonitorRegs const& regs, uint32_t* packed);
+
+/** RPC callbacks */
+/*!
+ * \brief Starts a streaming capture of the SBIT monitor in a worker process and returns immediately
+ * \details Keys are "ohN", "acquireTime" (seconds, 0 to capture until stopSbitCapture), "bufferWords" (ring size, default SBIT_CAPTURE_DEFAULT_WORDS)
+ *          and "bufferFile" (default /dev/shm/ctp7_sbit_capture.dat, must be accepted by allowedDataPath, may be on persistent storage). The capture ID is returned in "captureId".
+ */
+void startSbitCapture(const RPCMsg *request, RPCMsg *response);
+
+/*!
+ * \brief Returns the packed clusters of the current (or last) capture from a word offset
+ * \details Keys are "offset" (default 0) and "count" (default and maximum SBIT_CAPTURE_MAX_CHUNK). Returned are "data",
+ *          "offset" (the offset of the first word of data, larger than the requested one if words were overwritten), "written" (words captured so far),
+ *          "status" (RUNNING, DONE, STOPPED or FAILED), "captureId", "nReadouts", "nValidReadouts" and "liveTimeMs" measured with the monotonic clock.
+ *          With count 0 only the status is returned.
+ */
+void fetchSbitCapture(const RPCMsg *request, RPCMsg *response);
+
+/*!
+ * \brief Stops the running capture, the words captured so far remain available to fetchSbitCapture
+ */
+void stopSbitCapture(const RPCMsg *request, RPCMsg *response);
+
+#endif
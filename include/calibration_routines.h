@@ -9,11 +9,14 @@
 #define CALIBRATION_ROUTINES_H
 
 #include <map>
+#include <memory>
 #include <string>
 #include <tuple>
 #include "utils.h"
 #include <vector>
 
+struct calPulseState;
+
 //This could be imported from xhal legacyPreBoost branch...but I expect ctp7_modules develop to outlive that
 struct vfat3DACAndSize{
     //key is the monitoring select (dacSelect) value
@@ -54,25 +57,49 @@ struct vfat3DACAndSize{
     }
 };
 
-/*! \fn std::unordered_map<uint32_t, uint32_t> setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la)
- *  \brief Unmask the channel of interest and masks all the other
+/*! \struct chanMaskSnapshot
+ *  Original channel register words of a set of VFATs, 128 consecutive entries per VFAT
+ */
+struct chanMaskSnapshot {
+    std::vector<uint32_t> addrs; ///< VFAT_CHANNELS.CHANNEL%i addresses
+    std::vector<uint32_t> words; ///< original register words, mask, calibration pulse enable and trims included
+
+    bool empty() const { return addrs.empty(); }
+};
+
+/*! \fn chanMaskSnapshot setChanMaskLocal(localArgs *la, uint32_t ohN, uint32_t vfatMask, unsigned int ch)
+ *  \brief Unmask the channel of interest and masks all the other, on all VFATs of an optohybrid not in vfatMask
+ *  \details The channel register addresses are resolved once per address table. The channel registers of all VFATs are read with one address list read,
+ *            and the new words of all VFATs are written in one memhub transaction. Only the MASK field of the registers is changed.
+ *            If a register can not be read nothing is written, an error is set in the response and an empty snapshot is returned.
+ *  \param la Local arguments structure
+ *  \param ohN Optical link number
+ *  \param vfatMask VFATs to leave untouched, a 1 in the n^th bit skips the n^th VFAT
+ *  \param ch Channel of interest
+ *  \return Original channel registers, to restore with applyChanMask
+ */
+chanMaskSnapshot setChanMaskLocal(localArgs *la, uint32_t ohN, uint32_t vfatMask, unsigned int ch);
+
+/*! \fn chanMaskSnapshot setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la)
+ *  \brief Unmask the channel of interest and masks all the other, see setChanMaskLocal
  *  \param ohN Optical link number
  *  \param vfatN VFAT position
  *  \param ch Channel of interest
  *  \param la Local arguments structure
- *  \return Original channel mask in a form of an unordered map <chanMaskAddr, mask>
+ *  \return Original channel registers, to restore with applyChanMask
  */
-std::unordered_map<uint32_t, uint32_t> setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la);
+chanMaskSnapshot setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la);
 
-/*! \fn void applyChanMask(std::unordered_map<uint32_t, uint32_t> map_chanOrigMask, localArgs *la)
- *  \brief Applies channel mask
- *  \param map_chanOrigMask Original channel mask as obtained from setSingleChanMask mehod
+/*! \fn void applyChanMask(const chanMaskSnapshot & origMask, localArgs *la)
+ *  \brief Writes back the channel registers of a snapshot in one memhub transaction
+ *  \param origMask Original channel registers as obtained from setSingleChanMask or setChanMaskLocal
  *  \param la Local arguments structure
  */
-void applyChanMask(std::unordered_map<uint32_t, uint32_t> map_chanOrigMask, localArgs *la);
+void applyChanMask(const chanMaskSnapshot & origMask, localArgs *la);
 
-/*! \fn void confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor)
+/*! \fn void confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor, calPulseState *state)
  *  \brief Configures the calibration pulse for channel ch on all VFATs of ohN that are not in mask to either be on (toggleOn==true) or off (toggleOn==false).  If ch == 128 and toggleOn == False will write the CALPULSE_ENABLE bit for all channels of all vfats that are not masked on ohN to 0x0.
+ *  \details Only the register words that change are written, in one memhub transaction, see applyCalPulseConfigLocal
  *  \param la Local arguments structure
  *  \param ohN Optical link number
  *  \param mask VFAT mask
@@ -80,8 +107,9 @@ void applyChanMask(std::unordered_map<uint32_t, uint32_t> map_chanOrigMask, loca
  *  \param toggleOn if true (false) turns the calibration pulse on (off) for channel ch
  *  \param currentPulse Selects whether to use current or volage pulse
  *  \param calScaleFactor Scale factor for the calibration pulse height (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
+ *  \param state Register words known from previous calls, see calibration_routines/cal_pulse.h; nullptr to read back the words needed
  */
-bool confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor);
+bool confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor, calPulseState *state=nullptr);
 
 /*! \fn void dacMonConfLocal(localArgs * la, uint32_t ohN, uint32_t ch)
  *  \brief Configures DAQ monitor. Local version only
@@ -176,7 +204,7 @@ void ttcGenConfLocal(localArgs * la, uint32_t ohN, uint32_t mode, uint32_t type,
  */
 void ttcGenConf(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig)
+/*! \fn void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig, calPulseState *calState)
  *  \brief Generic calibration routine. Local callable version of genScan
  *  \param la Local arguments structure
  *  \param outData pointer to the results of the scan
@@ -193,16 +221,54 @@ void ttcGenConf(const RPCMsg *request, RPCMsg *response);
  *  \param scanReg DAC register to scan over name
  *  \param useUltra Set to 1 in order to use the ultra scan
  *  \param useExtTrig Set to 1 in order to use the backplane triggers
+ *  \param calState Calibration pulse state kept across the calls of a channel scan, so that moving the pulse to the next channel does not read back the channel registers again; nullptr for a single scan
  */
-void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig);
+void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig, calPulseState *calState=nullptr);
 
 /*! \fn void genScan(const RPCMsg *request, RPCMsg *response)
  *  \brief Generic calibration routine
+ *  \details With the "adaptive" key the scan is run by genScanAdaptiveLocal (see calibration_routines/adaptive_scan.h for the additional keys),
+ *           the points taken are returned in "dacPoints" and the counts in "data", indexed as [vfat][point]
+ *  \details With the optional "resultFile" key every completed point is also appended to that scan result file, see calibration_routines/result_file.h
+ *  \details The size of each result array is returned in "<key>Size", arrays above SCAN_MAX_RESPONSE_WORDS are returned in chunks, see calibration_routines/result_buffer.h
  *  \param request RPC request message
  *  \param response RPC response message
  */
 void genScan(const RPCMsg *request, RPCMsg *response);
 
+/*! \fn void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+ *  \brief Generic calibration routine on several optohybrids at once. Local callable version of genScanMultiLink
+ *
+ *  * At every point the scan register is set on all optohybrids in ohMask before any trigger is sent
+ *  * The VFAT_DAQ_MONITOR counts a single optohybrid, so CTRL.OH_SELECT is switched and one burst of nevts triggers is sent per optohybrid and point
+ *  * The VFAT mask of each optohybrid is taken from getOHVFATMaskLocal
+ *  * outData is indexed as [oh][vfat][dac], i.e. outData[scanDataIndex(nDacVals, ohN, vfatN, (dacVal-dacMin)/dacStep)] with nDacVals = scanPoints(dacMin, dacMax, dacStep),
+ *    always for 12 optohybrids; masked optohybrids and VFATs are left at 0xdeaddead
+ *
+ *  \param la Local arguments structure
+ *  \param outData pointer to the results of the scan, must hold 12*24*nDacVals words
+ *  \param ohMask 12 bit mask of the optohybrids to scan, a 1 in the n^th bit selects the n^th optohybrid
+ *  \param ch Channel of interest
+ *  \param useCalPulse Use  calibration pulse if true
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor
+ *  \param nevts Number of events per calibration point
+ *  \param dacMin Minimal value of scan variable
+ *  \param dacMax Maximal value of scan variable
+ *  \param dacStep Scan variable change step
+ *  \param scanReg DAC register to scan over name
+ *  \param useExtTrig Set to 1 in order to use the backplane triggers
+ */
+void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig);
+
+/*! \fn void genScanMultiLink(const RPCMsg *request, RPCMsg *response)
+ *  \brief Generic calibration routine on all optohybrids in "ohMask". See the local callable methods documentation for details
+ *  \details Takes the same keys as genScan (including "resultFile") with "ohMask" instead of "ohN" and "mask", the results are stored in the "data" word array (in chunks above SCAN_MAX_RESPONSE_WORDS, see calibration_routines/result_buffer.h)
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void genScanMultiLink(const RPCMsg *request, RPCMsg *response);
+
 /*! \fn void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRate, uint32_t ohN, uint32_t maskOh, bool invertVFATPos, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t waitTime)
  *  \brief SBIT rate scan. Local version of sbitRateScan
  *
@@ -230,33 +296,57 @@ void genScan(const RPCMsg *request, RPCMsg *response);
  */
 void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRate, uint32_t ohN, uint32_t maskOh, bool invertVFATPos, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t waitTime);
 
-/*! \fn void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ohN, uint32_t vfatmask, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg)
+/*! \struct sbitRateWindow
+ *  Integration window of the points of a parallel SBIT rate scan
+ */
+struct sbitRateWindow {
+    uint32_t minTimeMs = 100;        ///< shortest integration per point
+    uint32_t maxTimeMs = 1005;       ///< longest integration per point
+    uint32_t targetPrecision = 100;  ///< relative statistical precision in per mille, a VFAT is done once it counted (1000/targetPrecision)^2 SBITs; 0 to always integrate maxTimeMs
+    uint32_t quietPoints = 0;        ///< end the scan once all VFATs counted nothing for this many consecutive points; 0 to scan the full range
+};
+
+/*! \fn std::unique_ptr<sbitRateWindow> getSbitRateWindow(const RPCMsg *request)
+ *  \brief Reads the "minTime", "maxTime", "targetPrecision" and "quietPoints" keys of a request, nullptr if none of them is present
+ */
+std::unique_ptr<sbitRateWindow> getSbitRateWindow(const RPCMsg *request);
+
+/*! \fn void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t ohMask=0xFFF, const sbitRateWindow *window=nullptr)
  *  \brief Parallel SBIT rate scan. Local version of sbitRateScan
  *
- *  * Measures the SBIT rate seen by OHv3 ohN for the non-masked VFATs defined in vfatmask as a function of scanReg
+ *  * Measures the SBIT rate seen by the OHv3s in ohMask for their non-masked VFATs as a function of scanReg
+ *  * The VFAT mask of each optohybrid is taken from getOHVFATMaskLocal
  *  * Will scan from dacMin to dacMax in steps of dacStep
  *  * The x-values (e.g. scanReg values) will be stored in outDataDacVal
  *  * For each VFAT the y-valued (e.g. rate) will be stored in outDataTrigRatePerVFAT
  *  * For the overall y-value (e.g. rate) will be stored in outDataTrigRateOverall
- *  * Each measured point will take one second
+ *  * Each measured point will take one second, unless an integration window is given
+ *  * With an integration window a point is integrated at least minTimeMs and at most maxTimeMs. In between it ends as soon as every unmasked VFAT
+ *    either reached the target precision or counted nothing. The per VFAT values are then the counts scaled to Hz. The overall rate is the
+ *    firmware TRIGGER_RATE register, which is updated once per second, so it is only meaningful for points integrated for a second or more
+ *  * With quietPoints the scan ends once all VFATs were quiet for that many consecutive points, the remaining points are stored, and appended to the result file, with a rate of 0
  *  * The measurement is performed for all channels (ch=128) or a specific channel (0 <= ch <= 127)
  *
  *  \param la Local arguments structure
  *  \param outDataDacVal
  *  \param outDataTrigRatePerVFAT
  *  \param outDataTrigRateOverall
- *  \param ohN Optohybrid optical link number
- *  \param vfatMask VFAT mask
  *  \param ch Channel of interest
  *  \param dacMin Minimal value of scan variable
  *  \param dacMax Maximal value of scan variable
  *  \param dacStep Scan variable change step
  *  \param scanReg DAC register to scan over name
+ *  \param ohMask 12 bit mask of the optohybrids to scan
+ *  \param window Integration window, nullptr for the fixed one second per point
  */
-void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ohN, uint32_t vfatmask, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg);
+void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t ohMask=0xFFF, const sbitRateWindow *window=nullptr);
 
 /*! \fn void sbitRateScan(const RPCMsg *request, RPCMsg *response)
  *  \brief SBIT rate scan. See the local callable methods documentation for details
+ *  \details Any of the "minTime", "maxTime" (milliseconds), "targetPrecision" (per mille) and "quietPoints" keys selects the integration window mode,
+ *           the missing ones take the defaults of sbitRateWindow
+ *  \details With the optional "resultFile" key every completed point is also appended to that scan result file, see calibration_routines/result_file.h
+ *  \details The size of each result array is returned in "<key>Size", arrays above SCAN_MAX_RESPONSE_WORDS are returned in chunks, see calibration_routines/result_buffer.h
  *  \param request RPC response message
  *  \param response RPC response message
  */
@@ -267,6 +357,7 @@ void sbitRateScan(const RPCMsg *request, RPCMsg *response);
  *  \details The SBIT Monitor stores the 8 SBITs that are sent from the OH (they are all sent at the same time and correspond to the same clock cycle). Each SBIT clusters readout from the SBIT Monitor is a 16 bit word with bits [0:10] being the sbit address and bits [12:14] being the sbit size, bits 11 and 15 are not used.
  *  \details The possible values of the SBIT Address are [0,1535].  Clusters with address less than 1536 are considered valid (e.g. there was an sbit); otherwise an invalid (no sbit) cluster is returned.  The SBIT address maps to a given trigger pad following the equation \f$sbit = addr % 64\f$.  There are 64 such trigger pads per VFAT.  Each trigger pad corresponds to two VFAT channels.  The SBIT to channel mapping follows \f$sbit=floor(chan/2)\f$.  You can determine the VFAT position of the sbit via the equation \f$vfatPos=7-int(addr/192)+int((addr%192)/64)*8\f$.
  *  \details The SBIT size represents the number of adjacent trigger pads are part of this cluster.  The SBIT address always reports the lowest trigger pad number in the cluster.  The sbit size takes values [0,7].  So an sbit cluster with address 13 and with size of 2 includes 3 trigger pads for a total of 6 vfat channels and starts at channel \f$13*2=26\f$ and continues to channel \f$(2*15)+1=31\f$.
+ *  \details After each pulse the 8 clusters are read with one block read, polled until a cluster is latched and the L1A is sent, for at most 200 us + pulseDelay BX. A summary of the check is logged at INFO level, single clusters only at DEBUG level.
  *  \param la Local arguments structure
  *  \param outData pointer to an array of size (24*128*8*nevts) which stores the results of the scan, bits [0,7] channel pulsed; bits [8:15] sbit observed; bits [16:20] vfat pulsed; bits [21,25] vfat observed; bit 26 isValid; bits [27,29] are the cluster size
  *  \param ohN Optical link
@@ -283,6 +374,9 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
 
 /*! \fn void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response)
  *  \brief Checks the sbit mapping using the calibration pulse. See the local callable methods documentation for details
+ *  \details The size of "data" is returned in "dataSize", see calibration_routines/result_buffer.h for results above SCAN_MAX_RESPONSE_WORDS
+ *  \details With "analysis" set to 1 the comparison with the expected mapping is done on the board (see calibration_routines/sbit_mapping.h):
+ *            the per channel summary ("correct", "wrongStrip", "missed", "clusterSizes") is returned and "data" holds the words of the wrong strip pulses only
  *  \param request RPC response message
  *  \param response RPC response message
  */
@@ -313,20 +407,25 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
  */
 void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false)
+/*! \fn std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false, uint32_t nReads=100, bool stopOnVariance=false)
  *  \brief configures the VFAT3 DAC Monitoring and then scans the DAC and records the measured ADC values for all unmasked VFATs
+ *  \details At every point the DAC is set on all unmasked VFATs in one transaction, then the ADC caches of all VFATs are updated together,
+ *           followed by a single wait and the read of all ADCs, repeated nReads times.
  *  \param la Local arguments structure
  *  \param ohN Optical link
  *  \param dacSelect Monitor Sel for ADC monitoring in VFAT3, see documentation for GBL_CFG_CTR_4 in VFAT3 manual for more details
  *  \param dacStep step size to scan the dac in
  *  \param mask VFAT mask to use, a value of 1 in the N^th bit indicates the N^th VFAT is masked
  *  \param useExtRefADC if (true) false use the (externally) internally referenced ADC on the VFAT3 for monitoring
- *  \return Returns a std::vector<uint32_t> object of size 24*(dacMax-dacMin+1)/dacStep where dacMax and dacMin are described in the VFAT3 manual.  For each element bits [7:0] are the dacValue, bits [17:8] are the ADC readback value in either current or voltage units depending on dacSelect (again, see VFAT3 manual), bits [22:18] are the VFAT position, and bits [26:23] are the optohybrid number.
+ *  \param nReads number of ADC reads averaged per point
+ *  \param stopOnVariance stop averaging, after at least 10 reads, once the standard error of the mean is below half an ADC count on every VFAT
+ *  \return Returns a std::vector<uint32_t> object of size 24*scanPoints(dacMin, dacMax, dacStep) where dacMax and dacMin are described in the VFAT3 manual.  For each element bits [7:0] are the dacValue, bits [17:8] are the ADC readback value in either current or voltage units depending on dacSelect (again, see VFAT3 manual), bits [22:18] are the VFAT position, and bits [26:23] are the optohybrid number.
  */
-std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false);
+std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false, uint32_t nReads=100, bool stopOnVariance=false);
 
 /*! \fn void dacScan(const RPCMsg *request, RPCMsg *response)
  *  \brief allows the host machine to perform a dacScan for all unmasked VFATs on a given optohybrid, see Local version for details.
+ *  \details The optional "nReads" (default 100) and "stopOnVariance" keys set the averaging of the ADC, also for dacScanMultiLink.
  *  \param request rpc request message
  *  \param response rpc responce message
  */
@@ -342,6 +441,16 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response);
 
 /*! \fn void genChannelScan(const RPCMsg *request, RPCMsg *response)
  *  \brief Generic per channel scan. See the local callable methods documentation for details
+ *  \details With the "adaptive" key every channel is scanned by genScanAdaptiveLocal (see calibration_routines/adaptive_scan.h for the additional keys).
+ *           The number of points of every channel is returned in "nPoints", the points in "dacPoints" and the counts in "data", both concatenated over the channels,
+ *           the counts of a channel being indexed as [vfat][point]
+ *  \details With the "fit" key the S-curve of every channel is analysed on the board (see calibration_routines/scurve_fit.h), the results are returned in
+ *           "scurveThreshold", "scurveNoise", "scurveChi2" and "scurveFlags", indexed as [vfat][channel]. The counts ("data", and "dacPoints" for adaptive scans)
+ *           are then only returned with the "returnRaw" key
+ *  \details With the "grouping" key (and optionally "groupSize", default 8) the channels are pulsed in groups, see calibration_routines/channel_groups.h,
+ *           with the same output format
+ *  \details With the optional "resultFile" key every completed point is also appended to that scan result file, see calibration_routines/result_file.h
+ *  \details The size of each result array is returned in "<key>Size", arrays above SCAN_MAX_RESPONSE_WORDS are returned in chunks, see calibration_routines/result_buffer.h
  *  \param request RPC response message
  *  \param response RPC response message
  */
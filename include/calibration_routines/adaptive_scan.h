@@ -0,0 +1,69 @@
+/*! \file calibration_routines/adaptive_scan.h
+ *  \brief Adaptive generic scan for v3 electronics, concentrating the points on the turn-on of the S-curves
+ *
+ *  A uniform scan spends most of its trigger bursts on the plateaus at 0% and 100% efficiency.
+ *  The adaptive scan first takes a coarse pass over the full range, then bisects, down to the fine
+ *  step, only the intervals in which the counts of at least one unmasked VFAT change by more than
+ *  the plateau threshold, most changing interval first. Since one burst measures all VFATs, the
+ *  refined points are shared by the VFATs, and the points actually taken are returned with the data.
+ */
+
+#ifndef CALIBRATION_ROUTINES_ADAPTIVE_SCAN_H
+#define CALIBRATION_ROUTINES_ADAPTIVE_SCAN_H
+
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+struct calPulseState;
+
+/*! \struct adaptiveScanParams
+ *  Range and refinement parameters of an adaptive scan
+ */
+struct adaptiveScanParams {
+    uint32_t dacMin;
+    uint32_t dacMax;
+    uint32_t fineStep;      ///< smallest distance between two points
+    uint32_t coarseStep;    ///< step of the first pass over [dacMin, dacMax], dacMax is always taken
+    uint32_t maxPoints;     ///< step budget, coarse points included, 0 for no limit
+    uint32_t plateauCounts; ///< an interval is refined if the counts of one VFAT differ by more than this between its ends
+};
+
+/*! \fn bool checkAdaptiveScanParams(localArgs *la, const adaptiveScanParams & params)
+ *  \brief Checks the range, steps and budget of an adaptive scan, sets the error in the response otherwise
+ */
+bool checkAdaptiveScanParams(localArgs *la, const adaptiveScanParams & params);
+
+/*! \fn adaptiveScanParams getAdaptiveScanParams(const RPCMsg *request, uint32_t nevts)
+ *  \brief Reads the adaptive scan keys of a genScan or genChannelScan request
+ *  \details "dacMin", "dacMax", "dacStep" (the fine step), and optionally "coarseStep" (default 8 fine steps),
+ *           "maxPoints" (default 0, no limit) and "plateauCounts" (default 5% of nevts, at least 1)
+ */
+adaptiveScanParams getAdaptiveScanParams(const RPCMsg *request, uint32_t nevts);
+
+/*! \fn void genScanAdaptiveLocal(localArgs *la, std::vector<uint32_t> & dacPoints, std::vector<uint32_t> & outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, const adaptiveScanParams & params, std::string scanReg, bool useExtTrig, calPulseState *calState)
+ *  \brief Adaptive version of genScanLocal, v3 electronics only
+ *
+ *  * Coarse pass from dacMin to dacMax in steps of coarseStep
+ *  * Bisection of the interval with the largest count difference above plateauCounts, until all intervals are flat,
+ *    no longer than fineStep, or maxPoints points were taken
+ *
+ *  \param la Local arguments structure
+ *  \param dacPoints Filled with the scan register values taken, in increasing order
+ *  \param outData Filled with the GOOD_EVENTS_COUNT of the points, indexed as [vfat][point] (24*dacPoints.size() words), 0 for masked VFATs
+ *  \param ohN Optical link
+ *  \param mask VFAT mask
+ *  \param ch Channel of interest
+ *  \param useCalPulse Use  calibration pulse if true
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor
+ *  \param nevts Number of events per calibration point
+ *  \param params Range and refinement parameters
+ *  \param scanReg DAC register to scan over name
+ *  \param useExtTrig Set to 1 in order to use the backplane triggers
+ *  \param calState Calibration pulse state kept across the channels of a channel scan, see genScanLocal; nullptr for a single scan
+ */
+void genScanAdaptiveLocal(localArgs *la, std::vector<uint32_t> & dacPoints, std::vector<uint32_t> & outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, const adaptiveScanParams & params, std::string scanReg, bool useExtTrig, calPulseState *calState=nullptr);
+
+#endif
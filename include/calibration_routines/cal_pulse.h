@@ -0,0 +1,96 @@
+/*! \file calibration_routines/cal_pulse.h
+ *  \brief Batched calibration pulse configuration for v3 electronics
+ *
+ *  A calibration pulse configuration describes the whole target state of an optohybrid: the VFATs
+ *  concerned, the set of pulsed channels and the pulse mode. applyCalPulseConfigLocal computes the
+ *  register words that differ from the current state and writes them in one memhub transaction.
+ *
+ *  The current state is read back from the VFATs when it is not known. A calPulseState kept across
+ *  calls remembers the words already read or written, so that moving the pulse from one channel
+ *  (or channel group) to the next in a scan costs only the writes of the channel registers that
+ *  change, with no reads and no rewrite of the unchanged CFG_CAL_* registers.
+ */
+
+#ifndef CALIBRATION_ROUTINES_CAL_PULSE_H
+#define CALIBRATION_ROUTINES_CAL_PULSE_H
+
+#include "utils.h"
+#include "hw_constants.h"
+
+#include <array>
+#include <bitset>
+
+/*! \brief Value of CFG_CAL_MODE */
+enum calPulseMode {
+    CALPULSE_OFF     = 0x0,
+    CALPULSE_VOLTAGE = 0x1,
+    CALPULSE_CURRENT = 0x2,
+};
+
+/*! \struct calPulseConfig
+ *  Target calibration pulse state of one optohybrid
+ */
+struct calPulseConfig {
+    uint32_t ohN;               ///< Optical link number
+    uint32_t vfatMask;          ///< VFATs left untouched, a 1 in the n^th bit skips the n^th VFAT
+    std::bitset<128> channels;  ///< Channels of interest
+    calPulseMode mode;          ///< CALPULSE_OFF disables the pulse on the channels of interest
+    uint32_t calScaleFactor;    ///< CFG_CAL_FS of the current pulse (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
+    bool exclusive;             ///< Also disable the pulse on channels never configured through the state, which reads back all 128 channel registers
+    bool unmask;                ///< Unmask the channels of interest and mask the channels that leave the set
+};
+
+/*! \struct calPulseState
+ *  Known register words of the VFATs of one optohybrid, to carry over consecutive calls of applyCalPulseConfigLocal
+ *  \details The state must be dropped (see invalidate) when the channel or CFG_CAL_* registers are written by other means in between,
+ *           e.g. when restoring the channel registers with applyChanMask
+ */
+struct calPulseState {
+    struct vfatWords {
+        std::bitset<128> known;    ///< channel words read back or written
+        std::bitset<128> pulsed;   ///< channels with the pulse enabled through this state
+        std::bitset<128> unmasked; ///< channels unmasked through this state
+        std::array<uint32_t, 128> chan;
+        bool cfgKnown = false;
+        std::array<uint32_t, 3> cfg; ///< words holding CFG_CAL_MODE, CFG_CAL_FS and CFG_CAL_DUR
+    };
+
+    uint32_t ohN = 0xFFFFFFFF; ///< optohybrid the words belong to
+    std::array<vfatWords, oh::VFATS_PER_OH> vfats;
+
+    void invalidate() { ohN = 0xFFFFFFFF; }
+
+    /*! \brief Drops the CFG_CAL_* words only, e.g. after writing a scan register that may share their words */
+    void invalidateCfg()
+    {
+        for (auto & vfat : vfats)
+            vfat.cfgKnown = false;
+    }
+};
+
+/*! \fn calPulseConfig makeCalPulseConfig(uint32_t ohN, uint32_t vfatMask, bool toggleOn, bool currentPulse, uint32_t calScaleFactor)
+ *  \brief Configuration with no channel of interest, to which channels are added
+ *  \param ohN Optical link number
+ *  \param vfatMask VFAT mask
+ *  \param toggleOn Pulse mode is CALPULSE_OFF if false, CALPULSE_CURRENT or CALPULSE_VOLTAGE otherwise
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor Scale factor for the current pulse height
+ */
+calPulseConfig makeCalPulseConfig(uint32_t ohN, uint32_t vfatMask, bool toggleOn, bool currentPulse, uint32_t calScaleFactor);
+
+/*! \fn bool applyCalPulseConfigLocal(localArgs *la, const calPulseConfig & config, calPulseState *state)
+ *  \brief Brings the calibration pulse of an optohybrid to the state described by config, v3 electronics only
+ *  \details On every VFAT not in config.vfatMask:
+ *            * CALPULSE_ENABLE is set on the channels of interest if the mode is not CALPULSE_OFF, and cleared otherwise
+ *            * CALPULSE_ENABLE is cleared on the channels previously pulsed through state (on all channels with config.exclusive)
+ *            * with config.unmask, MASK is cleared on the channels of interest and set on the other channels considered above
+ *            * CFG_CAL_MODE is set to the mode, and for CALPULSE_CURRENT CFG_CAL_FS to config.calScaleFactor and CFG_CAL_DUR to 0
+ *           Register words are only written if they change, all in one memhub transaction. Words missing in state are read back first, also in one transaction.
+ *  \param la Local arguments structure
+ *  \param config Target configuration
+ *  \param state Known register words, updated by the call; nullptr to read back everything needed
+ *  \return false, with the error set in the response, if the configuration is invalid or the registers could not be resolved
+ */
+bool applyCalPulseConfigLocal(localArgs *la, const calPulseConfig & config, calPulseState *state = nullptr);
+
+#endif
@@ -0,0 +1,60 @@
+/*! \file calibration_routines/channel_groups.h
+ *  \brief Channel scans with the calibration pulse on several channels at once
+ *
+ *  A channel group is a set of well separated channels that are pulsed together. The group is
+ *  configured once (calibration pulse, VFAT_DAQ_MONITOR) and the scan register is set once per
+ *  point for all of its channels. The VFAT_DAQ_MONITOR counts a single channel, so at every
+ *  point VFAT_CHANNEL_SELECT is rotated over the channels of the group, one burst each.
+ *
+ *  The way the 128 channels are split into groups is a named policy. The built-in policies are
+ *  "sequential" (one channel per group, as genScanLocal over all channels) and "interleaved"
+ *  (groupSize channels spaced by 128/groupSize, e.g. 0, 16, 32, ... for groupSize 8). Other
+ *  policies can be added with registerChannelGrouping.
+ */
+
+#ifndef CALIBRATION_ROUTINES_CHANNEL_GROUPS_H
+#define CALIBRATION_ROUTINES_CHANNEL_GROUPS_H
+
+#include "utils.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::vector<uint32_t> > channelGroups;
+
+/*! \brief Splits the 128 channels into groups, the argument is the requested group size */
+typedef std::function<channelGroups(uint32_t)> channelGroupingPolicy;
+
+/*! \fn void registerChannelGrouping(const std::string & name, channelGroupingPolicy policy)
+ *  \brief Adds or replaces a channel grouping policy
+ */
+void registerChannelGrouping(const std::string & name, channelGroupingPolicy policy);
+
+/*! \fn bool getChannelGroups(localArgs *la, const std::string & name, uint32_t groupSize, channelGroups & groups)
+ *  \brief Builds the channel groups of a policy
+ *  \details Fails, setting the error in the response, if the policy is unknown or its groups do not hold every channel exactly once
+ */
+bool getChannelGroups(localArgs *la, const std::string & name, uint32_t groupSize, channelGroups & groups);
+
+/*! \fn void genChannelScanGroupedLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, const channelGroups & groups, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+ *  \brief Per channel generic scan over channel groups, v3 electronics only
+ *  \details outData has the layout of genChannelScan: the count of VFAT vfatN at point i of channel ch is at scanDataIndex(nPoints, ch, vfatN, i)
+ *  \param la Local arguments structure
+ *  \param outData pointer to the results of the scan
+ *  \param ohN Optical link
+ *  \param mask VFAT mask
+ *  \param groups Channel groups, see getChannelGroups
+ *  \param useCalPulse Use  calibration pulse if true
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor
+ *  \param nevts Number of events per calibration point
+ *  \param dacMin Minimal value of scan variable
+ *  \param dacMax Maximal value of scan variable
+ *  \param dacStep Scan variable change step
+ *  \param scanReg DAC register to scan over name
+ *  \param useExtTrig Set to 1 in order to use the backplane triggers
+ */
+void genChannelScanGroupedLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, const channelGroups & groups, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig);
+
+#endif
@@ -0,0 +1,64 @@
+/*! \file calibration_routines/checkpoint.h
+ *  \brief Checkpoint and resume of the scans streamed to a scan result file
+ *
+ *  The checkpoint of a scan is its result file (see calibration_routines/result_file.h): the
+ *  number of complete records gives the completed channel and DAC index, and the register
+ *  snapshot taken before the scan started gives the state to put back before the scan is
+ *  continued, since the interrupted scan did not run its own cleanup.
+ */
+
+#ifndef CALIBRATION_ROUTINES_CHECKPOINT_H
+#define CALIBRATION_ROUTINES_CHECKPOINT_H
+
+#include "calibration_routines/result_file.h"
+
+#include <string>
+#include <vector>
+
+/*! \fn std::vector<uint32_t> snapshotScanStateLocal(localArgs *la, const scanResultHeader & hdr)
+ *  \brief Reads the registers the scan described by hdr modifies
+ *
+ *  * TTC generator and L1A enable, VFAT_DAQ_MONITOR control, VFAT3 slow control only mode
+ *  * per optohybrid in hdr.ohMask: trigger VFAT_MASK and SBIT_CNT_PERSIST
+ *  * per unmasked VFAT: the scan register, and the channel registers (mask, calibration pulse enable, trim) of the channels
+ *    the scan pulses or masks: channel hdr.ch, or all channels for genChannelScan and for sbitRateScan of a single channel
+ *
+ *  \param la Local arguments structure
+ *  \param hdr Header of the result file, with the scan parameters filled
+ *  \return (address, mask, value) triplets, registers missing from the address table are skipped
+ */
+std::vector<uint32_t> snapshotScanStateLocal(localArgs *la, const scanResultHeader & hdr);
+
+/*! \fn void restoreScanStateLocal(localArgs *la, const ScanResultFile & file)
+ *  \brief Writes back the register snapshot of a scan result file, in reverse order of the snapshot
+ */
+void restoreScanStateLocal(localArgs *la, const ScanResultFile & file);
+
+/*! \fn uint32_t scanStepsRemainingLocal(localArgs *la, const std::string & path)
+ *  \brief Number of scan steps left to take to complete the scan of a result file, 0 if the file is not valid
+ */
+uint32_t scanStepsRemainingLocal(localArgs *la, const std::string & path);
+
+/*! \fn void resumeScanLocal(localArgs *la, const std::string & path, bool restoreOnly=false)
+ *  \brief Continues an interrupted scan from the last completed point of its result file
+ *
+ *  * Restores the register snapshot of the file
+ *  * Drops the records of a partially recorded step (multi optohybrid scans record one record per optohybrid and step)
+ *  * Runs the remaining points with the original parameters, appending to the same file, which is marked complete at the end
+ *
+ *  \param la Local arguments structure
+ *  \param path Scan result file of the interrupted scan
+ *  \param restoreOnly Only restore the register snapshot, do not continue the scan
+ */
+void resumeScanLocal(localArgs *la, const std::string & path, bool restoreOnly=false);
+
+/*! \fn void resumeScan(const RPCMsg *request, RPCMsg *response)
+ *  \brief Continues an interrupted scan. See the local callable methods documentation for details
+ *  \details Keys are "resultFile" and optionally "restoreOnly". The number of records in the file at the end is returned in "nRecords".
+ *           To resume in the background use submitScan with the "resume" scanType and the "resultFile" key.
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void resumeScan(const RPCMsg *request, RPCMsg *response);
+
+#endif
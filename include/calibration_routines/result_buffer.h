@@ -0,0 +1,49 @@
+/*! \file calibration_routines/result_buffer.h
+ *  \brief Bounded, pooled storage for the results of the calibration scans
+ *
+ *  The scan results used to live in variable length arrays on the stack of the RPC process, a
+ *  full range genChannelScan alone needing ~3 MB, and had to fit in a single response. The
+ *  buffers are now taken from a per process pool on the heap, reused by the next scan of the
+ *  same client, with an explicit upper size. Arrays larger than SCAN_MAX_RESPONSE_WORDS are
+ *  returned in chunks: the response carries the first chunk, the client fetches the rest from
+ *  the pool with fetchScanResultBuffer (or streams the scan to a result file in the first place).
+ */
+
+#ifndef CALIBRATION_ROUTINES_RESULT_BUFFER_H
+#define CALIBRATION_ROUTINES_RESULT_BUFFER_H
+
+#include "utils.h"
+
+#include <string>
+
+const size_t SCAN_MAX_BUFFER_WORDS   = 4*1024*1024; ///< 16 MB per result array
+const size_t SCAN_MAX_RESPONSE_WORDS = 256*1024;    ///< 1 MB per result array in one response
+
+/*! \fn bool checkScanRange(localArgs *la, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep)
+ *  \brief Checks that the scan range is usable to size the result buffers, sets the error in the response otherwise
+ */
+bool checkScanRange(localArgs *la, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep);
+
+/*! \fn uint32_t * scanResultBuffer(localArgs *la, const std::string & key, size_t nWords)
+ *  \brief Returns the zeroed pool buffer for the result array key, holding nWords words
+ *  \details The buffer stays valid until the next call with the same key in this process.
+ *           Returns nullptr and sets the error in the response if nWords exceeds SCAN_MAX_BUFFER_WORDS
+ */
+uint32_t * scanResultBuffer(localArgs *la, const std::string & key, size_t nWords);
+
+/*! \fn void setScanResultArray(localArgs *la, const std::string & key, size_t nWords)
+ *  \brief Puts the first nWords words of the pool buffer key in the response
+ *  \details The full size is stored in "<key>Size". If it exceeds SCAN_MAX_RESPONSE_WORDS only the first SCAN_MAX_RESPONSE_WORDS words are stored in key
+ */
+void setScanResultArray(localArgs *la, const std::string & key, size_t nWords);
+
+/*! \fn void fetchScanResultBuffer(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns a chunk of a result array of the last scan run by this client
+ *  \details Keys are "key" (e.g. "data"), "offset" and "count" (default and maximum SCAN_MAX_RESPONSE_WORDS).
+ *           The words are returned in "data", the size of the array in "size".
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void fetchScanResultBuffer(const RPCMsg *request, RPCMsg *response);
+
+#endif
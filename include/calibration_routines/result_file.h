@@ -0,0 +1,190 @@
+/*! \file calibration_routines/result_file.h
+ *  \brief Memory mapped, append-only files receiving the points of a scan while it runs
+ *
+ *  The file starts with a self-describing header (scan parameters, masks, firmware release,
+ *  timestamps) followed by fixed size records, one per completed point. A record is appended by
+ *  writing it into the mapping and only then increasing the record count in the header, so a
+ *  reader (or the host, after the scan died) always sees complete records only.
+ *
+ *  Record layout: word 0 is (ohN << 8) | ch, word 1 is the scan register value, followed by
+ *  payloadWords words (e.g. the 24 GOOD_EVENTS_COUNT values of a generic scan).
+ *
+ *  After the records the file holds the state of the registers the scan modifies, taken before
+ *  the scan started, as (address, mask, value) triplets. Together with the record count this is
+ *  the checkpoint from which an interrupted scan is resumed, see calibration_routines/checkpoint.h.
+ */
+
+#ifndef CALIBRATION_ROUTINES_RESULT_FILE_H
+#define CALIBRATION_ROUTINES_RESULT_FILE_H
+
+#include "utils.h"
+#include "hw_constants.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+const uint32_t SCAN_RESULT_MAGIC       = 0x4e435343; ///< "CSCN"
+const uint32_t SCAN_RESULT_VERSION     = 3;
+const uint32_t SCAN_RESULT_HEADER_SIZE = 4096;       ///< bytes, records start at this offset
+const uint32_t SCAN_RESULT_RECORD_HEADER_WORDS = 2;
+
+/*! \struct scanResultHeader
+ *  Header at the start of a scan result file, all words in host (little endian) order
+ */
+struct scanResultHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;   ///< bytes before the first record
+    uint32_t recordWords;  ///< SCAN_RESULT_RECORD_HEADER_WORDS + payloadWords
+    uint32_t payloadWords;
+    uint32_t maxRecords;   ///< the file is sized for this number of records
+    uint32_t nRecords;     ///< number of complete records
+    uint32_t complete;     ///< 1 once the scan finished
+    uint32_t fwMajor;      ///< GEM_AMC.GEM_SYSTEM.RELEASE
+    uint32_t fwMinor;
+    uint32_t fwBuild;
+    uint32_t createdTime;  ///< unix time
+    uint32_t updatedTime;  ///< unix time of the last appended record
+    uint32_t ohMask;
+    uint32_t vfatMask[amc::OH_PER_AMC];
+    uint32_t ch;
+    uint32_t nevts;
+    uint32_t dacMin;
+    uint32_t dacMax;
+    uint32_t dacStep;
+    uint32_t flags;        ///< bit 0: calibration pulse, bit 1: current pulse, bit 2: external triggers, bit 3: SBIT rate integration window
+    uint32_t calScaleFactor;
+    uint32_t nRestore;      ///< number of (address, mask, value) triplets of the register snapshot
+    uint32_t restoreOffset; ///< bytes from the start of the file to the register snapshot
+    char     scanType[32];
+    char     scanReg[32];
+    uint32_t rateMinTimeMs;       ///< integration window of an sbitRateScan (see sbitRateWindow), valid if bit 3 of flags is set
+    uint32_t rateMaxTimeMs;
+    uint32_t rateTargetPrecision;
+    uint32_t rateQuietPoints;
+};
+
+struct sbitRateWindow;
+
+/*! \class ScanResultFile
+ *  Writer of a scan result file, see openScanResultFile
+ */
+class ScanResultFile {
+public:
+    ScanResultFile(void *mapping, size_t size, const std::string & path);
+    ScanResultFile(const ScanResultFile&) = delete;
+    ScanResultFile& operator=(const ScanResultFile&) = delete;
+    ~ScanResultFile();
+
+    /*! \brief Appends one record, ignored once the file is full
+     *  \param ohN Optohybrid of the point
+     *  \param ch Channel of the point
+     *  \param dacVal Scan register value of the point
+     *  \param payload payloadWords words of data
+     */
+    void append(uint32_t ohN, uint32_t ch, uint32_t dacVal, const uint32_t *payload);
+
+    /*! \brief Marks the scan as complete */
+    void finish();
+
+    /*! \brief Drops the records from nRecords on, used to discard a partially recorded scan step before resuming */
+    void truncate(uint32_t nRecords);
+
+    /*! \brief Register snapshot, header().nRestore (address, mask, value) triplets */
+    const uint32_t * restoreState() const;
+
+    const scanResultHeader & header() const { return *m_header; }
+    const std::string & path() const { return m_path; }
+
+private:
+    scanResultHeader *m_header;
+    uint32_t *m_records;
+    size_t m_size;
+    std::string m_path;
+};
+
+/*! \fn void initScanResultHeader(localArgs *la, scanResultHeader & hdr, const std::string & scanType, const std::string & scanReg, uint32_t payloadWords, uint32_t maxRecords)
+ *  \brief Zeroes the header and fills the format, firmware and time fields; the caller fills the scan parameters
+ */
+void initScanResultHeader(localArgs *la, scanResultHeader & hdr, const std::string & scanType, const std::string & scanReg, uint32_t payloadWords, uint32_t maxRecords);
+
+/*! \fn std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const scanResultHeader & hdr, const std::vector<uint32_t> & restoreState)
+ *  \brief Creates (or truncates) the result file at path and writes the header and the register snapshot
+ *  \details Only paths accepted by allowedDataPath are opened, without following symbolic links. On failure the error is set in the response and nullptr is returned
+ *  \param restoreState (address, mask, value) triplets
+ */
+std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const scanResultHeader & hdr, const std::vector<uint32_t> & restoreState=std::vector<uint32_t>());
+
+/*! \fn std::unique_ptr<ScanResultFile> reopenScanResultFile(localArgs *la, const std::string & path)
+ *  \brief Maps an existing result file to append to it
+ *  \details On failure the error is set in the response and nullptr is returned
+ */
+std::unique_ptr<ScanResultFile> reopenScanResultFile(localArgs *la, const std::string & path);
+
+/*! \fn uint32_t scanPoints(uint32_t dacMin, uint32_t dacMax, uint32_t dacStep)
+ *  \brief Number of points taken by a scan loop from dacMin to dacMax (included) in steps of dacStep
+ */
+inline uint32_t scanPoints(uint32_t dacMin, uint32_t dacMax, uint32_t dacStep)
+{
+    return (dacMax-dacMin)/dacStep+1;
+}
+
+/*! \fn size_t scanDataIndex(uint32_t nPoints, uint32_t block, uint32_t vfatN, uint32_t point)
+ *  \brief Index of a point in the [block][vfat][point] arrays filled by the scans, nPoints being given by scanPoints
+ *  \details block is the channel for genChannelScan, the optohybrid for genScanMultiLink and sbitRateScan, and 0 for genScan.
+ *           When dacStep divides dacMax-dacMin+1 this is the historical block*24*(dacMax-dacMin+1)/dacStep + vfatN*(dacMax-dacMin+1)/dacStep + point;
+ *           otherwise that expression let consecutive VFATs overlap and dropped the last point
+ *  \param point Index of the DAC value, (dacVal-dacMin)/dacStep
+ */
+inline size_t scanDataIndex(uint32_t nPoints, uint32_t block, uint32_t vfatN, uint32_t point)
+{
+    return (size_t(block)*oh::VFATS_PER_OH + vfatN)*nPoints + point;
+}
+
+/*! \fn std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const std::string & scanType, const std::string & scanReg, uint32_t ohMask, uint32_t vfatMask, uint32_t ch, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, uint32_t flags, uint32_t calScaleFactor, const sbitRateWindow *window)
+ *  \brief Creates the result file of one of the streaming scans (genScan, genChannelScan, genScanMultiLink, sbitRateScan)
+ *  \details Determines the record size and count from the scan type and takes the register snapshot (see snapshotScanStateLocal).
+ *           For genScan and genChannelScan vfatMask is stored as the mask of the optohybrid in ohMask, for the multi-link scans (whatever
+ *           the number of optohybrids in ohMask) the masks are read with getOHVFATMaskLocal and vfatMask is ignored
+ *  \param flags bit 0: calibration pulse, bit 1: current pulse, bit 2: external triggers
+ *  \param window Integration window of an sbitRateScan, stored so that a resumed scan uses it too; nullptr for the fixed window
+ */
+std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const std::string & scanType, const std::string & scanReg, uint32_t ohMask, uint32_t vfatMask, uint32_t ch, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, uint32_t flags, uint32_t calScaleFactor, const sbitRateWindow *window=nullptr);
+
+/*! \fn uint32_t scanResultFlags(bool useCalPulse, bool currentPulse, bool useExtTrig)
+ *  \brief Packs the boolean scan options into the flags word of the header
+ */
+inline uint32_t scanResultFlags(bool useCalPulse, bool currentPulse, bool useExtTrig)
+{
+    return (useCalPulse ? 0x1 : 0x0) | (currentPulse ? 0x2 : 0x0) | (useExtTrig ? 0x4 : 0x0);
+}
+
+/*! \fn void scanResultAppend(uint32_t ohN, uint32_t ch, uint32_t dacVal, const uint32_t *payload)
+ *  \brief Appends a record to the result file active in this process, no-op if there is none
+ *  \details Called by the scan loops for every completed point
+ */
+void scanResultAppend(uint32_t ohN, uint32_t ch, uint32_t dacVal, const uint32_t *payload);
+
+/*! \class ScanResultSink
+ *  Makes a result file the active one of the process for its lifetime, and marks it complete when the scan returned without error and was not cancelled
+ */
+class ScanResultSink {
+public:
+    ScanResultSink(localArgs *la, std::unique_ptr<ScanResultFile> file);
+    ~ScanResultSink();
+private:
+    localArgs *m_la;
+    std::unique_ptr<ScanResultFile> m_file;
+};
+
+/*! \fn void readScanResultFile(const RPCMsg *request, RPCMsg *response)
+ *  \brief Reads complete records from a scan result file, also while the scan is running
+ *  \details Keys are "path", "first" (first record, default 0) and "count" (default and maximum is what fits in 16384 words).
+ *           The header fields are returned with their names, the records in "data" and the number of returned records in "count".
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void readScanResultFile(const RPCMsg *request, RPCMsg *response);
+
+#endif
@@ -0,0 +1,47 @@
+/*! \file calibration_routines/sbit_mapping.h
+ *  \brief On-board analysis of the sbit mapping check
+ *
+ *  The words of checkSbitMappingWithCalPulseLocal are compared with the expected mapping (see the
+ *  sbit namespace of hw_constants.h): a pulse on channel ch of VFAT vfatN must give a cluster on
+ *  vfatN covering sbit ch/2. Every pulse is classified as correct (such a cluster was seen),
+ *  wrong strip (only other clusters were seen) or missed (no cluster), per channel. Only the
+ *  words of the wrong strip pulses are kept for the client.
+ */
+
+#ifndef CALIBRATION_ROUTINES_SBIT_MAPPING_H
+#define CALIBRATION_ROUTINES_SBIT_MAPPING_H
+
+#include "utils.h"
+
+#include <vector>
+
+const uint32_t SBIT_MAPPING_CLUSTERS      = 8; ///< clusters read from the sbit monitor per pulse
+const uint32_t SBIT_MAPPING_CLUSTER_SIZES = 8; ///< cluster size values, [0,7]
+
+/*! \struct sbitMappingSummary
+ *  Per channel summary of the sbit mapping check of one VFAT
+ */
+struct sbitMappingSummary {
+    std::vector<uint32_t> correct;      ///< pulses with a cluster covering the expected sbit, per channel
+    std::vector<uint32_t> wrongStrip;   ///< pulses with valid clusters, none covering the expected sbit, per channel
+    std::vector<uint32_t> missed;       ///< pulses without any valid cluster, per channel
+    std::vector<uint32_t> clusterSizes; ///< histogram of the size of the valid clusters, indexed as [ch*8+size]
+};
+
+/*! \fn uint32_t analyzeSbitMapping(const uint32_t *data, uint32_t nevts, uint32_t vfatN, sbitMappingSummary & summary, uint32_t *mismatches)
+ *  \brief Compares the result of checkSbitMappingWithCalPulseLocal with the expected mapping
+ *  \param data Words of checkSbitMappingWithCalPulseLocal, 128*8*nevts words
+ *  \param nevts Number of pulses per channel
+ *  \param vfatN Pulsed VFAT
+ *  \param summary Per channel summary, resized to 128 channels
+ *  \param mismatches Array of 128*8*nevts words to hold the 8 words of every wrong strip pulse, may be data itself
+ *  \return Number of words stored in mismatches
+ */
+uint32_t analyzeSbitMapping(const uint32_t *data, uint32_t nevts, uint32_t vfatN, sbitMappingSummary & summary, uint32_t *mismatches);
+
+/*! \fn void setSbitMappingSummary(RPCMsg *response, const sbitMappingSummary & summary)
+ *  \brief Stores the summary in "correct", "wrongStrip", "missed" and "clusterSizes"
+ */
+void setSbitMappingSummary(RPCMsg *response, const sbitMappingSummary & summary);
+
+#endif
@@ -0,0 +1,121 @@
+/*! \file calibration_routines/scan_engine.h
+ *  \brief Register plan and step execution of the generic DAC scan for v3 electronics
+ *
+ *  All registers touched by a scan step are resolved once per (OH, scan register) and cached until
+ *  the address table changes, so that the time per step is dominated by the triggers and not by
+ *  address table lookups and name formatting.
+ */
+
+#ifndef CALIBRATION_ROUTINES_SCAN_ENGINE_H
+#define CALIBRATION_ROUTINES_SCAN_ENGINE_H
+
+#include "utils.h"
+#include "hw_constants.h"
+
+#include <array>
+#include <string>
+
+/*! \struct genScanPlan
+ *  Registers used by a generic scan step on one optohybrid
+ */
+struct genScanPlan {
+    bool valid = false; ///< false if one of the registers could not be resolved
+
+    std::array<RegHandle, oh::VFATS_PER_OH> scanReg;         ///< GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_<scanReg>
+    std::array<uint32_t,  oh::VFATS_PER_OH> goodEventsCount;  ///< VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT addresses
+    std::array<uint32_t,  oh::VFATS_PER_OH> channelFireCount; ///< VFAT_DAQ_MONITOR.VFAT%i.CHANNEL_FIRE_COUNT addresses
+
+    RegHandle daqMonReset;      ///< GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.RESET
+    RegHandle daqMonEnable;     ///< GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE
+    RegHandle daqMonOHSelect;   ///< GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.OH_SELECT
+    RegHandle daqMonChanSelect; ///< GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_SELECT
+    RegHandle ttcCyclicStart;   ///< GEM_AMC.TTC.GENERATOR.CYCLIC_START
+    RegHandle ttcGenEnable;     ///< GEM_AMC.TTC.GENERATOR.ENABLE
+    RegHandle ttcCyclicRunning; ///< GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING
+    RegHandle ttcL1AEnable;     ///< GEM_AMC.TTC.CTRL.L1A_ENABLE
+    RegHandle ttcCntReset;      ///< GEM_AMC.TTC.CTRL.CNT_RESET
+    uint32_t  l1aCount;         ///< GEM_AMC.TTC.CMD_COUNTERS.L1A address
+};
+
+/*! \fn const genScanPlan & getGenScanPlan(localArgs *la, uint32_t ohN, const std::string & scanReg)
+ *  \brief Returns the register plan of a generic scan, building it on first use and after an address table update
+ *  \param la Local arguments structure
+ *  \param ohN Optical link
+ *  \param scanReg DAC register to scan over name, without the CFG_ prefix
+ */
+const genScanPlan & getGenScanPlan(localArgs *la, uint32_t ohN, const std::string & scanReg);
+
+/*! \fn bool checkGenScanLocal(localArgs *la, uint32_t ohN, uint32_t mask, bool currentPulse, uint32_t calScaleFactor)
+ *  \brief Checks that a generic scan can run: all unmasked VFATs are synced and CFG_CAL_FS is valid for a current pulse
+ *  \details Sets the error in the response and returns false otherwise
+ *  \param la Local arguments structure
+ *  \param ohN Optical link
+ *  \param mask VFAT mask
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor CFG_CAL_FS value of the current pulse
+ */
+bool checkGenScanLocal(localArgs *la, uint32_t ohN, uint32_t mask, bool currentPulse, uint32_t calScaleFactor);
+
+/*! \fn void confScanTriggersLocal(localArgs *la, uint32_t nevts, bool useExtTrig)
+ *  \brief Configures the trigger source of a generic scan: backplane triggers blocked until a burst, or nevts triggers per burst of the TTC generator
+ *  \param la Local arguments structure
+ *  \param nevts Number of events per burst
+ *  \param useExtTrig Use the backplane triggers instead of the TTC generator
+ */
+void confScanTriggersLocal(localArgs *la, uint32_t nevts, bool useExtTrig);
+
+/*! \fn void readScanRegWords(localArgs *la, const genScanPlan & plan, uint32_t mask, uint32_t *regWords)
+ *  \brief Reads the full register words holding the scan register of the unmasked VFATs
+ *  \details The other fields of these words do not change during a scan, so the words are read once and the scan register is merged in for every step, which saves the read of the read-modify-write
+ *  \param la Local arguments structure
+ *  \param plan Scan plan
+ *  \param mask VFAT mask
+ *  \param regWords Array of oh::VFATS_PER_OH words to hold the register words
+ */
+void readScanRegWords(localArgs *la, const genScanPlan & plan, uint32_t mask, uint32_t *regWords);
+
+/*! \fn void writeScanRegLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal)
+ *  \brief Sets the scan register of all unmasked VFATs in one memhub transaction
+ *  \param la Local arguments structure
+ *  \param plan Scan plan
+ *  \param mask VFAT mask
+ *  \param regWords Register words from readScanRegWords
+ *  \param dacVal Value of the scan register
+ */
+void writeScanRegLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal);
+
+/*! \fn void sendScanTriggersLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig)
+ *  \brief Sends a burst of triggers from the TTC generator, or lets nevts backplane triggers through, and waits until it is done
+ *  \param la Local arguments structure
+ *  \param plan Scan plan
+ *  \param nevts Number of events (only used with useExtTrig, the generator is configured with the burst size beforehand)
+ *  \param useExtTrig Wait for nevts backplane triggers instead of using the TTC generator
+ */
+void sendScanTriggersLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig);
+
+/*! \fn void genScanBurstLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents)
+ *  \brief Counts one burst of triggers with the VFAT_DAQ_MONITOR at the current scan register value
+ *  \details The VFAT_DAQ_MONITOR and the trigger source must already be configured (see dacMonConfLocal)
+ *  \param la Local arguments structure
+ *  \param plan Scan plan
+ *  \param nevts Number of events
+ *  \param useExtTrig Wait for nevts backplane triggers instead of using the TTC generator
+ *  \param goodEvents Array of oh::VFATS_PER_OH words to hold the GOOD_EVENTS_COUNT of every VFAT
+ */
+void genScanBurstLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents);
+
+/*! \fn void genScanStepLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents)
+ *  \brief Executes one point of a generic scan: sets the scan register, sends the triggers and reads the VFAT_DAQ_MONITOR counters
+ *  \details The VFAT_DAQ_MONITOR and the trigger source must already be configured (see dacMonConfLocal)
+ *  \param la Local arguments structure
+ *  \param plan Scan plan
+ *  \param mask VFAT mask
+ *  \param regWords Register words from readScanRegWords
+ *  \param dacVal Value of the scan register
+ *  \param nevts Number of events
+ *  \param useExtTrig Wait for nevts backplane triggers instead of using the TTC generator
+ *  \param goodEvents Array of oh::VFATS_PER_OH words to hold the GOOD_EVENTS_COUNT of every VFAT
+ */
+void genScanStepLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents);
+
+#endif
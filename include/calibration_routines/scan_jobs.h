@@ -0,0 +1,72 @@
+/*! \file calibration_routines/scan_jobs.h
+ *  \brief Asynchronous execution of the long calibration scans
+ *
+ *  A scan submitted as a job runs in a detached worker process, so it neither blocks the RPC
+ *  connection of the submitter nor dies with it: the client may disconnect and poll the job from
+ *  a new connection. The job table lives in a shared memory file because every RPC client is
+ *  served by its own process. Only one job may drive the hardware at a time. The worker is forked
+ *  from the single threaded client process and opens its own LMDB environment, see utils/worker.h.
+ *
+ *  Supported scan types are genScan, genChannelScan, genScanMultiLink, dacScanMultiLink and
+ *  sbitRateScan, submitted with the same RPC keys as the synchronous methods. Like for the
+ *  synchronous methods the "resultFile" key streams the points to a scan result file (see
+ *  calibration_routines/result_file.h), except for dacScanMultiLink. The "resume" scan type
+ *  continues the interrupted scan of the result file given in "resultFile" (see resumeScanLocal).
+ */
+
+#ifndef CALIBRATION_ROUTINES_SCAN_JOBS_H
+#define CALIBRATION_ROUTINES_SCAN_JOBS_H
+
+#include "utils.h"
+
+#include <string>
+
+/*! \fn bool scanJobCancelled()
+ *  \brief Returns true if the current process is the worker of a scan job that was cancelled
+ *  \details Scan loops check it at every point and leave the loop early, so that the cleanup after the loop still runs. Always false outside of a job worker.
+ */
+bool scanJobCancelled();
+
+/*! \fn void scanJobStep(uint32_t dacVal)
+ *  \brief Reports that one point of the scan was taken, no-op outside of a job worker
+ *  \param dacVal Value of the scan register at this point
+ */
+void scanJobStep(uint32_t dacVal);
+
+/*! \fn void submitScan(const RPCMsg *request, RPCMsg *response)
+ *  \brief Starts a scan in a worker process and returns immediately
+ *  \details The "scanType" key selects the scan, the other keys are the ones of the synchronous method.
+ *           The job ID is returned in "jobId". Fails if another job is still running.
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void submitScan(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void getScanProgress(const RPCMsg *request, RPCMsg *response)
+ *  \brief Reports the state of the job "jobId"
+ *  \details Fills "status" (RUNNING, DONE, FAILED or CANCELLED), "stepsDone", "stepsTotal", "percent", "dacVal", "elapsedMs" and "etaMs".
+ *           The error of a failed job is reported in "jobError", and the names of the result arrays of a finished job in "results".
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void getScanProgress(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void cancelScan(const RPCMsg *request, RPCMsg *response)
+ *  \brief Requests the job "jobId" to stop
+ *  \details The worker leaves the scan loop at the next point, runs the cleanup of the scan (calibration pulse, channel masks, run mode)
+ *           and restores the TTC and VFAT_DAQ_MONITOR state found at submission. The job then goes to the CANCELLED state.
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void cancelScan(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void fetchScanResults(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns a chunk of the results of a finished job
+ *  \details Keys are "jobId", "name" (result array, default is the first one), "offset" (default 0) and "count" (default and maximum 16384 words).
+ *           The words are returned in "data", the full size of the array in "size".
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void fetchScanResults(const RPCMsg *request, RPCMsg *response);
+
+#endif
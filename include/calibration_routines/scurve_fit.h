@@ -0,0 +1,45 @@
+/*! \file calibration_routines/scurve_fit.h
+ *  \brief On-board analysis of the S-curves of a channel scan
+ *
+ *  The threshold and noise of a channel are estimated from the moments of the derivative of its
+ *  S-curve: the efficiency differences between consecutive points, taken at the middle of each
+ *  interval, form a sampled Gaussian whose mean is the 50% point and whose width is the noise.
+ *  The estimate needs no iteration and works for rising and falling curves and for non-uniform
+ *  points (adaptive scans). The quality is the chi2 per degree of freedom of the error function
+ *  with these parameters against the counts, with binomial errors.
+ *
+ *  The sums over the points use NEON on the CTP7, with a scalar fallback for other targets. The
+ *  arithmetic (fitSCurve) is in calibration_routines/scurve_math.h.
+ */
+
+#ifndef CALIBRATION_ROUTINES_SCURVE_FIT_H
+#define CALIBRATION_ROUTINES_SCURVE_FIT_H
+
+#include "utils.h"
+#include "calibration_routines/scurve_math.h"
+
+#include <vector>
+
+const float SCURVE_FIXED_POINT_SCALE = 1000.; ///< threshold, noise and chi2 are returned in units of 1/1000
+
+/*! \fn void fitSCurvesLocal(const uint32_t *data, const uint32_t *dacPoints, uint32_t nPoints, uint32_t nevts, uint32_t mask, uint32_t ch, std::vector<uint32_t> *results)
+ *  \brief Analyses the S-curves of one channel on the 24 VFATs of a genChannelScan
+ *  \details The results are stored in fixed point (see SCURVE_FIXED_POINT_SCALE) at index vfatN*128+ch of
+ *           results[0] (threshold), results[1] (noise), results[2] (chi2 per degree of freedom) and results[3] (flags),
+ *           which must hold 24*128 words each
+ *  \param data Counts of the channel, indexed as [vfat][point]
+ *  \param dacPoints Scan register values of the points
+ *  \param nPoints Number of points
+ *  \param nevts Number of events per point
+ *  \param mask VFAT mask of the scan
+ *  \param ch Channel
+ *  \param results Array of 4 result vectors
+ */
+void fitSCurvesLocal(const uint32_t *data, const uint32_t *dacPoints, uint32_t nPoints, uint32_t nevts, uint32_t mask, uint32_t ch, std::vector<uint32_t> *results);
+
+/*! \fn void setSCurveFitResults(RPCMsg *response, std::vector<uint32_t> *results)
+ *  \brief Stores the results of fitSCurvesLocal in "scurveThreshold", "scurveNoise", "scurveChi2" and "scurveFlags"
+ */
+void setSCurveFitResults(RPCMsg *response, std::vector<uint32_t> *results);
+
+#endif
@@ -0,0 +1,186 @@
+/*! \file calibration_routines/scurve_math.h
+ *  \brief Arithmetic of the S-curve analysis, see calibration_routines/scurve_fit.h
+ *
+ *  Kept free of the module dependencies so that it can be built and tested on a PC (see test/scurve_fit_test.cxx).
+ */
+
+#ifndef CALIBRATION_ROUTINES_SCURVE_MATH_H
+#define CALIBRATION_ROUTINES_SCURVE_MATH_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+const uint32_t SCURVE_FLAG_DEAD      = 0x1; ///< efficiency below 10% at every point
+const uint32_t SCURVE_FLAG_NOISY     = 0x2; ///< no turn-on and efficiency above 50% at every point
+const uint32_t SCURVE_FLAG_NO_TURNON = 0x4; ///< no transition in the range, threshold and noise are not valid
+const uint32_t SCURVE_FLAG_MASKED    = 0x8; ///< VFAT masked in the scan
+
+/*! \struct scurveFitResult
+ *  Analysis result of one channel
+ */
+struct scurveFitResult {
+    float threshold; ///< scan register value at 50% of the turn-on
+    float noise;     ///< width of the turn-on, in scan register units
+    float chi2ndf;   ///< chi2 per degree of freedom of the error function against the counts
+    uint32_t flags;  ///< SCURVE_FLAG_* bits
+};
+
+/*! \struct scurveMoments
+ *  Sums of the S-curve derivative, in counts, and extrema of the counts
+ */
+struct scurveMoments {
+    float sw   = 0.; ///< sum of the count differences, i.e. last minus first count
+    float swx  = 0.; ///< first moment, around the centre of the range
+    float swx2 = 0.; ///< second moment, around the centre of the range
+    uint32_t minCount = 0xFFFFFFFF;
+    uint32_t maxCount = 0;
+};
+
+/*! \fn void addSCurveMoments(scurveMoments & m, const uint32_t *counts, const float *x, uint32_t first, uint32_t nPoints, float centre)
+ *  \brief Adds the intervals from point first on to the sums, one at a time
+ */
+inline void addSCurveMoments(scurveMoments & m, const uint32_t *counts, const float *x, uint32_t first, uint32_t nPoints, float centre)
+{
+    for (uint32_t i = first; i + 1 < nPoints; ++i) {
+        float w  = float(counts[i+1]) - float(counts[i]);
+        float xm = 0.5*(x[i] + x[i+1]) - centre;
+        m.sw   += w;
+        m.swx  += w*xm;
+        m.swx2 += w*xm*xm;
+        m.minCount = std::min(m.minCount, counts[i]);
+        m.maxCount = std::max(m.maxCount, counts[i]);
+    }
+    m.minCount = std::min(m.minCount, counts[nPoints-1]);
+    m.maxCount = std::max(m.maxCount, counts[nPoints-1]);
+}
+
+/*! \fn scurveMoments scurveMomentsScalar(const uint32_t *counts, const float *x, uint32_t nPoints, float centre)
+ *  \brief Moments of the S-curve derivative without vector instructions, the reference of scurveMomentsFast
+ */
+inline scurveMoments scurveMomentsScalar(const uint32_t *counts, const float *x, uint32_t nPoints, float centre)
+{
+    scurveMoments m;
+    addSCurveMoments(m, counts, x, 0, nPoints, centre);
+    return m;
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+namespace scurve_neon {
+    inline float horizontalSum(float32x4_t v)
+    {
+        float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpadd_f32(s, s), 0);
+    }
+
+    inline uint32_t horizontalMin(uint32x4_t v)
+    {
+        uint32x2_t m = vpmin_u32(vget_low_u32(v), vget_high_u32(v));
+        return vget_lane_u32(vpmin_u32(m, m), 0);
+    }
+
+    inline uint32_t horizontalMax(uint32x4_t v)
+    {
+        uint32x2_t m = vpmax_u32(vget_low_u32(v), vget_high_u32(v));
+        return vget_lane_u32(vpmax_u32(m, m), 0);
+    }
+}
+#endif
+
+/*! \fn scurveMoments scurveMomentsFast(const uint32_t *counts, const float *x, uint32_t nPoints, float centre)
+ *  \brief Moments of the S-curve derivative, four intervals at a time with NEON, same as scurveMomentsScalar on other targets
+ */
+inline scurveMoments scurveMomentsFast(const uint32_t *counts, const float *x, uint32_t nPoints, float centre)
+{
+    scurveMoments m;
+    uint32_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    using namespace scurve_neon;
+    float32x4_t vsw   = vdupq_n_f32(0.);
+    float32x4_t vswx  = vdupq_n_f32(0.);
+    float32x4_t vswx2 = vdupq_n_f32(0.);
+    uint32x4_t vmin   = vdupq_n_u32(0xFFFFFFFF);
+    uint32x4_t vmax   = vdupq_n_u32(0);
+    const float32x4_t vcentre = vdupq_n_f32(centre);
+    for (; i + 4 < nPoints; i += 4) {
+        uint32x4_t c0 = vld1q_u32(counts + i);
+        uint32x4_t c1 = vld1q_u32(counts + i + 1);
+        float32x4_t w  = vsubq_f32(vcvtq_f32_u32(c1), vcvtq_f32_u32(c0));
+        float32x4_t xm = vsubq_f32(vmulq_n_f32(vaddq_f32(vld1q_f32(x + i), vld1q_f32(x + i + 1)), 0.5), vcentre);
+        float32x4_t wx = vmulq_f32(w, xm);
+        vsw   = vaddq_f32(vsw, w);
+        vswx  = vaddq_f32(vswx, wx);
+        vswx2 = vmlaq_f32(vswx2, wx, xm);
+        vmin  = vminq_u32(vmin, c0);
+        vmax  = vmaxq_u32(vmax, c0);
+    }
+    m.sw       = horizontalSum(vsw);
+    m.swx      = horizontalSum(vswx);
+    m.swx2     = horizontalSum(vswx2);
+    m.minCount = horizontalMin(vmin);
+    m.maxCount = horizontalMax(vmax);
+#endif
+    addSCurveMoments(m, counts, x, i, nPoints, centre);
+    return m;
+}
+
+/*! \fn scurveFitResult fitSCurve(const uint32_t *counts, const float *dacPoints, uint32_t nPoints, uint32_t nevts)
+ *  \brief Estimates the threshold and noise of one S-curve
+ *  \details A curve with a valid turn-on is analysed whatever its efficiency level, so rising, falling and partial curves are not
+ *           flagged noisy; SCURVE_FLAG_NOISY is only set, together with SCURVE_FLAG_NO_TURNON, on a flat curve above 50%
+ *  \param counts Hit counts of the nPoints points
+ *  \param dacPoints Scan register values of the points, in increasing order
+ *  \param nPoints Number of points
+ *  \param nevts Number of events per point
+ */
+inline scurveFitResult fitSCurve(const uint32_t *counts, const float *dacPoints, uint32_t nPoints, uint32_t nevts)
+{
+    scurveFitResult result = {0., 0., 0., 0x0};
+    if (nPoints < 3 || nevts == 0) {
+        result.flags = SCURVE_FLAG_NO_TURNON;
+        return result;
+    }
+
+    const float nev    = nevts;
+    const float centre = 0.5*(dacPoints[0] + dacPoints[nPoints-1]);
+    scurveMoments m = scurveMomentsFast(counts, dacPoints, nPoints, centre);
+
+    if (m.maxCount < 0.1*nev) {
+        result.flags = SCURVE_FLAG_DEAD | SCURVE_FLAG_NO_TURNON;
+        return result;
+    }
+    //The turn-on must be complete and monotonic enough for the moments to describe it
+    if (fabsf(m.sw) < 0.1*nev || fabsf(m.sw) < 0.5*(m.maxCount - m.minCount)) {
+        result.flags = (m.minCount > 0.5*nev) ? (SCURVE_FLAG_NOISY | SCURVE_FLAG_NO_TURNON) : SCURVE_FLAG_NO_TURNON;
+        return result;
+    }
+
+    float mean     = m.swx/m.sw;
+    float variance = m.swx2/m.sw - mean*mean;
+    result.threshold = mean + centre;
+    result.noise     = (variance > 0.) ? sqrtf(variance) : 0.; //0 for a turn-on sharper than the point spacing
+
+    //Error function through the first and last points with these parameters, rising or falling with the counts
+    const float first = counts[0];
+    const float step  = float(counts[nPoints-1]) - first;
+    float chi2 = 0.;
+    for (uint32_t i = 0; i < nPoints; ++i) {
+        float cdf;
+        if (result.noise > 0.)
+            cdf = 0.5*(1. + erff((dacPoints[i] - result.threshold)/(M_SQRT2*result.noise)));
+        else
+            cdf = (dacPoints[i] < result.threshold) ? 0. : ((dacPoints[i] > result.threshold) ? 1. : 0.5);
+        float expected = first + step*cdf;
+        float variance = std::max(expected*(1. - expected/nev), 1.);
+        float diff     = float(counts[i]) - expected;
+        chi2 += diff*diff/variance;
+    }
+    result.chi2ndf = chi2/(nPoints - 2);
+    return result;
+}
+
+#endif
@@ -11,6 +11,24 @@
 #include <unistd.h>
 
 const int NOH_MAX = 12;
+const uint32_t ORBIT_LENGTH_NS = 3564*25; ///< Length of one LHC orbit, used for the link counter integration
+
+/*! \brief Category bits understood by getmonAll
+ */
+namespace moncat {
+    constexpr uint32_t TTC       = 0x001; ///< getmonTTCmain registers
+    constexpr uint32_t TRIGGER   = 0x002; ///< getmonTRIGGERmain registers
+    constexpr uint32_t TRIGGEROH = 0x004; ///< getmonTRIGGEROHmain registers
+    constexpr uint32_t DAQ       = 0x008; ///< getmonDAQmain registers
+    constexpr uint32_t DAQOH     = 0x010; ///< getmonDAQOHmain registers
+    constexpr uint32_t GBTLINK   = 0x020; ///< getmonGBTLink registers
+    constexpr uint32_t VFATLINK  = 0x040; ///< getmonVFATLink registers
+    constexpr uint32_t OH        = 0x080; ///< getmonOHmain registers
+    constexpr uint32_t OHSYSMON  = 0x100; ///< getmonOHSysmon registers
+    constexpr uint32_t OHSCA     = 0x200; ///< getmonOHSCAmain registers
+    constexpr uint32_t SCA       = 0x400; ///< getmonSCA registers
+    constexpr uint32_t ALL       = 0x7ff; ///< All of the above
+}
 
 /*! \fn void getmonDAQmainLocal(localArgs * la)
  *  \brief Local version of getmonDAQmain
@@ -89,6 +107,7 @@ void getmonOHSCAmainLocal(localArgs *la, int NOH=12, int ohMask=0xfff);
 
 /* !\fn void getmonOHSCAmain(const RPCMsg *request, RPCMsg *response)
  *  \brief Reads the SCA Monitoring values of all OH's (voltage and temperature); these quantities are reported in ADC units
+ *  \details If the "useCache" RPC key is set, the values are taken from the monitoring sampler cache instead, see getmonCachedLocal
  *  \param request RPC request message
  *  \param response RPC response message
  */
@@ -107,6 +126,7 @@ void getmonOHSysmonLocal(localArgs *la, int NOH=12, int ohMask=0xfff, bool doRes
  *  \brief reads FPGA Sysmon values of all unmasked OH's
  *  \details Reads FPGA core temperature, core voltage (1V), and I/O voltage (2.5V); these quantities are reported in ADC units.  The LSB for the core temperature correspons to 0.49 C.  The LSB for the core voltage (both 1V and 2.5V) corresponds to 2.93 mV.
  *  \details Will also check error conditions (over temperature, 1V VCCINT, and 2.5V VCCAUX), and the error conunters for those conditions.
+ *  \details If the "useCache" RPC key is set, the values are taken from the monitoring sampler cache instead, see getmonCachedLocal
  *  \param request RPC request message
  *  \param response RPC response message
  */
@@ -160,19 +180,42 @@ void getmonTTCmainLocal(localArgs * la);
  */
 void getmonTTCmain(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn void getmonVFATLinkLocal(const RPCMsg *request, RPCMsg *response);
+/*! \fn void getmonVFATLinkLocal(localArgs * la, int NOH, bool doReset, uint32_t nOrbits, bool snapshot)
  *  \brief Local version of getmonVFATLink
+ *  \details In snapshot mode the time window over which the counters of each OH were read is reported in "OH%i.WINDOW_START_US" and "OH%i.WINDOW_END_US". The times are relative to the link reset when doReset is true (i.e. they bound the integration time of the counters), otherwise to the start of the read pass. "SNAPSHOT.RESET" tells which reference was used and "SNAPSHOT.READ_US" holds the duration of the whole read pass.
  *  \param la Local arguments
  *  \param NOH Number of optohybrids in FW
  *  \param doReset boolean if true (false) a link reset will (not) be sent
+ *  \param nOrbits number of orbits to integrate over after the link reset, before the counters are read
+ *  \param snapshot boolean if true (false) the read window of every OH will (not) be reported
  */
-void getmonVFATLinkLocal(localArgs * la, int NOH=12, bool doReset=false);
+void getmonVFATLinkLocal(localArgs * la, int NOH=12, bool doReset=false, uint32_t nOrbits=1, bool snapshot=false);
 
 /*! \fn void getmonVFATLink(const RPCMsg *request, RPCMsg *response);
  *  \brief Reads the VFAT link status registers (LINK_GOOD, SYNC_ERR_CNT, etc...) for a particular ohMask
+ *  \details Accepts the optional "doReset", "nOrbits" and "snapshot" RPC keys, see getmonVFATLinkLocal
  *  \param request RPC request message
  *  \param response RPC response message
  */
 void getmonVFATLink(const RPCMsg *request, RPCMsg *response);
 
+/*! \fn void getmonAllLocal(localArgs * la, uint32_t categories, int NOH, int ohMask, bool doReset)
+ *  \brief Local version of getmonAll
+ *  \details Runs the requested monitoring categories back to back in a single pass. AMC side counters (TTC, DAQ, DAQ OH, OH event counters, trigger) are read first and adjacent to each other, so that the related counters are as close in time as possible; link counters follow, and the slow control (SCA, sysmon) reads, which go over the GBT, are done last. For every category that ran, the time spent is reported in the word "TIME.<CATEGORY>_US", and the whole pass in "TIME.TOTAL_US".
+ *  \param la Local arguments
+ *  \param categories Bitmask of moncat categories to read
+ *  \param NOH Number of optohybrids in FW
+ *  \param ohMask A 12 bit number which specifies which optohybrids to read from.  Having a value of 1 in the n^th bit indicates that the n^th optohybrid should be considered.
+ *  \param doReset boolean if true (false) the GBT/VFAT link counters will (not) be reset before they are read
+ */
+void getmonAllLocal(localArgs * la, uint32_t categories=moncat::ALL, int NOH=12, int ohMask=0xfff, bool doReset=false);
+
+/*! \fn void getmonAll(const RPCMsg *request, RPCMsg *response)
+ *  \brief Reads all requested monitoring categories in one RPC call
+ *  \details Expects the optional "categories" (default moncat::ALL), "ohMask", "NOH" and "doReset" RPC keys. The response contains the same words as the individual getmon* methods, plus the per category timing.
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void getmonAll(const RPCMsg *request, RPCMsg *response);
+
 #endif
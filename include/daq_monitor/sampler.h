@@ -0,0 +1,60 @@
+/*! \file daq_monitor/sampler.h
+ *  \brief Background sampler for the monitoring values (SCA ADC, FPGA sysmon, link counters)
+ *
+ *  The slow control monitoring values change on the time scale of seconds, while every
+ *  getmonOHSCAmain/getmonOHSysmon call reads all of them over the GBT links. The sampler
+ *  refreshes them in a single worker process (see utils/worker.h), one OH per tick so that the
+ *  slow control never sees a burst, and stores them in a cache shared between all client
+ *  processes (clients are forked, so the cache lives in a shared memory file). The client
+ *  processes only read the cache; they start a new worker when the sampler is enabled and the
+ *  worker went away or stopped updating its heartbeat.
+ *
+ *  Optionally the sampling process exports the cache after every full cycle over the OHs in
+ *  the OpenMetrics text format to a file (e.g. on a tmpfs), which is replaced atomically, so
+ *  that a node-local scraper can collect the values without any RPC or bus traffic.
+ */
+
+#ifndef DAQ_MONITOR_SAMPLER_H
+#define DAQ_MONITOR_SAMPLER_H
+
+#include "utils.h"
+
+/*!
+ * \defgroup sampler Cached slow monitoring
+ */
+
+/** Locally executed methods */
+/*!
+ * \brief Starts the sampler worker process if the sampler is enabled and no worker is sampling
+ * \details Called by configureMonitorSamplerLocal and getmonCachedLocal. The worker exits when the sampler is disabled
+ */
+void startMonitorSampler();
+
+/*!
+ * \brief Configures the background sampler, the configuration is shared by all client processes
+ * \param enable Enables (disables) the background sampling
+ * \param categories Bitmask of moncat categories to sample, only moncat::OHSCA, moncat::OHSYSMON, moncat::TRIGGEROH, moncat::GBTLINK and moncat::VFATLINK are supported
+ * \param cadenceMs Time in ms after which the values of a given OH are refreshed; the OHs are refreshed staggered over this period
+ * \param ohMask A 12 bit number which specifies which optohybrids to sample
+ * \param exportPath File to which the OpenMetrics text exposition is written, empty to disable the export. It must be accepted by allowedDataPath
+ */
+void configureMonitorSamplerLocal(localArgs* la, bool enable, uint32_t categories, uint32_t cadenceMs, uint32_t ohMask, std::string const& exportPath="");
+
+/*!
+ * \brief Fills the response with the cached values of the requested categories
+ * \details The values are stored with the same keys as the direct read methods, the age in ms of every value is stored in "<key>.AGE_MS".
+ *          Values that were never sampled are reported as 0xdeaddead with an age of 0xffffffff.
+ * \param categories Bitmask of moncat categories to report
+ * \param NOH Number of optohybrids in FW
+ * \param ohMask A 12 bit number which specifies which optohybrids to report
+ */
+void getmonCachedLocal(localArgs* la, uint32_t categories, int NOH=12, int ohMask=0xfff);
+
+/** RPC callbacks */
+/*!
+ * \brief Configures the background sampler
+ * \details Expects the "enable" RPC key, optional are "categories" (default moncat::OHSCA|moncat::OHSYSMON), "cadenceMs" (default 1000), "ohMask" (default 0xfff) and "exportPath" (default none)
+ */
+void configureMonitorSampler(const RPCMsg *request, RPCMsg *response);
+
+#endif
@@ -38,6 +38,36 @@ namespace oh {
     using namespace GEM_VARIANT;
 }
 
+/*! \brief This namespace hold the constants related to the trigger (sbit) data of an OptoHybrid.
+ */
+namespace sbit {
+    constexpr uint32_t CHANNELS_PER_SBIT = 2;  ///< The number of VFAT channels ORed into one sbit (trigger pad).
+    constexpr uint32_t SBITS_PER_VFAT    = 64; ///< The number of sbits of a VFAT.
+    constexpr uint32_t MONITOR_CLUSTERS  = 8;  ///< The number of clusters latched by the SBIT monitor.
+    constexpr uint32_t CLUSTER_SIZES     = 8;  ///< The number of cluster size values, the size field has 3 bits.
+    constexpr uint32_t L1A_DELAY_BINS    = 4096; ///< L1A delays histogrammed, the SBIT monitor is read 4095 clock cycles after its reset.
+
+    /*! \brief GE1/1 specific namespace.
+     */
+    namespace ge11 {
+        constexpr uint32_t SBIT_ADDRESSES = 24*SBITS_PER_VFAT; ///< Cluster addresses are valid below this value.
+
+        /*! \brief VFAT position of a cluster address, the addresses run over 3 VFAT columns and then over the 8 eta partitions in reverse.
+         */
+        constexpr uint32_t addressToVFAT(uint32_t address) { return 7 - address/(3*SBITS_PER_VFAT) + ((address%(3*SBITS_PER_VFAT))/SBITS_PER_VFAT)*8; }
+    }
+
+    using namespace GEM_VARIANT;
+
+    /*! \brief Sbit of a cluster address within its VFAT.
+     */
+    constexpr uint32_t addressToSbit(uint32_t address) { return address % SBITS_PER_VFAT; }
+
+    /*! \brief Sbit a VFAT channel belongs to.
+     */
+    constexpr uint32_t channelToSbit(uint32_t channel) { return channel / CHANNELS_PER_SBIT; }
+}
+
 /*! \brief This namespace hold the constants related to the OptoHybrid.
  */
 namespace vfat {
@@ -21,6 +21,20 @@ int memhub_close(memsvc_handle_t *handle);
  */
 int memhub_read(memsvc_handle_t handle, uint32_t addr, uint32_t words, uint32_t *data);
 int memhub_write(memsvc_handle_t handle, uint32_t addr, uint32_t words, const uint32_t *data);
+
+/* Writes n single words to n (not necessarily contiguous) addresses, holding the semaphore only once.
+ *
+ * Returns -1 on the first error (the remaining words are not written) and 0 on success.
+ */
+int memhub_write_list(memsvc_handle_t handle, uint32_t n, const uint32_t *addrs, const uint32_t *data);
+
+/* Reads n single words from n (not necessarily contiguous) addresses, holding the semaphore only once.
+ * Consecutive entries with consecutive word addresses (addrs[i+1] == addrs[i]+4) are read with one block read.
+ *
+ * Returns -1 on the first error (the remaining words are not read) and 0 on success.
+ */
+int memhub_read_list(memsvc_handle_t handle, uint32_t n, const uint32_t *addrs, uint32_t *data);
+
 void die(int signo);
 
 #ifdef __cplusplus
@@ -13,6 +13,7 @@
 #include "lmdb_cpp_wrapper.h"
 #include "xhal/utils/XHALXMLParser.h"
 
+#include <sys/types.h>
 #include <unistd.h>
 #include <iostream>
 #include <string>
@@ -56,6 +57,46 @@ static constexpr uint32_t LMDB_SIZE = 1UL * 1024UL * 1024UL * 50UL; ///< Maximum
 
 struct localArgs getLocalArgs(RPCMsg *response);
 
+static constexpr const char* AT_GENERATION_KEY = "__AT_GENERATION__"; ///< LMDB key holding the address table generation
+
+/*! \fn uint32_t getAddressTableGeneration(localArgs * la)
+ *  \brief Returns the generation of the address table, which is increased by every update_address_table call
+ *  \details Anything cached from the address table (addresses, masks, register lists) must be rebuilt when the generation changes.
+ *            Returns 0 for an address table created before the generation was introduced.
+ *  \param la Local arguments structure
+ */
+uint32_t getAddressTableGeneration(localArgs * la);
+
+/*! \class ATGenerationCache
+ *  \brief Holds a value derived from the address table and rebuilds it lazily when the address table generation changes
+ *  \details The check is a single LMDB lookup, cheap compared to the register accesses the cached value saves
+ */
+template<typename T>
+class ATGenerationCache {
+  public:
+    /*! \brief Returns the cached value, calling build(la) first if the address table has changed since it was built
+     */
+    template<typename Builder>
+    T const& get(localArgs * la, Builder build) {
+      uint32_t generation = getAddressTableGeneration(la);
+      if (!m_valid || generation != m_generation) {
+        m_value      = build(la);
+        m_generation = generation;
+        m_valid      = true;
+      }
+      return m_value;
+    }
+
+    /*! \brief Forces a rebuild on the next access
+     */
+    void invalidate() { m_valid = false; }
+
+  private:
+    T m_value{};
+    uint32_t m_generation = 0;
+    bool m_valid = false;
+};
+
 template<typename Out>
 void split(const std::string &s, char delim, Out result) {
     std::stringstream ss;
@@ -219,4 +260,107 @@ void writeBlock(localArgs* la, const std::string& regName, const uint32_t* value
  */
 void writeBlock(const uint32_t& regAddr, const uint32_t* values, const uint32_t& size, const uint32_t& offset=0);
 
+/*! \struct regHandle
+ *  Address and mask of a register, resolved once from the address table so that loops do not repeat the LMDB lookup
+ */
+typedef struct regHandle {
+    uint32_t address = 0xdeaddead; /*!< Register address, 0xdeaddead if the register was not found */
+    uint32_t mask    = 0xffffffff; /*!< Register mask */
+} RegHandle;
+
+/*! \fn RegHandle getRegHandle(localArgs * la, const std::string & regName)
+ *  \brief Resolves the address and mask of a register. Sets the "error" key if the register is not found
+ *  \param la Local arguments structure
+ *  \param regName Register name
+ */
+RegHandle getRegHandle(localArgs * la, const std::string & regName);
+
+/*! \fn uint32_t readRegHandle(const RegHandle & reg, RPCMsg *response)
+ *  \brief Reads a value from a resolved register. Register mask is applied. Will return 0xdeaddead if register is no accessible
+ *  \param reg Register handle
+ *  \param response RPC response message
+ */
+uint32_t readRegHandle(const RegHandle & reg, RPCMsg *response);
+
+/*! \fn void writeRegHandle(const RegHandle & reg, uint32_t value, RPCMsg *response)
+ *  \brief Writes a value to a resolved register. Register mask is applied
+ *  \param reg Register handle
+ *  \param value Value to write
+ *  \param response RPC response message
+ */
+void writeRegHandle(const RegHandle & reg, uint32_t value, RPCMsg *response);
+
+/*! \fn void readAddressList(const uint32_t * addrs, uint32_t * result, size_t n, RPCMsg *response)
+ *  \brief Reads n raw addresses. Register masks are not applied
+ *  \details The whole list is read under one memhub lock, in address order, with one block read per contiguous run of addresses,
+ *            so no register outside of the list is ever read. On a memsvc error every address is read again on its own.
+ *  \param addrs Addresses to read
+ *  \param result Array of n words to hold the result
+ *  \param n Number of addresses
+ *  \param response RPC response message
+ */
+void readAddressList(const uint32_t * addrs, uint32_t * result, size_t n, RPCMsg *response);
+
+/*! \fn void writeAddressList(const uint32_t * addrs, const uint32_t * values, size_t n, RPCMsg *response)
+ *  \brief Writes n raw addresses in one memhub transaction. Register masks are not applied
+ *  \param addrs Addresses to write
+ *  \param values Values to write
+ *  \param n Number of addresses
+ *  \param response RPC response message
+ */
+void writeAddressList(const uint32_t * addrs, const uint32_t * values, size_t n, RPCMsg *response);
+
+/*! \fn bool logLevelEnabled(LogManager::LogLevel level)
+ *  \brief Returns true if messages of the given level are output by the logger; use it to skip building expensive log messages
+ *  \param level Log level
+ */
+bool logLevelEnabled(LogManager::LogLevel level);
+
+/*! \struct firmwareIdentity
+ *  Firmware registers that do not change while the firmware is loaded. A register absent from the address table reads 0xdeaddead
+ */
+struct firmwareIdentity {
+    uint32_t releaseMajor = 0xdeaddead; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR */
+    uint32_t releaseMinor = 0xdeaddead; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.MINOR */
+    uint32_t releaseBuild = 0xdeaddead; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.BUILD */
+    uint32_t numOfOH      = 0xdeaddead; /*!< GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH */
+    uint32_t gbtRAMSize   = 0xdeaddead; /*!< GEM_AMC.CONFIG_BLASTER.STATUS.GBT_RAM_SIZE */
+    uint32_t ohRAMSize    = 0xdeaddead; /*!< GEM_AMC.CONFIG_BLASTER.STATUS.OH_RAM_SIZE */
+    uint32_t vfatRAMSize  = 0xdeaddead; /*!< GEM_AMC.CONFIG_BLASTER.STATUS.VFAT_RAM_SIZE */
+};
+
+static constexpr uint32_t FW_IDENTITY_RECHECK_MS = 1000; ///< Interval at which getFirmwareIdentity checks the release registers for a firmware reload
+
+/*! \fn firmwareIdentity getFirmwareIdentity(localArgs * la)
+ *  \brief Returns a copy of the identity of the loaded firmware, read once per process
+ *  \details The identity is read again when the address table generation changes, or when the release registers, checked at most
+ *            every FW_IDENTITY_RECHECK_MS with one list read, show that another firmware was loaded. An identity with a failed register
+ *            read (0xdeaddead for a register of the address table) is returned but not cached. Safe to call from several threads.
+ *  \param la Local arguments structure
+ */
+firmwareIdentity getFirmwareIdentity(localArgs * la);
+
+/*! \fn void invalidateFirmwareIdentity()
+ *  \brief Forces getFirmwareIdentity to read the firmware registers on its next call
+ */
+void invalidateFirmwareIdentity();
+
+/*! \fn bool allowedDataPath(const std::string & path)
+ *  \brief Returns true if a client supplied file path lies below one of the directories the modules may write to
+ *  \details The directories are /mnt/persistent/, /dev/shm/ and /tmp/. Paths containing ".." are refused, and the parent
+ *            directory is resolved with realpath so that a symbolic link to a directory cannot lead outside of them
+ *  \param path Path to check
+ */
+bool allowedDataPath(const std::string & path);
+
+/*! \fn int openDataFile(const std::string & path, int flags, mode_t mode=0664)
+ *  \brief Opens a client supplied file path checked with allowedDataPath
+ *  \details The file is opened with O_NOFOLLOW, so the last component cannot be a symbolic link either
+ *  \param path Path of the file
+ *  \param flags Flags passed to open(2)
+ *  \param mode Mode of a created file
+ *  \return The file descriptor, or -1 with errno set (EACCES if the path is not allowed)
+ */
+int openDataFile(const std::string & path, int flags, mode_t mode=0664);
+
 #endif
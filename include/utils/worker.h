@@ -0,0 +1,48 @@
+/*! \file utils/worker.h
+ *  \brief Detached worker processes of the long running RPC methods
+ *
+ *  The scan jobs, the streaming sbit capture and the monitoring sampler run in a worker process
+ *  started with a double fork, so that the worker is neither a child of the RPC client process nor
+ *  dies with it. Their state is shared through a memory mapped control file in /dev/shm.
+ *
+ *  The RPC client processes of the modules are single threaded, so the fork does not copy a lock
+ *  held by another thread. The worker must not use the LMDB environment of the client process
+ *  (LMDB does not support an environment used across a fork); it opens its own with GETLOCALARGS
+ *  on a scratch message.
+ */
+
+#ifndef UTILS_WORKER_H
+#define UTILS_WORKER_H
+
+#include <cstdint>
+#include <functional>
+#include <sys/types.h>
+
+/*! \fn uint64_t monotonicNs()
+ *  \brief CLOCK_MONOTONIC in ns, comparable between processes
+ */
+uint64_t monotonicNs();
+
+/*! \fn bool processAlive(pid_t pid)
+ *  \brief Returns true if the process exists, also when it belongs to another user
+ *  \param pid Process ID, 0 or negative values are never alive
+ */
+bool processAlive(pid_t pid);
+
+/*! \fn void closeInheritedSockets()
+ *  \brief Closes the RPC connection sockets inherited from the client process
+ *  \details Otherwise the connection of the client would stay half open as long as the worker runs
+ */
+void closeInheritedSockets();
+
+/*! \fn bool startWorker(const std::function<void()> & body, const std::function<void(pid_t)> & started=nullptr)
+ *  \brief Runs body in a detached worker process
+ *  \details The worker closes the inherited sockets and ignores SIGPIPE before running body, and exits when
+ *           body returns; it never returns to the caller. The call waits for the intermediate process only.
+ *  \param body Work of the worker process
+ *  \param started If set, called in the intermediate process with the PID of the worker, to record it in the control file
+ *  \return false if the worker could not be started
+ */
+bool startWorker(const std::function<void()> & body, const std::function<void(pid_t)> & started=nullptr);
+
+#endif
@@ -11,8 +11,44 @@
 #include "utils.h"
 #include <string>
 
+const uint32_t VFAT_SYNC_CACHE_DEFAULT_US = 100000; ///< default validity window of the sync check cache, in microseconds
+
+/*! \class VFATSyncCacheScope
+ *  \brief Enables the sync check cache for its lifetime
+ *  \details Routines called from one RPC check the same OH many times (e.g. once per VFAT or once per channel).
+ *            While a scope is alive vfatSyncCheckLocal returns the status read less than the validity window ago instead of reading
+ *            the links again; the cache is dropped when the outermost scope ends, so nothing is kept between RPC calls.
+ *            Only RPCs that create a scope use the cache, the window of nested scopes is the one of the outermost.
+ */
+class VFATSyncCacheScope {
+  public:
+    /*! \brief Enables the cache with a validity window in microseconds, 0 to always read the links
+     */
+    explicit VFATSyncCacheScope(uint32_t validity);
+
+    /*! \brief Enables the cache with the window of the optional "syncCacheValidity" key of the request (microseconds), VFAT_SYNC_CACHE_DEFAULT_US if absent
+     */
+    explicit VFATSyncCacheScope(const RPCMsg *request);
+
+    ~VFATSyncCacheScope();
+
+    VFATSyncCacheScope(const VFATSyncCacheScope&) = delete;
+    VFATSyncCacheScope& operator=(const VFATSyncCacheScope&) = delete;
+};
+
+/*! \fn void vfatSyncCheckMultiLinkLocal(localArgs * la, uint32_t ohMask, uint32_t * goodVFATs)
+ *  \brief Checks the sync of the VFATs of several optohybrids
+ *  \details LINK_GOOD and SYNC_ERR_CNT of all the VFATs are read with one list read, using register handles resolved once per address table.
+ *            A VFAT is sync'ed if its link is good and has no sync error.
+ *  \param la Local arguments structure
+ *  \param ohMask Optohybrids to check, bit i for OHi
+ *  \param goodVFATs Array of amc::OH_PER_AMC words to hold the bitmask of sync'ed VFATs per OH, 0 for the OHs not in ohMask
+ */
+void vfatSyncCheckMultiLinkLocal(localArgs * la, uint32_t ohMask, uint32_t * goodVFATs);
+
 /*! \fn uint32_t vfatSyncCheckLocal(localArgs * la, uint32_t ohN)
  *  \brief Local callable version of vfatSyncCheck
+ *  \details Uses the cache if a VFATSyncCacheScope is alive
  *  \param la Local arguments structure
  *  \param ohN Optohybrid optical link number
  *  \return Bitmask of sync'ed VFATs
@@ -26,6 +62,13 @@ uint32_t vfatSyncCheckLocal(localArgs * la, uint32_t ohN);
  */
 void vfatSyncCheck(const RPCMsg *request, RPCMsg *response);
 
+/*! \fn void vfatSyncCheckMultiLink(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns the synchronized VFAT chips of the optohybrids in "ohMask", as the "goodVFATs" array of amc::OH_PER_AMC bitmasks
+ *  \param request RPC request message
+ *  \param response RPC responce message
+ */
+void vfatSyncCheckMultiLink(const RPCMsg *request, RPCMsg *response);
+
 /*! \fn void configureVFAT3DacMonitorLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t dacSelect)
  *  \brief configures the VFAT3s on optohybrid ohN to use their ADCs to monitor the DAC provided by dacSelect.
  *  \param la Local arguments structure
@@ -68,17 +111,27 @@ void configureVFAT3sLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask);
  */
 void configureVFAT3s(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData)
+/*! \brief Default spacing of the channel register transfers, in microseconds
+ *  \details 0 transfers the 128 channels of a VFAT in one list transaction. A non zero spacing (the "spacing" key of the RPC
+ *            methods, e.g. 200 as in the original one channel at a time transfer) is the fallback for links where the list transfer fails.
+ */
+const uint32_t VFAT_CHANNEL_REG_SPACING_US = 0;
+
+/*! \fn void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US)
  *  \brief reads all channel registers for unmasked vfats and stores values in chanRegData
+ *  \details The sync of the unmasked VFATs is checked once, then the channels of each VFAT are read in one transaction, or one at a time with a non zero spacing.
+ *            A summary with the measured transfer time is logged per VFAT.
  *  \param la Local arguments structure
  *  \param ohN Optical link
  *  \param mask VFAT mask
  *  \param chanRegData pointer to the container holding channel registers; expected to be an array of 3072 channels with idx = vfatN * 128 + chan
+ *  \param spacing if non zero, read one channel at a time and wait spacing microseconds between channels
  */
-void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData);
+void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US);
 
 /*! \fn void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response);
  *  \brief reads all vfat3 channel registers from host machine
+ *  \details The optional "spacing" key is passed to getChannelRegistersVFAT3Local
  *  \param request RPC request message
  *  \param response RPC responce message
  */
@@ -109,17 +162,20 @@ void readVFAT3ADC(const RPCMsg *request, RPCMsg *response);
  */
 void readVFAT3ADCMultiLink(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData)
+/*! \fn void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US)
  *  \brief writes all vfat3 channel registers from AMC
+ *  \details As getChannelRegistersVFAT3Local, the channels of each VFAT are written after a single sync check, in one transaction unless a spacing is given
  *  \param la Local arguments structure
  *  \param ohN Optical link
  *  \param vfatMask VFAT mask
  *  \param chanRegData pointer to the container holding channel registers; expected to be an array of 3072 channels with idx = vfatN * 128 + chan
+ *  \param spacing if non zero, write one channel at a time and wait spacing microseconds between channels
  */
-void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData);
+void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US);
 
-/*! \fn void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol);
+/*! \fn void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US);
  *  \brief writes all vfat3 channel registers from AMC
+ *  \details All trim values are checked before anything is written, the registers are then written as by setChannelRegistersVFAT3SimpleLocal
  *  \param ohN Optohybrid optical link number
  *  \param vfatMask Bitmask of chip positions determining which chips to use
  *  \param calEnable array pointer for calEnable with 3072 entries, the (vfat,chan) pairing determines the array index via: idx = vfat*128 + chan
@@ -128,11 +184,13 @@ void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t
  *  \param trimARMPol as calEnable but for arming comparator trim polarity
  *  \param trimZCC as calEnable but for zero crossing comparator trim value
  *  \param trimZCCPol as calEnable but for zero crossing comparator trim polarity
+ *  \param spacing see setChannelRegistersVFAT3SimpleLocal
  */
-void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol);
+void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol, uint32_t spacing=VFAT_CHANNEL_REG_SPACING_US);
 
 /*! \fn void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response);
  *  \brief writes all vfat3 channel registers from host machine
+ *  \details The optional "spacing" key is passed to the local methods
  *  \param request RPC request message
  *  \param response RPC responce message
  */
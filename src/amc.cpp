@@ -9,26 +9,29 @@
 #include "amc/ttc.h"
 #include "amc/daq.h"
 #include "amc/blaster_ram.h"
+#include "amc/sbit_capture.h"
+#include "hw_constants.h"
 
 #include <chrono>
 #include <string>
+#include <algorithm>
 #include <time.h>
 #include <thread>
 #include <vector>
 
 unsigned int fw_version_check(const char* caller_name, localArgs *la)
 {
-    int iFWVersion = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+    int iFWVersion = getFirmwareIdentity(la).releaseMajor;
     char regBuf[200];
     switch (iFWVersion) {
         case 1:
         {
-            LOGGER->log_message(LogManager::INFO, "System release major is 1, v2B electronics behavior");
+            LOGGER->log_message(LogManager::DEBUG, "System release major is 1, v2B electronics behavior");
             break;
         }
         case 3:
         {
-            LOGGER->log_message(LogManager::INFO, "System release major is 3, v3 electronics behavior");
+            LOGGER->log_message(LogManager::DEBUG, "System release major is 3, v3 electronics behavior");
             break;
         }
         default:
@@ -78,7 +81,7 @@ void getOHVFATMaskMultiLink(const RPCMsg *request, RPCMsg *response)
         ohMask = request->get_word("ohMask");
     }
 
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
     if (request->get_key_exists("NOH")) {
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -115,12 +118,9 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
 {
     //Setup the sbit monitor
     const int nclusters = 8;
-    writeReg(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.OH_SELECT", ohN);
-    uint32_t addrSbitMonReset=getAddress(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.RESET");
-    uint32_t addrSbitL1ADelay=getAddress(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY");
-    uint32_t addrSbitCluster[nclusters];
-    for (int iCluster=0; iCluster < nclusters; ++iCluster) {
-        addrSbitCluster[iCluster] = getAddress(la, stdsprintf("GEM_AMC.TRIGGER.SBIT_MONITOR.CLUSTER%i",iCluster) );
+    sbitMonitorRegs regs;
+    if (!setupSbitMonitorLocal(la, ohN, regs)) {
+        return std::vector<uint32_t>();
     }
 
     //Take the VFATs out of slow control only mode
@@ -131,56 +131,24 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
     //[14:26] L1A Delay (consider anything over 4095 as overflow)
     std::vector<uint32_t> storedSbits;
 
-    //readout sbits
-    time_t acquisitionTime,startTime;
-    bool acquire=true;
-    startTime=time(NULL);
+    //readout sbits, the acquisition time is measured on the monotonic clock
+    auto startTime = std::chrono::steady_clock::now();
+    auto endTime = startTime + std::chrono::seconds(acquireTime);
     (*maxNetworkSizeReached) = false;
-    uint32_t l1ADelay;
-    while(acquire) {
-        if ( sizeof(uint32_t) * storedSbits.size() > 65000 ) { //Max TCP/IP message is 65535
+    uint32_t tempSBits[nclusters]; //will only be stored into storedSbits if any is valid
+    while (std::chrono::steady_clock::now() < endTime) {
+        if ( sizeof(uint32_t) * storedSbits.size() > 65000 ) { //Max TCP/IP message is 65535, see startSbitCapture for longer acquisitions
             (*maxNetworkSizeReached) = true;
             break;
         }
 
         //Reset monitors
-        writeRawAddress(addrSbitMonReset, 0x1, la->response);
+        writeRawAddress(regs.reset, 0x1, la->response);
 
-        //wait for 4095 clock cycles then read L1A delay
+        //wait for 4095 clock cycles then read L1A delay and the clusters with one block read
         std::this_thread::sleep_for (std::chrono::nanoseconds(4095*25));
-        l1ADelay = readRawAddress(addrSbitL1ADelay, la->response);
-        if (l1ADelay > 4095) { //Anything larger than this consider as overflow
-            l1ADelay = 4095; //(0xFFF in hex)
-        }
-
-        //get sbits
-        bool anyValid=false;
-        std::vector<uint32_t> tempSBits; //will only be stored into storedSbits if anyValid is true
-        for (int cluster=0; cluster<nclusters; ++cluster) {
-            //bits [10:0] is the address of the cluster
-            //bits [14:12] is the cluster size
-            //bits 15 and 11 are not used
-            uint32_t thisCluster = readRawAddress(addrSbitCluster[cluster], la->response);
-            uint32_t sbitAddress = (thisCluster & 0x7ff);
-            int clusterSize = (thisCluster >> 12) & 0x7;
-            bool isValid = (sbitAddress < 1536); //Possible values are [0,(24*64)-1]
-
-            if (isValid) {
-                LOGGER->log_message(LogManager::INFO,stdsprintf("valid sbit data: thisClstr %x; sbitAddr %x;",thisCluster,sbitAddress));
-                anyValid=true;
-            }
-
-            //Store the sbit
-            tempSBits.push_back( ((l1ADelay & 0x1fff) << 14) + ((clusterSize & 0x7) << 11) + (sbitAddress & 0x7ff) );
-        } //End Loop over clusters
-
-        if (anyValid) {
-            storedSbits.insert(storedSbits.end(),tempSBits.begin(),tempSBits.end());
-        }
-
-        acquisitionTime=difftime(time(NULL),startTime);
-        if (uint32_t(acquisitionTime) > acquireTime) {
-            acquire=false;
+        if (readSbitMonitorLocal(la, regs, tempSBits)) {
+            storedSbits.insert(storedSbits.end(),tempSBits,tempSBits+nclusters);
         }
     } //End readout sbits
 
@@ -196,9 +164,9 @@ void sbitReadOut(const RPCMsg *request, RPCMsg *response)
 
     bool maxNetworkSizeReached = false;
 
-    time_t startTime=time(NULL);
+    auto startTime = std::chrono::steady_clock::now();
     std::vector<uint32_t> storedSbits = sbitReadOutLocal(&la, ohN, acquireTime, &maxNetworkSizeReached);
-    time_t approxLivetime=difftime(time(NULL),startTime);
+    uint32_t approxLivetime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - startTime).count();
 
     if (maxNetworkSizeReached) {
         response->set_word("maxNetworkSizeReached", maxNetworkSizeReached);
@@ -209,6 +177,77 @@ void sbitReadOut(const RPCMsg *request, RPCMsg *response)
     rtxn.abort();
 } //End sbitReadOut()
 
+void sbitHistogramLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, sbitHistograms & histos)
+{
+    histos.occupancy.assign(sbit::SBIT_ADDRESSES, 0);
+    histos.clusterSize.assign(sbit::CLUSTER_SIZES, 0);
+    histos.l1aDelay.assign(sbit::L1A_DELAY_BINS, 0);
+    histos.nReadouts  = 0;
+    histos.liveTimeMs = 0;
+
+    //Setup the sbit monitor
+    sbitMonitorRegs regs;
+    if (!setupSbitMonitorLocal(la, ohN, regs)) {
+        return;
+    }
+
+    //Take the VFATs out of slow control only mode
+    writeReg(la, "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE", 0x0);
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto endTime = startTime + std::chrono::seconds(acquireTime);
+    uint32_t packed[sbit::MONITOR_CLUSTERS];
+    uint32_t nClusters = 0;
+    while (std::chrono::steady_clock::now() < endTime && !la->response->get_key_exists("error")) {
+        //Reset monitors, wait for 4095 clock cycles then read L1A delay and the clusters
+        writeRawAddress(regs.reset, 0x1, la->response);
+        std::this_thread::sleep_for (std::chrono::nanoseconds((sbit::L1A_DELAY_BINS-1)*25));
+        ++histos.nReadouts;
+        if (!readSbitMonitorLocal(la, regs, packed)) {
+            continue;
+        }
+
+        for (uint32_t cluster=0; cluster<sbit::MONITOR_CLUSTERS; ++cluster) {
+            //Same layout as sbitReadOutLocal
+            uint32_t sbitAddress = packed[cluster] & 0x7ff;
+            uint32_t clusterSize = (packed[cluster] >> 11) & 0x7;
+            uint32_t l1ADelay = (packed[cluster] >> 14) & 0x1fff;
+            if (sbitAddress >= sbit::SBIT_ADDRESSES) { //Possible values are [0,(24*64)-1]
+                continue;
+            }
+
+            for (uint32_t addr = sbitAddress; addr <= sbitAddress + clusterSize && addr < sbit::SBIT_ADDRESSES; ++addr) {
+                ++histos.occupancy[addr];
+            }
+            ++histos.clusterSize[clusterSize];
+            ++histos.l1aDelay[std::min(l1ADelay, sbit::L1A_DELAY_BINS-1)];
+            ++nClusters;
+        }
+    }
+    histos.liveTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Histogrammed %u sbit clusters of OH%i in %u readouts over %u ms", nClusters, ohN, histos.nReadouts, histos.liveTimeMs));
+} //End sbitHistogramLocal(...)
+
+void sbitHistogram(const RPCMsg *request, RPCMsg *response)
+{
+    GETLOCALARGS(response);
+
+    uint32_t ohN = request->get_word("ohN");
+    uint32_t acquireTime = request->get_word("acquireTime");
+
+    sbitHistograms histos;
+    sbitHistogramLocal(&la, ohN, acquireTime, histos);
+
+    response->set_word_array("occupancy", histos.occupancy);
+    response->set_word_array("clusterSize", histos.clusterSize);
+    response->set_word_array("l1aDelay", histos.l1aDelay);
+    response->set_word("nReadouts", histos.nReadouts);
+    response->set_word("liveTimeMs", histos.liveTimeMs);
+
+    rtxn.abort();
+} //End sbitHistogram()
+
 extern "C" {
     const char *module_version_key = "amc v1.0.1";
     int module_activity_color = 4;
@@ -221,8 +260,14 @@ extern "C" {
 
         modmgr->register_method("amc", "getOHVFATMask",          getOHVFATMask);
         modmgr->register_method("amc", "getOHVFATMaskMultiLink", getOHVFATMaskMultiLink);
+        modmgr->register_method("amc", "sbitHistogram",          sbitHistogram);
         modmgr->register_method("amc", "sbitReadOut",            sbitReadOut);
 
+        // Streaming sbit capture methods (from amc/sbit_capture)
+        modmgr->register_method("amc", "fetchSbitCapture", fetchSbitCapture);
+        modmgr->register_method("amc", "startSbitCapture", startSbitCapture);
+        modmgr->register_method("amc", "stopSbitCapture",  stopSbitCapture);
+
         // DAQ module methods (from amc/daq)
         modmgr->register_method("amc", "enableDAQLink",           enableDAQLink);
         modmgr->register_method("amc", "disableDAQLink",          disableDAQLink);
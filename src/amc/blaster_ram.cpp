@@ -18,11 +18,11 @@ uint32_t getRAMMaxSize(localArgs *la, BLASTERTypeT const& type)
   uint32_t ram_size = 0x0;
   switch (type) {
   case (BLASTERType::GBT) :
-    return readReg(la, "GEM_AMC.CONFIG_BLASTER.STATUS.GBT_RAM_SIZE");
+    return getFirmwareIdentity(la).gbtRAMSize;
   case (BLASTERType::OptoHybrid) :
-    return readReg(la, "GEM_AMC.CONFIG_BLASTER.STATUS.OH_RAM_SIZE");
+    return getFirmwareIdentity(la).ohRAMSize;
   case (BLASTERType::VFAT) :
-    return readReg(la, "GEM_AMC.CONFIG_BLASTER.STATUS.VFAT_RAM_SIZE");
+    return getFirmwareIdentity(la).vfatRAMSize;
   case (BLASTERType::ALL) :
     ram_size  = getRAMMaxSize(la, BLASTERType::GBT);
     ram_size += getRAMMaxSize(la, BLASTERType::OptoHybrid);
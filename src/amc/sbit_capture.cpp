@@ -0,0 +1,410 @@
+/*!
+ * \file amc/sbit_capture.cpp
+ * \brief Streaming capture of the SBIT monitor
+ */
+
+#include "amc/sbit_capture.h"
+#include "utils/worker.h"
+#include "hw_constants.h"
+#include "LockTools.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  constexpr const char* SBIT_CAPTURE_SHM_FILE  = "/dev/shm/ctp7_sbit_capture";
+  constexpr const char* SBIT_CAPTURE_DATA_FILE = "/dev/shm/ctp7_sbit_capture.dat";
+  constexpr uint32_t SBIT_CAPTURE_VERSION      = 1;
+  constexpr size_t   SBIT_CAPTURE_PATH_SIZE    = 128;
+  constexpr size_t   SBIT_CAPTURE_ERROR_SIZE   = 256;
+  constexpr uint32_t SBIT_CAPTURE_MAX_WORDS    = 64*1024*1024; ///< 256 MB ring
+  constexpr uint32_t SBIT_MONITOR_CLUSTERS     = sbit::MONITOR_CLUSTERS;
+  constexpr uint32_t SBIT_MONITOR_WINDOW_NS    = (sbit::L1A_DELAY_BINS-1)*25; ///< the L1A delay saturates after 4095 BX
+
+  enum SbitCaptureStatus : uint32_t {
+    CAPTURE_IDLE = 0,
+    CAPTURE_RUNNING,
+    CAPTURE_DONE,
+    CAPTURE_STOPPED,
+    CAPTURE_FAILED
+  };
+  const char* const STATUS_NAMES[] = {"IDLE", "RUNNING", "DONE", "STOPPED", "FAILED"};
+
+  /*!
+   * \brief Layout of the shared memory control file, the ring itself is in the data file
+   */
+  struct SbitCaptureControl {
+    uint32_t version;
+    uint32_t id;
+    uint32_t status;
+    pid_t    pid;
+    uint32_t stop;
+    uint32_t ohN;
+    uint32_t capacity;       ///< words in the ring
+    uint32_t written;        ///< words written since the start, only accessed with atomic builtins
+    uint32_t nReadouts;
+    uint32_t nValidReadouts;
+    uint64_t startNs;        ///< CLOCK_MONOTONIC
+    uint64_t endNs;
+    uint64_t acquireNs;      ///< 0 to capture until stopped
+    char     dataFile[SBIT_CAPTURE_PATH_SIZE];
+    char     error[SBIT_CAPTURE_ERROR_SIZE];
+  };
+
+  SbitCaptureControl *control = nullptr;
+  int captureLockID = -1;
+  std::mutex captureMutex;
+
+  /*!
+   * \brief Scoped lock held while accessing the control fields, the ring and the written counter are lock free
+   */
+  class CaptureLock {
+  public:
+    CaptureLock() : m_guard(captureMutex) { namedlock_lock(captureLockID); }
+    ~CaptureLock() { namedlock_unlock(captureLockID); }
+  private:
+    std::lock_guard<std::mutex> m_guard;
+  };
+
+  /*!
+   * \brief Maps the control file, creating and initializing it if needed
+   */
+  SbitCaptureControl* mapControl()
+  {
+    if (control)
+      return control;
+
+    if (captureLockID < 0)
+      captureLockID = namedlock_init("amc", "sbit_capture");
+    if (captureLockID < 0) {
+      LOGGER->log_message(LogManager::ERROR, "Unable to initialize the sbit capture lock");
+      return nullptr;
+    }
+
+    int fd = open(SBIT_CAPTURE_SHM_FILE, O_RDWR|O_CREAT, 0664);
+    if (fd < 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to open %s: %s", SBIT_CAPTURE_SHM_FILE, strerror(errno)));
+      return nullptr;
+    }
+    if (ftruncate(fd, sizeof(SbitCaptureControl)) != 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to resize %s: %s", SBIT_CAPTURE_SHM_FILE, strerror(errno)));
+      close(fd);
+      return nullptr;
+    }
+    void *addr = mmap(nullptr, sizeof(SbitCaptureControl), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to map %s: %s", SBIT_CAPTURE_SHM_FILE, strerror(errno)));
+      return nullptr;
+    }
+
+    SbitCaptureControl *ctrl = static_cast<SbitCaptureControl*>(addr);
+    CaptureLock lock;
+    if (ctrl->version != SBIT_CAPTURE_VERSION) {
+      std::memset(ctrl, 0, sizeof(SbitCaptureControl));
+      ctrl->version = SBIT_CAPTURE_VERSION;
+    }
+    control = ctrl;
+    return control;
+  }
+
+  /*!
+   * \brief Marks a running capture whose worker went away as failed. Must be called with the lock held
+   */
+  void checkWorker()
+  {
+    if (control->status == CAPTURE_RUNNING && control->pid && !processAlive(control->pid)) {
+      control->status = CAPTURE_FAILED;
+      control->endNs  = monotonicNs();
+      strncpy(control->error, "Worker process terminated unexpectedly", SBIT_CAPTURE_ERROR_SIZE-1);
+    }
+  }
+
+  /*!
+   * \brief Maps the ring of the data file, nullptr on failure
+   */
+  uint32_t* mapRing(const char* path, uint32_t capacity, bool create)
+  {
+    int fd = openDataFile(path, create ? (O_RDWR|O_CREAT|O_TRUNC) : O_RDONLY);
+    if (fd < 0)
+      return nullptr;
+    if (create && ftruncate(fd, size_t(capacity)*sizeof(uint32_t)) != 0) {
+      close(fd);
+      return nullptr;
+    }
+    void *addr = mmap(nullptr, size_t(capacity)*sizeof(uint32_t), create ? (PROT_READ|PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return (addr == MAP_FAILED) ? nullptr : static_cast<uint32_t*>(addr);
+  }
+
+  /*!
+   * \brief Body of the worker process, never returns
+   */
+  void runCapture()
+  {
+    uint32_t ohN, capacity;
+    uint64_t acquireNs;
+    std::string dataFile;
+    {
+      CaptureLock lock;
+      ohN       = control->ohN;
+      capacity  = control->capacity;
+      acquireNs = control->acquireNs;
+      dataFile  = control->dataFile;
+    }
+
+    std::string error;
+    uint32_t *ring = mapRing(dataFile.c_str(), capacity, true);
+    if (!ring)
+      error = stdsprintf("Unable to map %s: %s", dataFile.c_str(), strerror(errno));
+
+    uint32_t nReadouts = 0, nValidReadouts = 0;
+    const uint64_t startNs = monotonicNs();
+    if (error.empty()) {
+      try {
+        RPCMsg scratch("sbitCapture");
+        RPCMsg *response = &scratch;
+        GETLOCALARGS(response);
+
+        sbitMonitorRegs regs;
+        if (setupSbitMonitorLocal(&la, ohN, regs)) {
+          //Take the VFATs out of slow control only mode
+          writeReg(&la, "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE", 0x0);
+
+          uint32_t written = 0;
+          uint32_t packed[SBIT_MONITOR_CLUSTERS];
+          while (!__atomic_load_n(&control->stop, __ATOMIC_RELAXED) && !scratch.get_key_exists("error")) {
+            uint64_t resetNs = monotonicNs();
+            if (acquireNs && resetNs - startNs >= acquireNs)
+              break;
+            if (written > 0xFFFFFFFF - SBIT_MONITOR_CLUSTERS)
+              break; //Offsets are 32 bit words
+
+            writeRawAddress(regs.reset, 0x1, response);
+            std::this_thread::sleep_for(std::chrono::nanoseconds(SBIT_MONITOR_WINDOW_NS - std::min<uint64_t>(monotonicNs() - resetNs, SBIT_MONITOR_WINDOW_NS)));
+            ++nReadouts;
+            if (readSbitMonitorLocal(&la, regs, packed)) {
+              for (uint32_t cluster = 0; cluster < SBIT_MONITOR_CLUSTERS; ++cluster)
+                ring[(written + cluster) % capacity] = packed[cluster];
+              written += SBIT_MONITOR_CLUSTERS;
+              __atomic_store_n(&control->written, written, __ATOMIC_RELEASE);
+              ++nValidReadouts;
+            }
+            if ((nReadouts & 0x3FF) == 0) {
+              __atomic_store_n(&control->nReadouts, nReadouts, __ATOMIC_RELAXED);
+              __atomic_store_n(&control->nValidReadouts, nValidReadouts, __ATOMIC_RELAXED);
+            }
+          }
+        }
+        if (scratch.get_key_exists("error"))
+          error = scratch.get_string("error");
+        rtxn.abort();
+      } catch (const std::exception& e) {
+        error = e.what();
+      }
+      munmap(ring, size_t(capacity)*sizeof(uint32_t));
+    }
+
+    {
+      CaptureLock lock;
+      control->nReadouts      = nReadouts;
+      control->nValidReadouts = nValidReadouts;
+      if (!error.empty())
+        strncpy(control->error, error.c_str(), SBIT_CAPTURE_ERROR_SIZE-1);
+      control->status = !error.empty() ? CAPTURE_FAILED : (control->stop ? CAPTURE_STOPPED : CAPTURE_DONE);
+      control->endNs  = monotonicNs();
+    }
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Sbit capture on OH%i finished: %u readouts, %u with clusters, %u words",
+                                                     ohN, nReadouts, nValidReadouts, __atomic_load_n(&control->written, __ATOMIC_RELAXED)));
+    _exit(0);
+  }
+}
+
+bool setupSbitMonitorLocal(localArgs* la, uint32_t ohN, sbitMonitorRegs& regs)
+{
+  writeReg(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.OH_SELECT", ohN);
+
+  bool found = true;
+  auto resolve = [&](std::string const& regName) {
+    uint32_t address = getAddress(la, regName);
+    found &= (address != 0xdeaddead);
+    return address;
+  };
+  regs.reset      = resolve("GEM_AMC.TRIGGER.SBIT_MONITOR.RESET");
+  regs.readout[0] = resolve("GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY");
+  for (uint32_t cluster = 0; cluster < SBIT_MONITOR_CLUSTERS; ++cluster)
+    regs.readout[cluster+1] = resolve(stdsprintf("GEM_AMC.TRIGGER.SBIT_MONITOR.CLUSTER%i", cluster));
+
+  if (!found)
+    la->response->set_string("error", "Unable to resolve the SBIT monitor registers");
+  return found;
+}
+
+bool readSbitMonitorLocal(localArgs* la, sbitMonitorRegs const& regs, uint32_t* packed)
+{
+  uint32_t words[SBIT_MONITOR_CLUSTERS+1];
+  readAddressList(regs.readout, words, SBIT_MONITOR_CLUSTERS+1, la->response);
+
+  uint32_t l1ADelay = std::min(words[0], sbit::L1A_DELAY_BINS-1); //Anything larger than this consider as overflow
+  bool anyValid = false;
+  for (uint32_t cluster = 0; cluster < SBIT_MONITOR_CLUSTERS; ++cluster) {
+    //bits [10:0] is the address of the cluster
+    //bits [14:12] is the cluster size
+    //bits 15 and 11 are not used
+    //A failed read is stored as an invalid address
+    uint32_t thisCluster = (words[cluster+1] == 0xdeaddead) ? 0x7ff : words[cluster+1];
+    uint32_t sbitAddress = (thisCluster & 0x7ff);
+    uint32_t clusterSize = (thisCluster >> 12) & 0x7;
+    anyValid |= (sbitAddress < sbit::SBIT_ADDRESSES); //Possible values are [0,(24*64)-1]
+    packed[cluster] = ((l1ADelay & 0x1fff) << 14) + ((clusterSize & 0x7) << 11) + (sbitAddress & 0x7ff);
+  }
+  return anyValid;
+}
+
+void startSbitCapture(const RPCMsg *request, RPCMsg *response)
+{
+  if (!mapControl()) {
+    response->set_string("error", "Sbit capture control file not available");
+    return;
+  }
+
+  uint32_t ohN         = request->get_word("ohN");
+  uint32_t acquireTime = request->get_key_exists("acquireTime") ? request->get_word("acquireTime") : 0;
+  uint32_t capacity    = request->get_key_exists("bufferWords") ? request->get_word("bufferWords") : SBIT_CAPTURE_DEFAULT_WORDS;
+  std::string dataFile = request->get_key_exists("bufferFile") ? request->get_string("bufferFile") : SBIT_CAPTURE_DATA_FILE;
+
+  if (capacity < SBIT_MONITOR_CLUSTERS || capacity > SBIT_CAPTURE_MAX_WORDS || dataFile.size() >= SBIT_CAPTURE_PATH_SIZE) {
+    response->set_string("error", stdsprintf("Invalid capture buffer: %u words (at most %u) in %s", capacity, SBIT_CAPTURE_MAX_WORDS, dataFile.c_str()));
+    return;
+  }
+  if (!allowedDataPath(dataFile)) {
+    response->set_string("error", stdsprintf("Capture buffer file %s not allowed, it must be below /mnt/persistent/, /dev/shm/ or /tmp/", dataFile.c_str()));
+    return;
+  }
+  capacity -= capacity % SBIT_MONITOR_CLUSTERS; //Readouts never wrap in the middle
+
+  uint32_t captureId;
+  {
+    CaptureLock lock;
+    checkWorker();
+    if (control->status == CAPTURE_RUNNING) {
+      response->set_string("error", stdsprintf("Sbit capture %u is still running", control->id));
+      return;
+    }
+    captureId = control->id + 1;
+    std::memset(control, 0, sizeof(SbitCaptureControl));
+    control->version   = SBIT_CAPTURE_VERSION;
+    control->id        = captureId;
+    control->status    = CAPTURE_RUNNING;
+    control->ohN       = ohN;
+    control->capacity  = capacity;
+    control->acquireNs = uint64_t(acquireTime)*1000000000ULL;
+    control->startNs   = monotonicNs();
+    strncpy(control->dataFile, dataFile.c_str(), SBIT_CAPTURE_PATH_SIZE-1);
+  }
+
+  auto recordWorker = [](pid_t worker) {
+    CaptureLock lock;
+    control->pid = worker;
+  };
+  if (!startWorker(runCapture, recordWorker)) {
+    CaptureLock lock;
+    control->status = CAPTURE_FAILED;
+    control->endNs  = monotonicNs();
+    strncpy(control->error, "Unable to start the worker process", SBIT_CAPTURE_ERROR_SIZE-1);
+    response->set_string("error", stdsprintf("Unable to start the worker process of sbit capture %u", captureId));
+    return;
+  }
+
+  LOGGER->log_message(LogManager::INFO, stdsprintf("Started sbit capture %u on OH%i for %u s in a ring of %u words", captureId, ohN, acquireTime, capacity));
+  response->set_word("captureId", captureId);
+}
+
+void fetchSbitCapture(const RPCMsg *request, RPCMsg *response)
+{
+  if (!mapControl()) {
+    response->set_string("error", "Sbit capture control file not available");
+    return;
+  }
+
+  uint32_t offset = request->get_key_exists("offset") ? request->get_word("offset") : 0;
+  uint32_t count  = request->get_key_exists("count") ? request->get_word("count") : SBIT_CAPTURE_MAX_CHUNK;
+  count = std::min(count, SBIT_CAPTURE_MAX_CHUNK);
+
+  SbitCaptureControl ctrl;
+  {
+    CaptureLock lock;
+    checkWorker();
+    ctrl = *control;
+  }
+  if (ctrl.status == CAPTURE_IDLE) {
+    response->set_string("error", "No sbit capture was started");
+    return;
+  }
+
+  //Copy, then check that the producer did not overwrite what was copied in the meantime
+  uint32_t written = __atomic_load_n(&control->written, __ATOMIC_ACQUIRE);
+  uint32_t first   = std::max(offset, (written > ctrl.capacity) ? written - ctrl.capacity : 0u);
+  uint32_t n       = (first < written) ? std::min(count, written - first) : 0;
+  std::vector<uint32_t> data;
+  if (n) {
+    uint32_t *ring = mapRing(ctrl.dataFile, ctrl.capacity, false);
+    if (!ring) {
+      response->set_string("error", stdsprintf("Unable to map %s: %s", ctrl.dataFile, strerror(errno)));
+      return;
+    }
+    data.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+      data[i] = ring[(size_t(first) + i) % ctrl.capacity];
+    munmap(ring, size_t(ctrl.capacity)*sizeof(uint32_t));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t writtenAfter = __atomic_load_n(&control->written, __ATOMIC_RELAXED);
+    //The producer may already be writing the next readout, which it publishes only once complete
+    uint32_t reached      = writtenAfter + SBIT_MONITOR_CLUSTERS;
+    uint32_t overwritten  = (reached > ctrl.capacity) ? reached - ctrl.capacity : 0;
+    if (overwritten > first) {
+      uint32_t lost = std::min(overwritten - first, n);
+      data.erase(data.begin(), data.begin() + lost);
+      first += lost;
+    }
+  }
+
+  const uint64_t endNs = (ctrl.status == CAPTURE_RUNNING) ? monotonicNs() : ctrl.endNs;
+  response->set_word_array("data", data);
+  response->set_word("offset", first);
+  response->set_word("written", __atomic_load_n(&control->written, __ATOMIC_ACQUIRE));
+  response->set_string("status", STATUS_NAMES[ctrl.status]);
+  response->set_word("captureId", ctrl.id);
+  response->set_word("nReadouts", ctrl.nReadouts);
+  response->set_word("nValidReadouts", ctrl.nValidReadouts);
+  response->set_word("liveTimeMs", (endNs - ctrl.startNs)/1000000);
+  if (ctrl.error[0])
+    response->set_string("captureError", ctrl.error);
+}
+
+void stopSbitCapture(const RPCMsg *, RPCMsg *response)
+{
+  if (!mapControl()) {
+    response->set_string("error", "Sbit capture control file not available");
+    return;
+  }
+
+  CaptureLock lock;
+  checkWorker();
+  if (control->status == CAPTURE_RUNNING) {
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Stopping sbit capture %u", control->id));
+    __atomic_store_n(&control->stop, 1u, __ATOMIC_RELAXED);
+  }
+  response->set_string("status", STATUS_NAMES[control->status]);
+}
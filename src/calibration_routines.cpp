@@ -1,6 +1,17 @@
 #include <algorithm>
 #include "amc.h"
+#include <array>
 #include "calibration_routines.h"
+#include "calibration_routines/adaptive_scan.h"
+#include "calibration_routines/cal_pulse.h"
+#include "calibration_routines/channel_groups.h"
+#include "calibration_routines/checkpoint.h"
+#include "calibration_routines/result_buffer.h"
+#include "calibration_routines/result_file.h"
+#include "calibration_routines/sbit_mapping.h"
+#include "calibration_routines/scan_engine.h"
+#include "calibration_routines/scan_jobs.h"
+#include "calibration_routines/scurve_fit.h"
 #include <chrono>
 #include <math.h>
 #include <pthread.h>
@@ -9,81 +20,104 @@
 #include "vfat3.h"
 #include "hw_constants.h"
 
-std::unordered_map<uint32_t, uint32_t> setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la)
+namespace {
+    /*!
+     * \brief Channel registers of one VFAT, resolved from the VFAT_CHANNELS.CHANNEL%i.MASK fields
+     */
+    struct chanMaskRegs {
+        bool valid = false;
+        uint32_t maskBits = 0; ///< mask of the MASK field, identical for all channels
+        std::array<uint32_t, 128> addrs;
+    };
+
+    std::array<std::array<ATGenerationCache<chanMaskRegs>, oh::VFATS_PER_OH>, amc::OH_PER_AMC> chanMaskRegCache;
+
+    chanMaskRegs const& getChanMaskRegs(localArgs *la, uint32_t ohN, uint32_t vfatN)
+    {
+        return chanMaskRegCache[ohN][vfatN].get(la, [&](localArgs *la) {
+                chanMaskRegs regs;
+                regs.valid = true;
+                for (unsigned int chan = 0; chan < 128; ++chan) {
+                    RegHandle reg = getRegHandle(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan));
+                    regs.valid &= (reg.address != 0xdeaddead);
+                    regs.addrs[chan] = reg.address;
+                    regs.maskBits    = reg.mask;
+                }
+                return regs;
+            });
+    }
+}
+
+chanMaskSnapshot setChanMaskLocal(localArgs *la, uint32_t ohN, uint32_t vfatMask, unsigned int ch)
 {
-    char regBuf[200];
-    std::unordered_map<uint32_t, uint32_t> map_chanOrigMask; //key -> reg addr; val -> reg value
-    uint32_t chanMaskAddr;
-    for (unsigned int chan=0; chan<128; ++chan) { //Loop Over All Channels
-        uint32_t chMask = 1;
-        if ( ch == chan) { //Do not mask the channel of interest
-            chMask = 0;
+    chanMaskSnapshot snapshot;
+    std::vector<uint32_t> maskBits;
+    uint32_t notmask = ~vfatMask & 0xFFFFFF;
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        if (!((notmask >> vfatN) & 0x1))
+            continue;
+        chanMaskRegs const& regs = getChanMaskRegs(la, ohN, vfatN);
+        if (!regs.valid) {
+            la->response->set_string("error", stdsprintf("Unable to resolve the channel registers of OH%i VFAT%i",ohN,vfatN));
+            continue;
         }
-        //store the original channel mask
-        sprintf(regBuf, "GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan);
-        chanMaskAddr=getAddress(la, regBuf);
-        map_chanOrigMask[chanMaskAddr]=readReg(la, regBuf);
-
-        //write the new channel mask
-        writeRawAddress(chanMaskAddr, chMask, la->response);
-    } //End Loop Over all Channels
-    return map_chanOrigMask;
+        snapshot.addrs.insert(snapshot.addrs.end(), regs.addrs.begin(), regs.addrs.end());
+        maskBits.push_back(regs.maskBits);
+    }
+    if (snapshot.addrs.empty())
+        return snapshot;
+
+    //store the original channel registers of all VFATs at once
+    snapshot.words.resize(snapshot.addrs.size());
+    readAddressList(snapshot.addrs.data(), snapshot.words.data(), snapshot.addrs.size(), la->response);
+    if (std::find(snapshot.words.begin(), snapshot.words.end(), 0xdeaddead) != snapshot.words.end()) {
+        //Do not write masks built from failed reads, and leave nothing to restore
+        la->response->set_string("error", stdsprintf("setChanMaskLocal(): unable to read the channel registers of OH%i",ohN));
+        return chanMaskSnapshot();
+    }
+
+    std::vector<uint32_t> words(snapshot.words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        const unsigned int chan = i % 128;
+        const uint32_t bits = maskBits[i / 128];
+        uint32_t chMask = (chan == ch) ? 0x0 : bits; //Do not mask the channel of interest
+        words[i] = (snapshot.words[i] & ~bits) | chMask;
+    }
+
+    //write the new channel masks of all VFATs at once
+    writeAddressList(snapshot.addrs.data(), words.data(), words.size(), la->response);
+    return snapshot;
 }
 
-void applyChanMask(std::unordered_map<uint32_t, uint32_t> map_chanOrigMask, localArgs *la)
+chanMaskSnapshot setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la)
 {
-    for (auto chanPtr = map_chanOrigMask.begin(); chanPtr != map_chanOrigMask.end(); ++chanPtr) {
-        writeRawAddress( (*chanPtr).first, (*chanPtr).second, la->response);
-    }
+    return setChanMaskLocal(la, ohN, ~(0x1 << vfatN) & 0xFFFFFF, ch);
 }
 
-bool confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor)
+void applyChanMask(const chanMaskSnapshot & origMask, localArgs *la)
 {
-    //Determine the inverse of the vfatmask
-    uint32_t notmask = ~mask & 0xFFFFFF;
+    if (!origMask.empty())
+        writeAddressList(origMask.addrs.data(), origMask.words.data(), origMask.addrs.size(), la->response);
+}
 
-    char regBuf[200];
+bool confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch, bool toggleOn, bool currentPulse, uint32_t calScaleFactor, calPulseState *state)
+{
     if (ch >= 128 && toggleOn == true) { //Case: Bad Config, asked for OR of all channels
         la->response->set_string("error","confCalPulseLocal(): I was told to calpulse all channels which doesn't make sense");
         return false;
     } //End Case: Bad Config, asked for OR of all channels
-    else if (ch == 128 && toggleOn == false) { //Case: Turn cal pusle off for all channels
-        for (int vfatN = 0; vfatN < 24; vfatN++) { //Loop over all VFATs
-            if ((notmask >> vfatN) & 0x1) { //End VFAT is not masked
-                for (int chan=0; chan < 128; ++chan) { //Loop Over all Channels
-                    sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE", ohN, vfatN, chan);
-                    writeReg(la, regBuf, 0x0);
-                } //End Loop Over all Channels
-                writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x0);
-            } //End VFAT is not masked
-        } //End Loop over all VFATs
-    } //End Case: Turn cal pulse off for all channels
-    else{ //Case: Pulse a specific channel
-        for (int vfatN = 0; vfatN < 24; vfatN++) { //Loop over all VFATs
-            if ((notmask >> vfatN) & 0x1) { //End VFAT is not masked
-                sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE", ohN, vfatN, ch);
-                if (toggleOn == true) { //Case: turn calpulse on
-                    writeReg(la, regBuf, 0x1);
-                    if (currentPulse) { //Case: cal mode current injection
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x2);
-
-                        //Set cal current pulse scale factor. Q = CAL DUR[s] * CAL DAC * 10nA * CAL FS[%] (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_FS", ohN, vfatN), calScaleFactor);
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_DUR", ohN, vfatN), 0x0);
-                    } //End Case: cal mode current injection
-                    else { //Case: cal mode voltage injection
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x1);
-                    } //Case: cal mode voltage injection
-                } //End Case: Turn calpulse on
-                else{ //Case: Turn calpulse off
-                    writeReg(la, regBuf, 0x0);
-                    writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x0);
-                } //End Case: Turn calpulse off
-            } //End VFAT is not masked
-        } //End Loop over all VFATs
-    } //End Case: Pulse a specific channel
-
-    return true;
+    else if (ch > 128) {
+        la->response->set_string("error",stdsprintf("confCalPulseLocal(): channel %i does not exist",ch));
+        return false;
+    }
+
+    calPulseConfig config = makeCalPulseConfig(ohN, mask, toggleOn, currentPulse, calScaleFactor);
+    if (ch == 128) //Case: Turn cal pulse off for all channels
+        config.exclusive = true;
+    else
+        config.channels.set(ch);
+
+    return applyCalPulseConfigLocal(la, config, state);
 } //End confCalPulseLocal
 
 void dacMonConfLocal(localArgs * la, uint32_t ohN, uint32_t ch)
@@ -266,7 +300,7 @@ void ttcGenConf(const RPCMsg *request, RPCMsg *response)
     rtxn.abort();
 }
 
-void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig)
+void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig, calPulseState *calState)
 {
     //Determine the inverse of the vfatmask
     uint32_t notmask = ~mask & 0xFFFFFF;
@@ -275,112 +309,74 @@ void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask,
     switch(fw_version_check("genScanLocal", la)) {
         case 3: //v3 electronics behavior
         {
-            uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-            char regBuf[200];
-            if ( (notmask & goodVFATs) != notmask)
-            {
-                sprintf(regBuf,"One of the unmasked VFATs is not Synced. goodVFATs: %x\tnotmask: %x",goodVFATs,notmask);
-                la->response->set_string("error",regBuf);
+            if (!checkGenScanLocal(la, ohN, mask, currentPulse, calScaleFactor))
                 return;
-            }
-
-            if (currentPulse && calScaleFactor > 3) {
-                sprintf(regBuf,"Bad value for CFG_CAL_FS: %x, Possible values are {0b00, 0b01, 0b10, 0b11}. Exiting.",calScaleFactor);
-                la->response->set_string("error",regBuf);
-                return;
-            }
 
             //Do we turn on the calpulse for the channel = ch?
             if (useCalPulse) {
-                if (confCalPulseLocal(la, ohN, mask, ch, true, currentPulse, calScaleFactor) == false) {
+                if (confCalPulseLocal(la, ohN, mask, ch, true, currentPulse, calScaleFactor, calState) == false) {
                     la->response->set_string("error",stdsprintf("Unable to configure calpulse ON for ohN %i mask %x chan %i", ohN, mask, ch));
                     return; //Calibration pulse is not configured correctly
                 }
             } //End use calibration pulse
 
-            //Get addresses
-            uint32_t daqMonAddr[24];
-            uint32_t l1CntAddr = getAddress(la, "GEM_AMC.TTC.CMD_COUNTERS.L1A");
-            for (int vfatN = 0; vfatN < 24; vfatN++)
-            {
-                sprintf(regBuf,"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT",vfatN);
-                daqMonAddr[vfatN] = getAddress(la, regBuf);
+            //Resolve all registers of the scan step once
+            const genScanPlan & plan = getGenScanPlan(la, ohN, scanReg);
+            if (!plan.valid) {
+                la->response->set_string("error",stdsprintf("Unable to resolve the registers of the scan over CFG_%s for ohN %i", scanReg.c_str(), ohN));
+                return;
             }
 
             //TTC Config
-            if (useExtTrig) {
-                writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x0);
-                writeReg(la, "GEM_AMC.TTC.CTRL.CNT_RESET", 0x1);
-            }
-            else{
-                writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT", nevts);
-                writeReg(la, "GEM_AMC.TTC.GENERATOR.SINGLE_RESYNC", 0x1);
-            }
+            confScanTriggersLocal(la, nevts, useExtTrig);
 
             //Configure VFAT_DAQ_MONITOR
             dacMonConfLocal(la, ohN, ch);
 
-            //Scan over DAC values
-            for (uint32_t dacVal = dacMin; dacVal <= dacMax; dacVal += dacStep)
-            {
-                //Write the scan reg value
-                for (int vfatN = 0; vfatN < 24; vfatN++) if ((notmask >> vfatN) & 0x1)
-                {
-                    writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str()), dacVal);
-                }
+            //The other fields of the scan register words are fixed during the scan
+            uint32_t regWords[oh::VFATS_PER_OH];
+            readScanRegWords(la, plan, mask, regWords);
 
-                //Reset and enable the VFAT_DAQ_MONITOR
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.RESET", 0x1);
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE", 0x1);
+            bool logDebug = logLevelEnabled(LogManager::DEBUG);
+            const uint32_t nPoints = scanPoints(dacMin, dacMax, dacStep);
 
-                //Start the triggers
-                if (useExtTrig) {
-                    writeReg(la, "GEM_AMC.TTC.CTRL.CNT_RESET", 0x1);
-                    writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x1);
+            //Scan over DAC values
+            uint32_t goodEvents[oh::VFATS_PER_OH];
+            for (uint32_t dacVal = dacMin; dacVal <= dacMax && !scanJobCancelled(); dacVal += dacStep)
+            {
+                genScanStepLocal(la, plan, mask, regWords, dacVal, nevts, useExtTrig, goodEvents);
 
-                    uint32_t l1aCnt = 0;
-                    while(l1aCnt < nevts) {
-                        l1aCnt = readRawAddress(l1CntAddr, la->response);
-                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                //Store the DAQ Monitor counters
+                for (int vfatN = 0; vfatN < 24; vfatN++) {
+                    if ( !( (notmask >> vfatN) & 0x1)) {
+                        goodEvents[vfatN] = 0xdeaddead;
+                        continue;
                     }
 
-                    writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x0);
-                    l1aCnt = readRawAddress(l1CntAddr, la->response);
-                }
-                else{
-                    writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_START", 0x1);
-                    if (readReg(la, "GEM_AMC.TTC.GENERATOR.ENABLE")) { //TTC Commands from TTC.GENERATOR
-                        while(readReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING")) {
-                            std::this_thread::sleep_for(std::chrono::microseconds(50));
-                        }
-                    } //End TTC Commands from TTC.GENERATOR
-                }
-
-                //Stop the DAQ monitor counters from incrementing
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE", 0x0);
+                    outData[scanDataIndex(nPoints, 0, vfatN, (dacVal-dacMin)/dacStep)] = goodEvents[vfatN];
 
-                //Read the DAQ Monitor counters
-                for (int vfatN = 0; vfatN < 24; vfatN++) {
-                    if ( !( (notmask >> vfatN) & 0x1)) continue;
-
-                    int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                    outData[idx] = readRawAddress(daqMonAddr[vfatN], la->response);
-
-                    LOGGER->log_message(LogManager::DEBUG, stdsprintf("%s Value: %i; Readback Val: %i; Nhits: %i; Nev: %i; CFG_THR_ARM: %i",
-                                 scanReg.c_str(),
-                                 dacVal,
-                                 readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str())),
-                                 readReg(la, stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.CHANNEL_FIRE_COUNT",vfatN)),
-                                 readReg(la, stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT",vfatN)),
-                                 readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_THR_ARM_DAC",ohN,vfatN,scanReg.c_str()))
-                        )
-                    );
+                    if (logDebug) {
+                        LOGGER->log_message(LogManager::DEBUG, stdsprintf("%s Value: %i; Readback Val: %i; Nhits: %i; Nev: %i; CFG_THR_ARM: %i",
+                                     scanReg.c_str(),
+                                     dacVal,
+                                     readRegHandle(plan.scanReg[vfatN], la->response),
+                                     readRawAddress(plan.channelFireCount[vfatN], la->response),
+                                     goodEvents[vfatN],
+                                     readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_THR_ARM_DAC",ohN,vfatN))
+                            )
+                        );
+                    }
                 } //End Loop over vfats
+                scanResultAppend(ohN, ch, dacVal, goodEvents);
+                scanJobStep(dacVal);
             } //End Loop from dacMin to dacMax
 
             //If the calpulse for channel ch was turned on, turn it off
             if (useCalPulse) {
-                if (confCalPulseLocal(la, ohN, mask, ch, false, currentPulse, calScaleFactor) == false) {
+                //The scan register may share a word with the CFG_CAL_* registers
+                if (calState)
+                    calState->invalidateCfg();
+                if (confCalPulseLocal(la, ohN, mask, ch, false, currentPulse, calScaleFactor, calState) == false) {
                     la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, mask, ch));
                     return; //Calibration pulse is not configured correctly
                 }
@@ -499,13 +495,204 @@ void genScan(const RPCMsg *request, RPCMsg *response)
     }
     bool useExtTrig = request->get_word("useExtTrig");
 
-    uint32_t outData[24*(dacMax-dacMin+1)/dacStep];
+    if (request->get_key_exists("adaptive")) {
+        if (request->get_key_exists("resultFile")) {
+            response->set_string("error", "Streaming the results of an adaptive scan to a result file is not supported");
+            rtxn.abort();
+            return;
+        }
+        std::vector<uint32_t> dacPoints, outData;
+        genScanAdaptiveLocal(&la, dacPoints, outData, ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, getAdaptiveScanParams(request, nevts), scanReg, useExtTrig);
+        response->set_word_array("dacPoints", dacPoints);
+        response->set_word_array("data", outData);
+        rtxn.abort();
+        return;
+    }
+
+    if (!checkScanRange(&la, dacMin, dacMax, dacStep)) {
+        rtxn.abort();
+        return;
+    }
+
+    std::unique_ptr<ScanResultFile> resultFile;
+    if (request->get_key_exists("resultFile")) {
+        resultFile = openScanResultFile(&la, request->get_string("resultFile"), "genScan", scanReg, 0x1 << ohN, mask, ch, nevts, dacMin, dacMax, dacStep,
+                                        scanResultFlags(useCalPulse, currentPulse, useExtTrig), calScaleFactor);
+        if (!resultFile) {
+            rtxn.abort();
+            return;
+        }
+    }
+    ScanResultSink sink(&la, std::move(resultFile));
+
+    uint32_t *outData = scanResultBuffer(&la, "data", 24*scanPoints(dacMin, dacMax, dacStep));
+    if (!outData) {
+        rtxn.abort();
+        return;
+    }
     genScanLocal(&la, outData, ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig);
-    response->set_word_array("data",outData,24*(dacMax-dacMin+1)/dacStep);
+    setScanResultArray(&la, "data", 24*scanPoints(dacMin, dacMax, dacStep));
 
     rtxn.abort();
 }
 
+void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+{
+    const uint32_t nDacVals = scanPoints(dacMin, dacMax, dacStep);
+    std::fill(outData, outData+scanDataIndex(nDacVals, amc::OH_PER_AMC, 0, 0), 0xdeaddead);
+
+    if (ohMask > 0xFFF) {
+        la->response->set_string("error","genScanMultiLink supports only up to 12 optohybrids per CTP7");
+        return;
+    }
+
+    if (fw_version_check("genScanMultiLink", la) != 3) {
+        LOGGER->log_message(LogManager::ERROR, "genScanMultiLink is only supported in V3 electronics");
+        la->response->set_string("error","genScanMultiLink is only supported in V3 electronics");
+        return;
+    }
+
+    //Resolve the registers and check the links of all selected optohybrids before touching anything
+    const genScanPlan *plans[amc::OH_PER_AMC] = {nullptr};
+    uint32_t vfatMask[amc::OH_PER_AMC] = {0};
+    std::vector<uint32_t> ohList;
+    for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        if (!((ohMask >> ohN) & 0x1)) continue;
+
+        vfatMask[ohN] = getOHVFATMaskLocal(la, ohN);
+        if (!checkGenScanLocal(la, ohN, vfatMask[ohN], currentPulse, calScaleFactor))
+            return;
+
+        plans[ohN] = &getGenScanPlan(la, ohN, scanReg);
+        if (!plans[ohN]->valid) {
+            la->response->set_string("error",stdsprintf("Unable to resolve the registers of the scan over CFG_%s for ohN %i", scanReg.c_str(), ohN));
+            return;
+        }
+        ohList.push_back(ohN);
+    }
+
+    if (ohList.empty()) {
+        LOGGER->log_message(LogManager::WARNING, "genScanMultiLink called with an empty ohMask, nothing to do");
+        return;
+    }
+
+    //Do we turn on the calpulse for the channel = ch? The words read to turn it on are reused to turn it off
+    std::vector<calPulseState> calStates(amc::OH_PER_AMC);
+    if (useCalPulse) {
+        for (auto ohN = ohList.begin(); ohN != ohList.end(); ++ohN) {
+            if (confCalPulseLocal(la, *ohN, vfatMask[*ohN], ch, true, currentPulse, calScaleFactor, &calStates[*ohN]) == false) {
+                la->response->set_string("error",stdsprintf("Unable to configure calpulse ON for ohN %i mask %x chan %i", *ohN, vfatMask[*ohN], ch));
+                //Turn the pulse off again on the optohybrids already configured, the error of the ON is kept in the response
+                for (auto done = ohList.begin(); done != ohN; ++done)
+                    confCalPulseLocal(la, *done, vfatMask[*done], ch, false, currentPulse, calScaleFactor, &calStates[*done]);
+                return; //Calibration pulse is not configured correctly
+            }
+        }
+    } //End use calibration pulse
+
+    //TTC Config
+    confScanTriggersLocal(la, nevts, useExtTrig);
+
+    //Configure VFAT_DAQ_MONITOR, the OH_SELECT is switched at every step
+    dacMonConfLocal(la, ohList.front(), ch);
+
+    //The other fields of the scan register words are fixed during the scan
+    uint32_t regWords[amc::OH_PER_AMC][oh::VFATS_PER_OH];
+    for (auto ohN : ohList) {
+        readScanRegWords(la, *plans[ohN], vfatMask[ohN], regWords[ohN]);
+    }
+
+    //Scan over DAC values
+    uint32_t goodEvents[oh::VFATS_PER_OH];
+    for (uint32_t dacVal = dacMin; dacVal <= dacMax && !scanJobCancelled(); dacVal += dacStep) {
+        //Move all optohybrids to the next point first
+        for (auto ohN : ohList) {
+            writeScanRegLocal(la, *plans[ohN], vfatMask[ohN], regWords[ohN], dacVal);
+        }
+
+        //The VFAT_DAQ_MONITOR counts one optohybrid at a time
+        for (auto ohN : ohList) {
+            const genScanPlan & plan = *plans[ohN];
+            writeRegHandle(plan.daqMonOHSelect, ohN, la->response);
+            writeRegHandle(plan.daqMonReset, 0x1, la->response);
+            writeRegHandle(plan.daqMonEnable, 0x1, la->response);
+
+            sendScanTriggersLocal(la, plan, nevts, useExtTrig);
+
+            writeRegHandle(plan.daqMonEnable, 0x0, la->response);
+            readAddressList(plan.goodEventsCount.data(), goodEvents, oh::VFATS_PER_OH, la->response);
+
+            for (uint32_t vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+                if ((vfatMask[ohN] >> vfatN) & 0x1) {
+                    goodEvents[vfatN] = 0xdeaddead;
+                    continue;
+                }
+                outData[scanDataIndex(nDacVals, ohN, vfatN, (dacVal-dacMin)/dacStep)] = goodEvents[vfatN];
+            }
+            scanResultAppend(ohN, ch, dacVal, goodEvents);
+        } //End Loop over optohybrids
+        scanJobStep(dacVal);
+    } //End Loop from dacMin to dacMax
+
+    //If the calpulse for channel ch was turned on, turn it off
+    if (useCalPulse) {
+        for (auto ohN : ohList) {
+            calStates[ohN].invalidateCfg(); //The scan register may share a word with the CFG_CAL_* registers
+            if (confCalPulseLocal(la, ohN, vfatMask[ohN], ch, false, currentPulse, calScaleFactor, &calStates[ohN]) == false) {
+                la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, vfatMask[ohN], ch));
+                return; //Calibration pulse is not configured correctly
+            }
+        }
+    }
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Finished scan over CFG_%s for OH Mask 0x%x", scanReg.c_str(), ohMask));
+    return;
+} //End genScanMultiLinkLocal(...)
+
+void genScanMultiLink(const RPCMsg *request, RPCMsg *response)
+{
+    GETLOCALARGS(response);
+
+    uint32_t nevts = request->get_word("nevts");
+    uint32_t ohMask = request->get_word("ohMask");
+    uint32_t ch = request->get_word("ch");
+    uint32_t dacMin = request->get_word("dacMin");
+    uint32_t dacMax = request->get_word("dacMax");
+    uint32_t dacStep = request->get_word("dacStep");
+    bool useCalPulse = request->get_word("useCalPulse");
+    bool currentPulse = request->get_word("currentPulse");
+    uint32_t calScaleFactor = request->get_word("calScaleFactor");
+    std::string scanReg = request->get_string("scanReg");
+    bool useExtTrig = request->get_word("useExtTrig");
+
+    if (!checkScanRange(&la, dacMin, dacMax, dacStep)) {
+        rtxn.abort();
+        return;
+    }
+
+    std::unique_ptr<ScanResultFile> resultFile;
+    if (request->get_key_exists("resultFile")) {
+        resultFile = openScanResultFile(&la, request->get_string("resultFile"), "genScanMultiLink", scanReg, ohMask, 0, ch, nevts, dacMin, dacMax, dacStep,
+                                        scanResultFlags(useCalPulse, currentPulse, useExtTrig), calScaleFactor);
+        if (!resultFile) {
+            rtxn.abort();
+            return;
+        }
+    }
+    ScanResultSink sink(&la, std::move(resultFile));
+
+    const size_t nWords = scanDataIndex(scanPoints(dacMin, dacMax, dacStep), amc::OH_PER_AMC, 0, 0);
+    uint32_t *outData = scanResultBuffer(&la, "data", nWords);
+    if (!outData) {
+        rtxn.abort();
+        return;
+    }
+    genScanMultiLinkLocal(&la, outData, ohMask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useExtTrig);
+    setScanResultArray(&la, "data", nWords);
+
+    rtxn.abort();
+} //End genScanMultiLink(...)
+
 void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRate, uint32_t ohN, uint32_t maskOh, bool invertVFATPos, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t waitTime)
 {
     char regBuf[200];
@@ -557,8 +744,8 @@ void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outData
 
             //If ch!=128 store the original channel mask settings
             //Then mask all other channels except for channel ch
-            std::unordered_map<uint32_t, uint32_t> map_chanOrigMask; //key -> reg addr; val -> reg value
-            if ( ch != 128) map_chanOrigMask = setSingleChanMask(ohN,vfatN,ch,la);
+            chanMaskSnapshot origChanMask;
+            if ( ch != 128) origChanMask = setSingleChanMask(ohN,vfatN,ch,la);
 
             //Get the OH Rate Monitor Address
             sprintf(regBuf,"GEM_AMC.TRIGGER.OH%i.TRIGGER_RATE",ohN);
@@ -585,7 +772,7 @@ void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outData
             } //End Loop from dacMin to dacMax
 
             //Restore the original channel masks if specific channel was requested
-            if ( ch != 128) applyChanMask(map_chanOrigMask, la);
+            if ( ch != 128) applyChanMask(origChanMask, la);
 
             //Restore the original maskOh
             writeRawAddress(ohVFATMaskAddr, maskOhOrig, la->response);
@@ -603,7 +790,26 @@ void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outData
     return;
 } //End sbitRateScanLocal(...)
 
-void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t ohMask=0xFFF)
+std::unique_ptr<sbitRateWindow> getSbitRateWindow(const RPCMsg *request)
+{
+    std::unique_ptr<sbitRateWindow> window;
+    if (!request->get_key_exists("minTime") && !request->get_key_exists("maxTime") && !request->get_key_exists("targetPrecision") && !request->get_key_exists("quietPoints"))
+        return window;
+
+    window.reset(new sbitRateWindow);
+    if (request->get_key_exists("minTime"))
+        window->minTimeMs = request->get_word("minTime");
+    if (request->get_key_exists("maxTime"))
+        window->maxTimeMs = request->get_word("maxTime");
+    if (request->get_key_exists("targetPrecision"))
+        window->targetPrecision = request->get_word("targetPrecision");
+    if (request->get_key_exists("quietPoints"))
+        window->quietPoints = request->get_word("quietPoints");
+    window->maxTimeMs = std::max(window->maxTimeMs, window->minTimeMs);
+    return window;
+}
+
+void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRatePerVFAT, uint32_t *outDataTrigRateOverall, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t ohMask, const sbitRateWindow *window)
 {
     char regBuf[200];
     // Check that OH mask does not exceeds 0xFFF
@@ -614,7 +820,7 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
          return;
     }
     uint32_t vfatmask[12] = {0};
-    std::unordered_map<uint32_t, uint32_t> origVFATmasks[12][24];
+    chanMaskSnapshot origChanMasks[12];
     switch (fw_version_check("SBIT Rate Scan", la)){
         case 3:
         {
@@ -627,17 +833,9 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
                     LOGGER->log_message(LogManager::INFO, stdsprintf("VFAT Mask for OH%i Determined to be 0x%x",ohN,vfatmask[ohN]));
 
                     //If ch!=128 store the original channel mask settings
+                    //Then mask all other channels except for channel ch on all unmasked VFATs
                     if( ch != 128)
-                    {
-                        //Then mask all other channels except for channel ch
-                        uint32_t notmask = ~vfatmask[ohN] & 0xFFFFFF;
-                        for(int vfat = 0; vfat < 24; ++vfat)
-                        {
-                            //Skip this vfat if it's masked
-                            if ( !( (notmask >> vfat) & 0x1)) continue;
-                            origVFATmasks[ohN][vfat] = setSingleChanMask(ohN,vfat,ch,la);
-                        } //End loop over all vfats
-                    } //End loop over vfat channels
+                        origChanMasks[ohN] = setChanMaskLocal(la, ohN, vfatmask[ohN], ch);
                 } //End case this OH is not masked
             } //End loop over optohybrids
 
@@ -666,8 +864,14 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
                 }
             }
 
+            //Counts a VFAT needs to reach the target precision of the integration window
+            const uint64_t targetCounts = (window && window->targetPrecision) ? (1000000 + window->targetPrecision*window->targetPrecision - 1)/(uint64_t(window->targetPrecision)*window->targetPrecision) : 0;
+            uint32_t nQuiet = 0;
+            uint64_t totalIntegrationMs = 0;
+            const uint32_t nPoints = scanPoints(dacMin, dacMax, dacStep);
+
             //Loop from dacMin to dacMax in steps of dacStep
-            for (uint32_t dacVal = dacMin; dacVal <= dacMax; dacVal += dacStep) {
+            for (uint32_t dacVal = dacMin; dacVal <= dacMax && !scanJobCancelled(); dacVal += dacStep) {
                 LOGGER->log_message(LogManager::INFO, stdsprintf("Setting %s to %i for all optohybrids in 0x%x",scanReg.c_str(),dacVal,ohMask));
 
                 //Set the scan register value
@@ -689,25 +893,97 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
                     } // End checking whether the OH is masked
                 } // End loop over optohybrids
 
-                //Wait just over 1 second
-                std::this_thread::sleep_for(std::chrono::milliseconds(1005));
+                uint32_t integrationMs = 1005;
+                if (window) {
+                    //Integrate at least minTimeMs, then until every VFAT is precise enough or silent, at most maxTimeMs
+                    auto start = std::chrono::steady_clock::now();
+                    auto elapsedMs = [&start]() {
+                        return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+                    };
+                    std::this_thread::sleep_for(std::chrono::milliseconds(window->minTimeMs));
+                    while (targetCounts && elapsedMs() < window->maxTimeMs) {
+                        bool done = true;
+                        for (int ohN = 0; ohN < 12 && done; ++ohN) {
+                            if (!((ohMask >> ohN) & 0x1)) continue;
+                            uint32_t counts[24];
+                            readAddressList(ohTrigRateAddr[ohN], counts, 24, la->response);
+                            uint32_t notmask = ~vfatmask[ohN] & 0xFFFFFF;
+                            for (int vfat = 0; vfat < 24 && done; ++vfat) {
+                                if (((notmask >> vfat) & 0x1) && counts[vfat] != 0 && counts[vfat] < targetCounts)
+                                    done = false;
+                            }
+                        }
+                        if (done)
+                            break;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(std::min(10u, window->maxTimeMs - std::min(window->maxTimeMs, elapsedMs()))));
+                    }
+                    if (!targetCounts)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(window->maxTimeMs - std::min(window->maxTimeMs, elapsedMs())));
+                    integrationMs = std::max(elapsedMs(), 1u);
+                } else {
+                    //Wait just over 1 second
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1005));
+                }
+                totalIntegrationMs += integrationMs;
 
                 //Read the counters
+                bool quiet = true;
                 for (int ohN = 0; ohN < 12; ++ohN) {
                     if ((ohMask >> ohN) & 0x1) {
                         uint32_t notmask = ~vfatmask[ohN] & 0xFFFFFF;
-                        int idx = ohN*(dacMax-dacMin+1)/dacStep + (dacVal-dacMin)/dacStep;
+                        int idx = ohN*nPoints + (dacVal-dacMin)/dacStep;
                         outDataDacVal[idx] = dacVal;
                         outDataTrigRateOverall[idx] = readRawAddress(ohTrigRateAddr[ohN][24], la->response);
+                        uint32_t rates[25]; //idx 0->23 VFAT rates; idx 24 overall rate
+                        rates[24] = outDataTrigRateOverall[idx];
                         for(int vfat=0; vfat<24; ++vfat){
-                            if ( !( (notmask >> vfat) & 0x1)) continue;
-
-                            idx = ohN*24*(dacMax-dacMin+1)/dacStep + vfat*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                            outDataTrigRatePerVFAT[idx] = readRawAddress(ohTrigRateAddr[ohN][vfat], la->response);
+                            if ( !( (notmask >> vfat) & 0x1)) {
+                                rates[vfat] = 0xdeaddead;
+                                continue;
+                            }
+
+                            idx = scanDataIndex(nPoints, ohN, vfat, (dacVal-dacMin)/dacStep);
+                            uint32_t counts = readRawAddress(ohTrigRateAddr[ohN][vfat], la->response);
+                            outDataTrigRatePerVFAT[idx] = window ? uint32_t((uint64_t(counts)*1000 + integrationMs/2)/integrationMs) : counts;
+                            rates[vfat] = outDataTrigRatePerVFAT[idx];
+                            quiet &= (counts == 0);
                         } //End Loop Over all VFATs
+                        scanResultAppend(ohN, ch, dacVal, rates);
                     } // End checking whether the OH is masked
                 } // End loop over optohybrids
+                scanJobStep(dacVal);
+
+                //End the scan once all VFATs stayed quiet, the remaining points have a rate of 0
+                nQuiet = quiet ? nQuiet + 1 : 0;
+                if (window && window->quietPoints && nQuiet >= window->quietPoints) {
+                    LOGGER->log_message(LogManager::INFO, stdsprintf("All VFATs quiet for %i points, ending the scan at %s = %i",nQuiet,scanReg.c_str(),dacVal));
+                    //Recorded like measured points, so that the result file and the job progress cover the whole range
+                    for (uint32_t skipVal = dacVal + dacStep; skipVal <= dacMax && skipVal > dacVal; skipVal += dacStep) {
+                        for (int ohN = 0; ohN < 12; ++ohN) {
+                            if (!((ohMask >> ohN) & 0x1)) continue;
+                            int idx = ohN*nPoints + (skipVal-dacMin)/dacStep;
+                            outDataDacVal[idx] = skipVal;
+                            outDataTrigRateOverall[idx] = 0;
+                            uint32_t rates[25]; //idx 0->23 VFAT rates; idx 24 overall rate
+                            rates[24] = 0;
+                            uint32_t notmask = ~vfatmask[ohN] & 0xFFFFFF;
+                            for (int vfat = 0; vfat < 24; ++vfat) {
+                                if (!((notmask >> vfat) & 0x1)) {
+                                    rates[vfat] = 0xdeaddead;
+                                    continue;
+                                }
+                                outDataTrigRatePerVFAT[scanDataIndex(nPoints, ohN, vfat, (skipVal-dacMin)/dacStep)] = 0;
+                                rates[vfat] = 0;
+                            }
+                            scanResultAppend(ohN, ch, skipVal, rates);
+                        }
+                        scanJobStep(skipVal);
+                    }
+                    break;
+                }
             } //End Loop from dacMin to dacMax
+            if (window)
+                LOGGER->log_message(LogManager::INFO, stdsprintf("SBIT rate scan integrated %.1f s in total",totalIntegrationMs/1000.));
 
             //Restore the original SBIT counter persist setting
             for (int ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
@@ -718,15 +994,8 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
 
             //Restore the original channel masks if specific channel was requested
             if( ch != 128) {
-                for (int ohN = 0; ohN < 12; ++ohN) {
-                    if ((ohMask >> ohN) & 0x1) {
-                        uint32_t notmask = ~vfatmask[ohN] & 0xFFFFFF;
-                        for(int vfat=0; vfat<24; ++vfat){
-                            if ( !( (notmask >> vfat) & 0x1)) continue;
-                            applyChanMask(origVFATmasks[ohN][vfat], la);
-                        }
-                    }
-                }
+                for (int ohN = 0; ohN < 12; ++ohN)
+                    applyChanMask(origChanMasks[ohN], la);
             }
             break;
         }//End v3 electronics behavior
@@ -744,6 +1013,7 @@ return;
 void sbitRateScan(const RPCMsg *request, RPCMsg *response)
 {
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t ohMask = request->get_word("ohMask");
     uint32_t ch = request->get_word("ch");
@@ -752,14 +1022,30 @@ void sbitRateScan(const RPCMsg *request, RPCMsg *response)
     uint32_t dacStep = request->get_word("dacStep");
     std::string scanReg = request->get_string("scanReg");
 
-    uint32_t outDataTrigRatePerVFAT[12*24*(dacMax-dacMin+1)/dacStep];
-    uint32_t outDataDacValPerOH[12*(dacMax-dacMin+1)/dacStep];
-    uint32_t outDataTrigRatePerOH[12*(dacMax-dacMin+1)/dacStep];
-    sbitRateScanParallelLocal(&la, outDataDacValPerOH, outDataTrigRatePerVFAT, outDataTrigRatePerOH, ch, dacMin, dacMax, dacStep, scanReg, ohMask);
+    if (!checkScanRange(&la, dacMin, dacMax, dacStep))
+        return;
+
+    std::unique_ptr<sbitRateWindow> window = getSbitRateWindow(request);
+
+    std::unique_ptr<ScanResultFile> resultFile;
+    if (request->get_key_exists("resultFile")) {
+        resultFile = openScanResultFile(&la, request->get_string("resultFile"), "sbitRateScan", scanReg, ohMask, 0, ch, 0, dacMin, dacMax, dacStep, 0, 0, window.get());
+        if (!resultFile)
+            return;
+    }
+    ScanResultSink sink(&la, std::move(resultFile));
+
+    const uint32_t nPoints = scanPoints(dacMin, dacMax, dacStep);
+    uint32_t *outDataTrigRatePerVFAT = scanResultBuffer(&la, "outDataVFATRate", 12*24*nPoints);
+    uint32_t *outDataDacValPerOH = scanResultBuffer(&la, "outDataDacValue", 12*nPoints);
+    uint32_t *outDataTrigRatePerOH = scanResultBuffer(&la, "outDataCTP7Rate", 12*nPoints);
+    if (!outDataTrigRatePerVFAT || !outDataDacValPerOH || !outDataTrigRatePerOH)
+        return;
+    sbitRateScanParallelLocal(&la, outDataDacValPerOH, outDataTrigRatePerVFAT, outDataTrigRatePerOH, ch, dacMin, dacMax, dacStep, scanReg, ohMask, window.get());
 
-    response->set_word_array("outDataVFATRate", outDataTrigRatePerVFAT, 12*24*(dacMax-dacMin+1)/dacStep);
-    response->set_word_array("outDataDacValue", outDataDacValPerOH, 12*(dacMax-dacMin+1)/dacStep);
-    response->set_word_array("outDataCTP7Rate", outDataTrigRatePerOH, 12*(dacMax-dacMin+1)/dacStep);
+    setScanResultArray(&la, "outDataVFATRate", 12*24*nPoints);
+    setScanResultArray(&la, "outDataDacValue", 12*nPoints);
+    setScanResultArray(&la, "outDataCTP7Rate", 12*nPoints);
 
     return;
 } //End sbitRateScan(...)
@@ -805,6 +1091,7 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
     writeReg(la, "GEM_AMC.TTC.GENERATOR.SINGLE_RESYNC", 0x1);
     writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT", 0x1); //One pulse at a time
     uint32_t addrTtcStart = getAddress(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_START");
+    RegHandle ttcCyclicRunning = getRegHandle(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING");
 
     //Set all chips out of run mode
     broadcastWriteLocal(la, ohN, "CFG_RUN", 0x0, mask);
@@ -833,30 +1120,54 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
     //Place this vfat into run mode
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x1);
 
-    for (int chan=0; chan < 128; ++chan) { //Loop over all channels
-        //unmask this channel
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x0);
+    //Only this channel is unmasked and pulsed, moving to the next channel is a single transaction
+    calPulseState calState;
+    calPulseConfig calConfig = makeCalPulseConfig(ohN, ~((0x1)<<vfatN) & 0xFFFFFF, useCalPulse, currentPulse, calScaleFactor);
+    calConfig.unmask = true;
+
+    //Every pulse resets the monitor and starts the generator with one write list
+    uint32_t pulseAddrs[2] = {addrSbitMonReset, addrTtcStart};
+    uint32_t pulseWords[2] = {0x1, 0x1};
+
+    //Summary of the check, per cluster logging is only done at DEBUG level
+    bool logDebug = logLevelEnabled(LogManager::DEBUG);
+    uint32_t nValidClusters = 0, nWrongVFAT = 0, nWrongSbit = 0, nSilentChannels = 0;
+    std::chrono::steady_clock::duration pollTime(0);
 
-        //Turn on the calpulse for this channel
-        if (confCalPulseLocal(la, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan, useCalPulse, currentPulse, calScaleFactor) == false) {
+    for (int chan=0; chan < 128; ++chan) { //Loop over all channels
+        //unmask this channel and turn on the calpulse for it, mask the previous channel and turn off its calpulse
+        calConfig.channels.reset();
+        calConfig.channels.set(chan);
+        if (applyCalPulseConfigLocal(la, calConfig, &calState) == false) {
             la->response->set_string("error",stdsprintf("Unable to configure calpulse %b for ohN %i mask %x chan %i", useCalPulse, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan));
             return; //Calibration pulse is not configured correctly
         }
 
         //Start Pulsing
+        uint32_t nValidPulses = 0;
         for (unsigned int iPulse=0; iPulse < nevts; ++iPulse) { //Pulse this channel
-            //Reset monitors
-            writeRawAddress(addrSbitMonReset, 0x1, la->response);
-
-            //Start the TTC Generator
-            if (useCalPulse) {
-                writeRawAddress(addrTtcStart, 0x1, la->response);
+            //Reset monitors and start the TTC Generator in one transaction
+            writeAddressList(pulseAddrs, pulseWords, useCalPulse ? 2 : 1, la->response);
+
+            //Poll until a cluster is latched and the L1A has been sent, at most 200 us + pulseDelay * 25 ns * (0.001 us / ns)
+            uint32_t clusters[nclusters];
+            auto pulseStart = std::chrono::steady_clock::now();
+            auto deadline   = pulseStart + std::chrono::microseconds(200+int(ceil(pulseDelay*25*0.001)));
+            auto backoff    = std::chrono::microseconds(2);
+            while (true) {
+                readAddressList(addrSbitCluster, clusters, nclusters, la->response);
+                bool latched = false;
+                for (int cluster=0; cluster<nclusters; ++cluster)
+                    latched |= (clusters[cluster] != 0xdeaddead) && ((clusters[cluster] & 0x7ff) < sbit::SBIT_ADDRESSES); //A failed read is not a cluster
+                if ((latched && !(useCalPulse && readRegHandle(ttcCyclicRunning, la->response) == 0x1)) || std::chrono::steady_clock::now() >= deadline)
+                    break;
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(2*backoff, std::chrono::microseconds(32));
             }
-
-            //Sleep for 200 us + pulseDelay * 25 ns * (0.001 us / ns)
-            std::this_thread::sleep_for(std::chrono::microseconds(200+int(ceil(pulseDelay*25*0.001))));
+            pollTime += std::chrono::steady_clock::now() - pulseStart;
 
             //Check clusers
+            bool anyValid = false;
             for (int cluster=0; cluster<nclusters; ++cluster) {
                 //int idx = vfatN * posPerVFAT + chan * posPerChan + iPulse * posPerEvt + cluster; //Array index
                 int idx = chan * (nevts*nclusters) + (iPulse*nclusters+cluster);
@@ -864,34 +1175,45 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
                 //bits [10:0] is the address of the cluster
                 //bits [14:12] is the cluster size
                 //bits 15 and 11 are not used
-                uint32_t thisCluster = readRawAddress(addrSbitCluster[cluster], la->response);
+                uint32_t thisCluster = clusters[cluster];
                 int clusterSize = (thisCluster >> 12) & 0x7;
                 uint32_t sbitAddress = (thisCluster & 0x7ff);
-                bool isValid = (sbitAddress < 1536); //Possible values are [0,(24*64)-1]
-                int vfatObserved = 7-int(sbitAddress/192)+int((sbitAddress%192)/64)*8;
-                int sbitObserved = sbitAddress % 64;
+                bool isValid = (thisCluster != 0xdeaddead) && (sbitAddress < sbit::SBIT_ADDRESSES); //Possible values are [0,(24*64)-1]
+                int vfatObserved = sbit::addressToVFAT(sbitAddress);
+                int sbitObserved = sbit::addressToSbit(sbitAddress);
 
                 outData[idx] = ((clusterSize & 0x7 ) << 27) + ((isValid & 0x1) << 26) + ((vfatObserved & 0x1f) << 21) + ((vfatN & 0x1f) << 16) + ((sbitObserved & 0xff) << 8) + (chan & 0xff);
 
                 if (isValid) {
-                    LOGGER->log_message(
-                            LogManager::INFO,
-                            stdsprintf(
-                                "valid sbit data: useCalPulse %i; thisClstr %x; clstrSize %x; sbitAddr %x; isValid %x; vfatN %i; vfatObs %i; chan %i; sbitObs %i",
-                                useCalPulse, thisCluster, clusterSize, sbitAddress, isValid, vfatN, vfatObserved, chan, sbitObserved));
+                    anyValid = true;
+                    ++nValidClusters;
+                    nWrongVFAT += (uint32_t(vfatObserved) != vfatN) ? 1 : 0;
+                    nWrongSbit += (uint32_t(sbitObserved) != sbit::channelToSbit(chan)) ? 1 : 0;
+                    if (logDebug) {
+                        LOGGER->log_message(
+                                LogManager::DEBUG,
+                                stdsprintf(
+                                    "valid sbit data: useCalPulse %i; thisClstr %x; clstrSize %x; sbitAddr %x; isValid %x; vfatN %i; vfatObs %i; chan %i; sbitObs %i",
+                                    useCalPulse, thisCluster, clusterSize, sbitAddress, isValid, vfatN, vfatObserved, chan, sbitObserved));
+                    }
                 }
             } //End Loop over clusters
+            nValidPulses += anyValid ? 1 : 0;
         } //End Pulses for this channel
+        nSilentChannels += (nValidPulses == 0) ? 1 : 0;
+    } //End Loop over all channels
 
-        //Turn off the calpulse for this channel
-        if (confCalPulseLocal(la, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan, false, currentPulse, calScaleFactor) == false) {
-            la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan));
-            return; //Calibration pulse is not configured correctly
-        }
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Sbit mapping of OH%i VFAT%i with useCalPulse %i: %u valid clusters in %u pulses, %u on another VFAT, %u on another sbit, %u channels without any cluster, mean wait %.1f us per pulse",
+                                                     ohN, vfatN, useCalPulse, nValidClusters, 128*nevts, nWrongVFAT, nWrongSbit, nSilentChannels,
+                                                     nevts ? std::chrono::duration<double, std::micro>(pollTime).count()/(128*nevts) : 0.));
 
-        //mask this channel
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x1);
-    } //End Loop over all channels
+    //Turn off the calpulse and mask the last channel
+    calConfig.channels.reset();
+    calConfig.mode = CALPULSE_OFF;
+    if (applyCalPulseConfigLocal(la, calConfig, &calState) == false) {
+        la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x", ohN, ~((0x1)<<vfatN) & 0xFFFFFF));
+        return; //Calibration pulse is not configured correctly
+    }
 
     //Place this vfat out of run mode
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x0);
@@ -912,6 +1234,7 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
 void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response)
 {
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatN = request->get_word("vfatN");
@@ -923,10 +1246,24 @@ void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response)
     uint32_t L1Ainterval = request->get_word("L1Ainterval");
     uint32_t pulseDelay = request->get_word("pulseDelay");
 
-    uint32_t outData[128*8*nevts];
+    bool analysis = request->get_key_exists("analysis") && request->get_word("analysis");
+
+    uint32_t *outData = scanResultBuffer(&la, "data", size_t(128)*8*nevts);
+    if (!outData) {
+        rtxn.abort();
+        return;
+    }
     checkSbitMappingWithCalPulseLocal(&la, outData, ohN, vfatN, mask, useCalPulse, currentPulse, calScaleFactor, nevts, L1Ainterval, pulseDelay);
 
-    response->set_word_array("data",outData,128*8*nevts);
+    if (analysis) {
+        //Only the summary and the words of the mismatching pulses are returned, compacted at the start of outData
+        sbitMappingSummary summary;
+        uint32_t nMismatchWords = analyzeSbitMapping(outData, nevts, vfatN, summary, outData);
+        setSbitMappingSummary(response, summary);
+        setScanResultArray(&la, "data", nMismatchWords);
+    } else {
+        setScanResultArray(&la, "data", size_t(128)*8*nevts);
+    }
 
     rtxn.abort();
 } //End checkSbitMappingWithCalPulse()
@@ -1016,15 +1353,18 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
     LOGGER->log_message(LogManager::INFO, stdsprintf("Placing vfatN %i on ohN %i in run mode", vfatN, ohN));
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x1);
 
+    //Only this channel is unmasked and pulsed, moving to the next channel is a single transaction
+    calPulseState calState;
+    calPulseConfig calConfig = makeCalPulseConfig(ohN, ~((0x1)<<vfatN) & 0xFFFFFF, useCalPulse, currentPulse, calScaleFactor);
+    calConfig.unmask = true;
+
     LOGGER->log_message(LogManager::INFO, stdsprintf("Looping over all channels of vfatN %i on ohN %i", vfatN, ohN));
     for (int chan=0; chan < 128; ++chan) { //Loop over all channels
-        //unmask this channel
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Unmasking channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x0);
-
-        //Turn on the calpulse for this channel
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Enabling calpulse for channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        if (confCalPulseLocal(la, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan, useCalPulse, currentPulse, calScaleFactor) == false) {
+        //unmask this channel and turn on the calpulse for it, mask the previous channel and turn off its calpulse
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Unmasking and enabling calpulse for channel %i on vfat %i of OH %i", chan, vfatN, ohN));
+        calConfig.channels.reset();
+        calConfig.channels.set(chan);
+        if (applyCalPulseConfigLocal(la, calConfig, &calState) == false) {
             la->response->set_string("error",stdsprintf("Unable to configure calpulse %b for ohN %i mask %x chan %i", useCalPulse, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan));
             return; //Calibration pulse is not configured correctly
         }
@@ -1055,19 +1395,17 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
         //Reset the TTC Generator
         LOGGER->log_message(LogManager::INFO, "Stopping TTC Generator");
         writeRawAddress(addrTtcReset, 0x1, la->response);
-
-        //Turn off the calpulse for this channel
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Disabling calpulse for channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        if (confCalPulseLocal(la, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan, false, currentPulse, calScaleFactor) == false) {
-            la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan));
-            return; //Calibration pulse is not configured correctly
-        }
-
-        //mask this channel
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Masking channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x1);
     } //End Loop over all channels
 
+    //Turn off the calpulse and mask the last channel
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Disabling calpulse and masking the last channel on vfat %i of OH %i", vfatN, ohN));
+    calConfig.channels.reset();
+    calConfig.mode = CALPULSE_OFF;
+    if (applyCalPulseConfigLocal(la, calConfig, &calState) == false) {
+        la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x", ohN, ~((0x1)<<vfatN) & 0xFFFFFF));
+        return; //Calibration pulse is not configured correctly
+    }
+
     //Place this vfat out of run mode
     LOGGER->log_message(LogManager::INFO, stdsprintf("Finished looping over all channels.  Taking vfatN %i on ohN %i out of run mode", vfatN, ohN));
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x0);
@@ -1090,6 +1428,7 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
 void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response)
 {
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatN = request->get_word("vfatN");
@@ -1113,7 +1452,7 @@ void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response)
     rtxn.abort();
 } //End checkSbitRateWithCalPulse()
 
-std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep, uint32_t mask, bool useExtRefADC)
+std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep, uint32_t mask, bool useExtRefADC, uint32_t nReads, bool stopOnVariance)
 {
     //Ensure VFAT3 Hardware
     if (fw_version_check("dacScanLocal", la) < 3) {
@@ -1147,19 +1486,38 @@ std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSele
         return emptyVec;
     }
 
+    if (nReads == 0) {
+        la->response->set_string("error","dacScanLocal needs at least one ADC read per point");
+        std::vector<uint32_t> emptyVec;
+        return emptyVec;
+    }
+
     //Determine the addresses
     std::string regName = std::get<0>(map_dacSelect[dacSelect]);
     LOGGER->log_message(LogManager::INFO, stdsprintf("Scanning DAC: %s",regName.c_str()));
     uint32_t adcAddr[24];
     uint32_t adcCacheUpdateAddr[24];
+    RegHandle dacReg[24];
+    uint32_t dacRegWord[24];
+    std::vector<int> unmaskedVFATs;
     bool foundAdcCached = false;
     for (int vfatN=0; vfatN<24; ++vfatN) {
         //Skip Masked VFATs
         if ( !( (notmask >> vfatN) & 0x1)) continue;
+        unmaskedVFATs.push_back(vfatN);
 
         //Determine Register Base string
         std::string strRegBase = stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.",ohN,vfatN);
 
+        //The other fields of the DAC register word do not change during the scan
+        dacReg[vfatN] = getRegHandle(la, strRegBase + regName);
+        if (dacReg[vfatN].address == 0xdeaddead) {
+            la->response->set_string("error",stdsprintf("Unable to resolve %s%s",strRegBase.c_str(),regName.c_str()));
+            std::vector<uint32_t> emptyVec;
+            return emptyVec;
+        }
+        dacRegWord[vfatN] = (dacReg[vfatN].mask == 0xFFFFFFFF) ? 0x0 : readRawAddress(dacReg[vfatN].address, la->response);
+
         //Get ADC address
         if (useExtRefADC) { //Case: Use ADC with external reference
             //for backward compatibility, use ADC1 instead of ADC1_CACHED if it exists
@@ -1184,7 +1542,7 @@ std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSele
     //make the output container and correctly size it
     uint32_t dacMax = std::get<2>(map_dacSelect[dacSelect]);
     uint32_t dacMin = std::get<1>(map_dacSelect[dacSelect]);
-    int nDacValues = (dacMax-dacMin+1)/dacStep;
+    const uint32_t nDacValues = scanPoints(dacMin, dacMax, dacStep);
     std::vector<uint32_t> vec_dacScanData(24*nDacValues); //Each element has bits [0:7] as the current dacValue, and bits [8:17] as the ADC read back value
 
     //Configure the DAC Monitoring on all the VFATs
@@ -1198,44 +1556,76 @@ std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSele
     LOGGER->log_message(LogManager::INFO, stdsprintf("VFATs not in 0x%x were set to run mode", mask));
     std::this_thread::sleep_for(std::chrono::seconds(1)); //I noticed that DAC values behave weirdly immediately after VFAT is placed in run mode (probably voltage/current takes a moment to stabalize)
 
-    //Scan the DAC
+    //Scan the DAC, all unmasked VFATs at once
+    const size_t nVFATs = unmaskedVFATs.size();
+    std::vector<uint32_t> dacAddrs(nVFATs), dacWords(nVFATs), adcAddrs(nVFATs), updateAddrs(nVFATs), updateWords(nVFATs, 0x0), adcVals(nVFATs);
+    for (size_t i = 0; i < nVFATs; ++i) {
+        dacAddrs[i]    = dacReg[unmaskedVFATs[i]].address;
+        adcAddrs[i]    = adcAddr[unmaskedVFATs[i]];
+        updateAddrs[i] = adcCacheUpdateAddr[unmaskedVFATs[i]];
+    }
 
-    uint32_t nReads=100;
-    for (uint32_t dacVal=dacMin; dacVal<=dacMax; dacVal += dacStep) { //Loop over DAC values
-        for (int vfatN=0; vfatN<24; ++vfatN) { //Loop over VFATs
-            //Skip masked VFATs
-            if ( !( (notmask >> vfatN) & 0x1)) { //Case: VFAT is masked, skip
-                //Store word, but with adcVal = 0
-                int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                vec_dacScanData[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + (dacVal & 0xff);
-
-                //skip
-                continue;
-            } //End Case: VFAT is masked, skip
-            else{ //Case: VFAT is not masked
-            //Set DAC value
-                std::string strDacReg = stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.",ohN,vfatN) + regName;
-                writeReg(la, strDacReg, dacVal);
-                //Read nReads times and take avg value
-                uint32_t adcVal=0;
-                for (uint32_t i=0; i<nReads; ++i) {
-                    //Read the ADC
-                    if (foundAdcCached) {
-                        //either reading or writing this register will trigger a cache update
-                        readRawAddress(adcCacheUpdateAddr[vfatN], la->response);
-                        //updating the cache takes 20 us, including a 50% safety factor
-                        std::this_thread::sleep_for(std::chrono::microseconds(20));
-                    }
-                    adcVal += readRawAddress(adcAddr[vfatN], la->response);
+    //Early stopping needs a few reads to estimate the variance
+    const uint32_t minReads = std::min(nReads, 10u);
+    uint64_t readsTaken = 0, pointsTaken = 0;
+    std::vector<uint64_t> adcSum(nVFATs), adcSumSq(nVFATs);
+    for (uint32_t dacVal=dacMin; dacVal<=dacMax && !scanJobCancelled(); dacVal += dacStep) { //Loop over DAC values
+        //Set the DAC value on all unmasked VFATs in one transaction
+        for (size_t i = 0; i < nVFATs; ++i) {
+            RegHandle const& reg = dacReg[unmaskedVFATs[i]];
+            dacWords[i] = (reg.mask == 0xFFFFFFFF) ? dacVal : (((dacVal << __builtin_ctz(reg.mask)) & reg.mask) | (dacRegWord[unmaskedVFATs[i]] & ~reg.mask));
+        }
+        writeAddressList(dacAddrs.data(), dacWords.data(), nVFATs, la->response);
+
+        //Read up to nReads times and take avg value, the ADCs of all VFATs are sampled together
+        std::fill(adcSum.begin(), adcSum.end(), 0);
+        std::fill(adcSumSq.begin(), adcSumSq.end(), 0);
+        uint32_t nTaken = 0;
+        while (nTaken < nReads) {
+            if (foundAdcCached) {
+                //either reading or writing this register will trigger a cache update
+                writeAddressList(updateAddrs.data(), updateWords.data(), nVFATs, la->response);
+                //updating the cache takes 20 us, including a 50% safety factor
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+            readAddressList(adcAddrs.data(), adcVals.data(), nVFATs, la->response);
+            for (size_t i = 0; i < nVFATs; ++i) {
+                adcSum[i]   += adcVals[i];
+                adcSumSq[i] += uint64_t(adcVals[i])*adcVals[i];
+            }
+            ++nTaken;
+
+            //Stop once the standard error of the mean of every VFAT is below half an ADC count
+            if (stopOnVariance && nTaken >= minReads) {
+                bool converged = true;
+                for (size_t i = 0; i < nVFATs && converged; ++i) {
+                    double mean     = double(adcSum[i])/nTaken;
+                    double variance = double(adcSumSq[i])/nTaken - mean*mean;
+                    converged = (variance/nTaken < 0.25);
                 }
-                adcVal = adcVal/nReads;
-                //Store value
-                int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                vec_dacScanData[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + ((adcVal & 0x3ff) << 8) + (dacVal & 0xff);
-            } //End Case: VFAT is not masked
+                if (converged)
+                    break;
+            }
+        }
+        readsTaken += nTaken;
+        ++pointsTaken;
+
+        for (int vfatN=0; vfatN<24; ++vfatN) { //Loop over VFATs
+            //Store word, but with adcVal = 0 for masked VFATs
+            size_t idx = scanDataIndex(nDacValues, 0, vfatN, (dacVal-dacMin)/dacStep);
+            vec_dacScanData[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + (dacVal & 0xff);
         } //End Loop over VFATs
+        for (size_t i = 0; i < nVFATs; ++i) {
+            int vfatN = unmaskedVFATs[i];
+            uint32_t adcVal = adcSum[i]/nTaken;
+            size_t idx = scanDataIndex(nDacValues, 0, vfatN, (dacVal-dacMin)/dacStep);
+            vec_dacScanData[idx] |= ((adcVal & 0x3ff) << 8);
+        }
+        scanJobStep(dacVal);
     } //End Loop over DAC values
 
+    if (pointsTaken)
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Scanned %s on %u VFATs of OH%i with %.1f ADC reads per point on average", regName.c_str(), unsigned(nVFATs), ohN, double(readsTaken)/pointsTaken));
 
     //Take the VFATs out of Run Mode
     broadcastWriteLocal(la, ohN, "CFG_RUN", 0x0, mask);
@@ -1252,8 +1642,10 @@ void dacScan(const RPCMsg *request, RPCMsg *response)
     uint32_t dacStep = request->get_word("dacStep");
     uint32_t mask = request->get_word("mask");
     bool useExtRefADC = request->get_word("useExtRefADC");
+    uint32_t nReads = request->get_key_exists("nReads") ? request->get_word("nReads") : 100;
+    bool stopOnVariance = request->get_key_exists("stopOnVariance") && request->get_word("stopOnVariance");
 
-    std::vector<uint32_t> dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, mask, useExtRefADC);
+    std::vector<uint32_t> dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, mask, useExtRefADC, nReads, stopOnVariance);
     response->set_word_array("dacScanResults",dacScanResults);
 
     rtxn.abort();
@@ -1267,8 +1659,10 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response)
     uint32_t dacSelect = request->get_word("dacSelect");
     uint32_t dacStep = request->get_word("dacStep");
     bool useExtRefADC = request->get_word("useExtRefADC");
+    uint32_t nReads = request->get_key_exists("nReads") ? request->get_word("nReads") : 100;
+    bool stopOnVariance = request->get_key_exists("stopOnVariance") && request->get_word("stopOnVariance");
 
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
     if (request->get_key_exists("NOH")) {
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -1284,8 +1678,10 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response)
 
         // If this Optohybrid is masked skip it
         if (!((ohMask >> ohN) & 0x1)) {
-            int dacMax = std::get<2>(dacInfo.map_dacInfo[dacSelect]);
-            dacScanResults.assign( (dacMax+1)*24/dacStep, 0xdeaddead );
+            //Same length as the result of an unmasked OH, so that the client finds every OH at the same stride
+            auto dac = dacInfo.map_dacInfo.find(dacSelect);
+            if (dac != dacInfo.map_dacInfo.end() && dacStep)
+                dacScanResults.assign(oh::VFATS_PER_OH*scanPoints(std::get<1>(dac->second), std::get<2>(dac->second), dacStep), 0xdeaddead);
             std::copy(dacScanResults.begin(), dacScanResults.end(), std::back_inserter(dacScanResultsAll));
             continue;
         }
@@ -1296,7 +1692,7 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response)
 
         //Get dac scan results for this optohybrid
         LOGGER->log_message(LogManager::INFO, stdsprintf("Performing DAC Scan for OH%i", ohN));
-        dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, vfatMask, useExtRefADC);
+        dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, vfatMask, useExtRefADC, nReads, stopOnVariance);
 
         //Copy the results into the final container
         LOGGER->log_message(LogManager::INFO, stdsprintf("Storing results of DAC scan for OH%i", ohN));
@@ -1314,6 +1710,7 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response)
 void genChannelScan(const RPCMsg *request, RPCMsg *response)
 {
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t nevts = request->get_word("nevts");
     uint32_t ohN = request->get_word("ohN");
@@ -1332,11 +1729,106 @@ void genChannelScan(const RPCMsg *request, RPCMsg *response)
         useUltra = true;
     }
 
-    uint32_t outData[128*24*(dacMax-dacMin+1)/dacStep];
-    for (uint32_t ch = 0; ch < 128; ch++) {
-        genScanLocal(&la, &(outData[ch*24*(dacMax-dacMin+1)/dacStep]), ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig);
+    //On-board S-curve analysis, the counts are only returned on request
+    bool fit = request->get_key_exists("fit");
+    bool returnRaw = !fit || request->get_key_exists("returnRaw");
+    std::vector<uint32_t> fitResults[4];
+    if (fit) {
+        for (auto & results : fitResults)
+            results.assign(oh::VFATS_PER_OH*128, 0);
+    }
+
+    if (request->get_key_exists("adaptive")) {
+        if (request->get_key_exists("resultFile")) {
+            response->set_string("error", "Streaming the results of an adaptive scan to a result file is not supported");
+            rtxn.abort();
+            return;
+        }
+        adaptiveScanParams params = getAdaptiveScanParams(request, nevts);
+        std::vector<uint32_t> nPoints, dacPoints, outData, chDacPoints, chData;
+        calPulseState calState;
+        for (uint32_t ch = 0; ch < 128 && !scanJobCancelled() && !response->get_key_exists("error"); ch++) {
+            genScanAdaptiveLocal(&la, chDacPoints, chData, ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, params, scanReg, useExtTrig, &calState);
+            if (fit)
+                fitSCurvesLocal(chData.data(), chDacPoints.data(), chDacPoints.size(), nevts, mask, ch, fitResults);
+            nPoints.push_back(chDacPoints.size());
+            if (returnRaw) {
+                dacPoints.insert(dacPoints.end(), chDacPoints.begin(), chDacPoints.end());
+                outData.insert(outData.end(), chData.begin(), chData.end());
+            }
+        }
+        response->set_word_array("nPoints", nPoints);
+        if (fit)
+            setSCurveFitResults(response, fitResults);
+
+        if (returnRaw) {
+            response->set_word_array("dacPoints", dacPoints);
+            uint32_t *data = scanResultBuffer(&la, "data", outData.size());
+            if (data) {
+                std::copy(outData.begin(), outData.end(), data);
+                setScanResultArray(&la, "data", outData.size());
+            }
+        }
+        rtxn.abort();
+        return;
+    }
+
+    if (!checkScanRange(&la, dacMin, dacMax, dacStep)) {
+        rtxn.abort();
+        return;
+    }
+
+    //Channels pulsed together, the legacy loop over single channels otherwise
+    channelGroups groups;
+    if (request->get_key_exists("grouping")) {
+        uint32_t groupSize = request->get_key_exists("groupSize") ? request->get_word("groupSize") : 8;
+        if (!getChannelGroups(&la, request->get_string("grouping"), groupSize, groups)) {
+            rtxn.abort();
+            return;
+        }
+        if (request->get_key_exists("resultFile")) {
+            response->set_string("error", "Streaming the results of a grouped channel scan to a result file is not supported");
+            rtxn.abort();
+            return;
+        }
+    }
+
+    std::unique_ptr<ScanResultFile> resultFile;
+    if (request->get_key_exists("resultFile")) {
+        resultFile = openScanResultFile(&la, request->get_string("resultFile"), "genChannelScan", scanReg, 0x1 << ohN, mask, 128, nevts, dacMin, dacMax, dacStep,
+                                        scanResultFlags(useCalPulse, currentPulse, useExtTrig), calScaleFactor);
+        if (!resultFile) {
+            rtxn.abort();
+            return;
+        }
+    }
+    ScanResultSink sink(&la, std::move(resultFile));
+
+    const uint32_t nPoints = scanPoints(dacMin, dacMax, dacStep);
+    uint32_t *outData = scanResultBuffer(&la, "data", 128*24*nPoints);
+    if (!outData) {
+        rtxn.abort();
+        return;
+    }
+    if (!groups.empty()) {
+        genChannelScanGroupedLocal(&la, outData, ohN, mask, groups, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useExtTrig);
+    } else {
+        calPulseState calState;
+        for (uint32_t ch = 0; ch < 128; ch++) {
+            genScanLocal(&la, &(outData[scanDataIndex(nPoints, ch, 0, 0)]), ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig, &calState);
+        }
+    }
+
+    if (fit) {
+        std::vector<uint32_t> dacPoints(nPoints);
+        for (uint32_t i = 0; i < nPoints; ++i)
+            dacPoints[i] = dacMin + i*dacStep;
+        for (uint32_t ch = 0; ch < 128; ch++)
+            fitSCurvesLocal(&(outData[scanDataIndex(nPoints, ch, 0, 0)]), dacPoints.data(), nPoints, nevts, mask, ch, fitResults);
+        setSCurveFitResults(response, fitResults);
     }
-    response->set_word_array("data",outData,24*128*(dacMax-dacMin+1)/dacStep);
+    if (returnRaw)
+        setScanResultArray(&la, "data", 24*128*nPoints);
 
     rtxn.abort();
 }
@@ -1350,13 +1842,21 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        modmgr->register_method("calibration_routines", "cancelScan", cancelScan);
         modmgr->register_method("calibration_routines", "checkSbitMappingWithCalPulse", checkSbitMappingWithCalPulse);
         modmgr->register_method("calibration_routines", "checkSbitRateWithCalPulse", checkSbitRateWithCalPulse);
         modmgr->register_method("calibration_routines", "dacScan", dacScan);
         modmgr->register_method("calibration_routines", "dacScanMultiLink", dacScanMultiLink);
+        modmgr->register_method("calibration_routines", "fetchScanResultBuffer", fetchScanResultBuffer);
+        modmgr->register_method("calibration_routines", "fetchScanResults", fetchScanResults);
         modmgr->register_method("calibration_routines", "genScan", genScan);
+        modmgr->register_method("calibration_routines", "genScanMultiLink", genScanMultiLink);
+        modmgr->register_method("calibration_routines", "readScanResultFile", readScanResultFile);
+        modmgr->register_method("calibration_routines", "resumeScan", resumeScan);
         modmgr->register_method("calibration_routines", "genChannelScan", genChannelScan);
+        modmgr->register_method("calibration_routines", "getScanProgress", getScanProgress);
         modmgr->register_method("calibration_routines", "sbitRateScan", sbitRateScan);
+        modmgr->register_method("calibration_routines", "submitScan", submitScan);
         modmgr->register_method("calibration_routines", "ttcGenConf", ttcGenConf);
         modmgr->register_method("calibration_routines", "ttcGenToggle", ttcGenToggle);
     }
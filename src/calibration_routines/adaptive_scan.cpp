@@ -0,0 +1,165 @@
+/*! \file calibration_routines/adaptive_scan.cpp
+ *  \brief Adaptive generic scan for v3 electronics
+ */
+
+#include "calibration_routines/adaptive_scan.h"
+#include "calibration_routines/cal_pulse.h"
+#include "calibration_routines/scan_engine.h"
+#include "calibration_routines/scan_jobs.h"
+#include "calibration_routines.h"
+#include "amc.h"
+#include "hw_constants.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <queue>
+
+namespace {
+    typedef std::array<uint32_t, oh::VFATS_PER_OH> vfatCounts;
+
+    /*!
+     * \brief Interval between two measured points, ordered by the largest count difference of its ends
+     */
+    struct scanInterval {
+        uint32_t lo;
+        uint32_t hi;
+        uint32_t delta;
+        bool operator<(const scanInterval & other) const { return delta < other.delta; }
+    };
+
+    uint32_t countDelta(const vfatCounts & lo, const vfatCounts & hi, uint32_t notmask)
+    {
+        uint32_t delta = 0;
+        for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            if (!((notmask >> vfatN) & 0x1))
+                continue;
+            delta = std::max(delta, lo[vfatN] > hi[vfatN] ? lo[vfatN]-hi[vfatN] : hi[vfatN]-lo[vfatN]);
+        }
+        return delta;
+    }
+}
+
+bool checkAdaptiveScanParams(localArgs *la, const adaptiveScanParams & params)
+{
+    if (params.dacMax < params.dacMin || params.fineStep == 0 || params.coarseStep < params.fineStep) {
+        la->response->set_string("error", stdsprintf("Invalid adaptive scan range: dacMin %u, dacMax %u, dacStep %u, coarseStep %u",
+                                                     params.dacMin, params.dacMax, params.fineStep, params.coarseStep));
+        return false;
+    }
+    uint32_t nCoarse = (params.dacMax-params.dacMin)/params.coarseStep + 1 + (((params.dacMax-params.dacMin) % params.coarseStep) ? 1 : 0);
+    if (params.maxPoints && params.maxPoints < nCoarse) {
+        la->response->set_string("error", stdsprintf("maxPoints %u is smaller than the %u points of the coarse pass", params.maxPoints, nCoarse));
+        return false;
+    }
+    return true;
+}
+
+adaptiveScanParams getAdaptiveScanParams(const RPCMsg *request, uint32_t nevts)
+{
+    adaptiveScanParams params;
+    params.dacMin        = request->get_word("dacMin");
+    params.dacMax        = request->get_word("dacMax");
+    params.fineStep      = request->get_word("dacStep");
+    params.coarseStep    = request->get_key_exists("coarseStep") ? request->get_word("coarseStep") : 8*params.fineStep;
+    params.maxPoints     = request->get_key_exists("maxPoints") ? request->get_word("maxPoints") : 0;
+    params.plateauCounts = request->get_key_exists("plateauCounts") ? request->get_word("plateauCounts") : std::max(nevts/20, 1u);
+    return params;
+}
+
+void genScanAdaptiveLocal(localArgs *la, std::vector<uint32_t> & dacPoints, std::vector<uint32_t> & outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, const adaptiveScanParams & params, std::string scanReg, bool useExtTrig, calPulseState *calState)
+{
+    dacPoints.clear();
+    outData.clear();
+
+    if (fw_version_check("genScanAdaptiveLocal", la) != 3) {
+        la->response->set_string("error", "The adaptive scan is only supported in V3 electronics");
+        return;
+    }
+    if (!checkAdaptiveScanParams(la, params))
+        return;
+
+    //Determine the inverse of the vfatmask
+    uint32_t notmask = ~mask & 0xFFFFFF;
+
+    if (!checkGenScanLocal(la, ohN, mask, currentPulse, calScaleFactor))
+        return;
+
+    const genScanPlan & plan = getGenScanPlan(la, ohN, scanReg);
+    if (!plan.valid) {
+        la->response->set_string("error", stdsprintf("Unable to resolve the registers of the scan over CFG_%s for ohN %i", scanReg.c_str(), ohN));
+        return;
+    }
+
+    if (useCalPulse && confCalPulseLocal(la, ohN, mask, ch, true, currentPulse, calScaleFactor, calState) == false) {
+        la->response->set_string("error", stdsprintf("Unable to configure calpulse ON for ohN %i mask %x chan %i", ohN, mask, ch));
+        return;
+    }
+
+    //TTC Config
+    confScanTriggersLocal(la, nevts, useExtTrig);
+
+    dacMonConfLocal(la, ohN, ch);
+
+    uint32_t regWords[oh::VFATS_PER_OH];
+    readScanRegWords(la, plan, mask, regWords);
+
+    std::map<uint32_t, vfatCounts> points; //key -> scan register value; val -> GOOD_EVENTS_COUNT per VFAT
+    auto measure = [&](uint32_t dacVal) {
+        genScanStepLocal(la, plan, mask, regWords, dacVal, nevts, useExtTrig, points[dacVal].data());
+        scanJobStep(dacVal);
+    };
+
+    //Coarse pass, always ending on dacMax
+    for (uint32_t dacVal = params.dacMin; dacVal < params.dacMax && !scanJobCancelled(); dacVal += params.coarseStep)
+        measure(dacVal);
+    if (!scanJobCancelled())
+        measure(params.dacMax);
+    const uint32_t nCoarse = points.size();
+
+    std::priority_queue<scanInterval> intervals;
+    auto addInterval = [&](uint32_t lo, uint32_t hi) {
+        if (hi - lo > params.fineStep)
+            intervals.push(scanInterval{lo, hi, countDelta(points[lo], points[hi], notmask)});
+    };
+    for (auto it = points.begin(); it != points.end() && std::next(it) != points.end(); ++it)
+        addInterval(it->first, std::next(it)->first);
+
+    //Refinement, the most changing interval first
+    while (!intervals.empty() && !scanJobCancelled() && (params.maxPoints == 0 || points.size() < params.maxPoints)) {
+        scanInterval interval = intervals.top();
+        intervals.pop();
+        if (interval.delta <= params.plateauCounts)
+            break; //All remaining intervals are on a plateau
+
+        uint32_t nFine = (interval.hi - interval.lo)/params.fineStep;
+        uint32_t mid = interval.lo + std::max(nFine/2, 1u)*params.fineStep;
+        measure(mid);
+        addInterval(interval.lo, mid);
+        addInterval(mid, interval.hi);
+    }
+
+    if (calState)
+        calState->invalidateCfg(); //The scan register may share a word with the CFG_CAL_* registers
+    if (useCalPulse && confCalPulseLocal(la, ohN, mask, ch, false, currentPulse, calScaleFactor, calState) == false) {
+        la->response->set_string("error", stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, mask, ch));
+        return;
+    }
+
+    const uint32_t nPoints = points.size();
+    outData.assign(oh::VFATS_PER_OH*nPoints, 0);
+    size_t idx = 0;
+    for (auto const& point : points) {
+        dacPoints.push_back(point.first);
+        for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            if ((notmask >> vfatN) & 0x1)
+                outData[vfatN*nPoints + idx] = point.second[vfatN];
+        }
+        ++idx;
+    }
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Adaptive scan of CFG_%s on OH%i channel %i: %u points (%u coarse) instead of %u",
+                                                     scanReg.c_str(), ohN, ch, nPoints, nCoarse,
+                                                     (params.dacMax-params.dacMin)/params.fineStep+1));
+}
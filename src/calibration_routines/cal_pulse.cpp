@@ -0,0 +1,200 @@
+/*! \file calibration_routines/cal_pulse.cpp
+ *  \brief Batched calibration pulse configuration for v3 electronics
+ */
+
+#include "calibration_routines/cal_pulse.h"
+
+#include <map>
+#include <vector>
+
+namespace {
+    /*!
+     * \brief Calibration pulse registers of one VFAT
+     */
+    struct calPulseRegs {
+        bool valid = false;
+        uint32_t enableBits = 0; ///< mask of the CALPULSE_ENABLE field, identical for all channels
+        uint32_t maskBits   = 0; ///< mask of the MASK field, identical for all channels
+        std::array<uint32_t, 128> chanAddrs;
+        std::array<RegHandle, 3> cfg; ///< CFG_CAL_MODE, CFG_CAL_FS, CFG_CAL_DUR
+    };
+
+    enum { CAL_MODE = 0, CAL_FS = 1, CAL_DUR = 2 };
+
+    std::map<std::string, ATGenerationCache<calPulseRegs> > calPulseRegCache; ///< key is "OH<ohN>.VFAT<vfatN>"
+
+    calPulseRegs const& getCalPulseRegs(localArgs *la, uint32_t ohN, uint32_t vfatN)
+    {
+        return calPulseRegCache[stdsprintf("OH%i.VFAT%i",ohN,vfatN)].get(la, [&](localArgs *la) {
+                calPulseRegs regs;
+                bool found = true;
+                auto resolve = [&](const std::string & regName) {
+                    RegHandle reg = getRegHandle(la, regName);
+                    found &= (reg.address != 0xdeaddead);
+                    return reg;
+                };
+
+                for (unsigned int chan = 0; chan < 128; ++chan) {
+                    RegHandle reg = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE",ohN,vfatN,chan));
+                    regs.chanAddrs[chan] = reg.address;
+                    regs.enableBits      = reg.mask;
+                }
+                RegHandle mask = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL0.MASK",ohN,vfatN));
+                regs.maskBits = mask.mask;
+                found &= (mask.address == regs.chanAddrs[0]); //Both fields must belong to the channel register
+
+                regs.cfg[CAL_MODE] = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE",ohN,vfatN));
+                regs.cfg[CAL_FS]   = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_FS",ohN,vfatN));
+                regs.cfg[CAL_DUR]  = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_DUR",ohN,vfatN));
+
+                regs.valid = found;
+                return regs;
+            });
+    }
+
+    inline uint32_t setField(uint32_t word, uint32_t fieldMask, uint32_t value)
+    {
+        return (word & ~fieldMask) | ((value << __builtin_ctz(fieldMask)) & fieldMask);
+    }
+}
+
+calPulseConfig makeCalPulseConfig(uint32_t ohN, uint32_t vfatMask, bool toggleOn, bool currentPulse, uint32_t calScaleFactor)
+{
+    calPulseConfig config;
+    config.ohN            = ohN;
+    config.vfatMask       = vfatMask;
+    config.mode           = toggleOn ? (currentPulse ? CALPULSE_CURRENT : CALPULSE_VOLTAGE) : CALPULSE_OFF;
+    config.calScaleFactor = calScaleFactor;
+    config.exclusive      = false;
+    config.unmask         = false;
+    return config;
+}
+
+bool applyCalPulseConfigLocal(localArgs *la, const calPulseConfig & config, calPulseState *state)
+{
+    if (config.mode == CALPULSE_CURRENT && config.calScaleFactor > 3) {
+        la->response->set_string("error", stdsprintf("Bad value for CFG_CAL_FS: %x, Possible values are {0b00, 0b01, 0b10, 0b11}. Exiting.",config.calScaleFactor));
+        return false;
+    }
+
+    //Errors already in the response (e.g. from an interrupted scan) must not prevent turning the pulse off
+    const bool hadError = la->response->get_key_exists("error");
+
+    calPulseState localState;
+    if (state == nullptr)
+        state = &localState;
+    if (state->ohN != config.ohN) {
+        state->vfats.fill(calPulseState::vfatWords());
+        state->ohN = config.ohN;
+    }
+
+    const uint32_t notmask = ~config.vfatMask & 0xFFFFFF;
+    calPulseRegs const* regs[oh::VFATS_PER_OH] = {};
+    std::bitset<128> touched[oh::VFATS_PER_OH];
+
+    //Read back the words the state does not know yet, for all VFATs in one list
+    std::vector<uint32_t> addrs, words;
+    std::vector<uint32_t*> targets;
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        if (!((notmask >> vfatN) & 0x1))
+            continue;
+        regs[vfatN] = &getCalPulseRegs(la, config.ohN, vfatN);
+        if (!regs[vfatN]->valid) {
+            la->response->set_string("error", stdsprintf("Unable to resolve the calibration pulse registers of OH%i VFAT%i",config.ohN,vfatN));
+            state->invalidate(); //Words of the previous VFATs are marked known but not read
+            return false;
+        }
+
+        calPulseState::vfatWords & known = state->vfats[vfatN];
+        touched[vfatN] = config.exclusive ? std::bitset<128>().set() : (config.channels | known.pulsed | known.unmasked);
+
+        for (unsigned int chan = 0; chan < 128; ++chan) {
+            if (touched[vfatN].test(chan) && !known.known.test(chan)) {
+                addrs.push_back(regs[vfatN]->chanAddrs[chan]);
+                targets.push_back(&known.chan[chan]);
+                known.known.set(chan);
+            }
+        }
+        if (!known.cfgKnown) {
+            for (unsigned int i = 0; i < known.cfg.size(); ++i) {
+                addrs.push_back(regs[vfatN]->cfg[i].address);
+                targets.push_back(&known.cfg[i]);
+            }
+            known.cfgKnown = true;
+        }
+    }
+    if (!addrs.empty()) {
+        words.resize(addrs.size());
+        readAddressList(addrs.data(), words.data(), addrs.size(), la->response);
+        for (size_t idx = 0; idx < targets.size(); ++idx)
+            *targets[idx] = words[idx];
+    }
+    if (!hadError && la->response->get_key_exists("error")) {
+        state->invalidate();
+        return false;
+    }
+
+    //Compute the new words and keep only the ones that change
+    addrs.clear();
+    words.clear();
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        if (regs[vfatN] == nullptr)
+            continue;
+        calPulseRegs const& reg = *regs[vfatN];
+        calPulseState::vfatWords & known = state->vfats[vfatN];
+
+        for (unsigned int chan = 0; chan < 128; ++chan) {
+            if (!touched[vfatN].test(chan))
+                continue;
+            bool interest = config.channels.test(chan);
+            uint32_t word = setField(known.chan[chan], reg.enableBits, (interest && config.mode != CALPULSE_OFF) ? 0x1 : 0x0);
+            if (config.unmask)
+                word = setField(word, reg.maskBits, interest ? 0x0 : 0x1);
+            if (word != known.chan[chan]) {
+                addrs.push_back(reg.chanAddrs[chan]);
+                words.push_back(word);
+                known.chan[chan] = word;
+            }
+        }
+        known.pulsed = (config.mode != CALPULSE_OFF) ? config.channels : std::bitset<128>();
+        if (config.unmask)
+            known.unmasked = config.channels;
+
+        //CFG_CAL_* fields may share a register, every word holding a field is updated
+        std::array<uint32_t, 3> cfg = known.cfg;
+        auto setCfg = [&](unsigned int field, uint32_t value) {
+            for (unsigned int i = 0; i < cfg.size(); ++i) {
+                if (reg.cfg[i].address == reg.cfg[field].address)
+                    cfg[i] = setField(cfg[i], reg.cfg[field].mask, value);
+            }
+        };
+        setCfg(CAL_MODE, config.mode);
+        if (config.mode == CALPULSE_CURRENT) {
+            //Q = CAL DUR[s] * CAL DAC * 10nA * CAL FS[%] (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
+            setCfg(CAL_FS, config.calScaleFactor);
+            setCfg(CAL_DUR, 0x0);
+        }
+        for (unsigned int i = 0; i < cfg.size(); ++i) {
+            bool first = true;
+            for (unsigned int j = 0; j < i; ++j)
+                first &= (reg.cfg[j].address != reg.cfg[i].address);
+            if (first && cfg[i] != known.cfg[i]) {
+                addrs.push_back(reg.cfg[i].address);
+                words.push_back(cfg[i]);
+            }
+        }
+        known.cfg = cfg;
+    }
+
+    if (!addrs.empty())
+        writeAddressList(addrs.data(), words.data(), addrs.size(), la->response);
+
+    if (logLevelEnabled(LogManager::DEBUG))
+        LOGGER->log_message(LogManager::DEBUG, stdsprintf("Calibration pulse of OH%i: %u channels of interest, mode %i, %u register words written",
+                                                          config.ohN, unsigned(config.channels.count()), config.mode, unsigned(addrs.size())));
+    if (!hadError && la->response->get_key_exists("error")) {
+        state->invalidate();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+/*! \file calibration_routines/channel_groups.cpp
+ *  \brief Channel scans with the calibration pulse on several channels at once
+ */
+
+#include "calibration_routines/channel_groups.h"
+#include "calibration_routines/cal_pulse.h"
+#include "calibration_routines/result_file.h"
+#include "calibration_routines/scan_engine.h"
+#include "calibration_routines/scan_jobs.h"
+#include "calibration_routines.h"
+#include "amc.h"
+#include "hw_constants.h"
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+
+namespace {
+    channelGroups sequentialGroups(uint32_t)
+    {
+        channelGroups groups(128);
+        for (uint32_t ch = 0; ch < 128; ++ch)
+            groups[ch].push_back(ch);
+        return groups;
+    }
+
+    channelGroups interleavedGroups(uint32_t groupSize)
+    {
+        groupSize = std::max(1u, std::min(groupSize, 64u)); //Adjacent channels are never pulsed together
+        const uint32_t nGroups = (128 + groupSize - 1)/groupSize;
+        channelGroups groups(nGroups);
+        for (uint32_t ch = 0; ch < 128; ++ch)
+            groups[ch % nGroups].push_back(ch);
+        return groups;
+    }
+
+    std::map<std::string, channelGroupingPolicy> & groupingPolicies()
+    {
+        static std::map<std::string, channelGroupingPolicy> policies = {
+            {"sequential",  sequentialGroups},
+            {"interleaved", interleavedGroups},
+        };
+        return policies;
+    }
+}
+
+void registerChannelGrouping(const std::string & name, channelGroupingPolicy policy)
+{
+    groupingPolicies()[name] = policy;
+}
+
+bool getChannelGroups(localArgs *la, const std::string & name, uint32_t groupSize, channelGroups & groups)
+{
+    auto policy = groupingPolicies().find(name);
+    if (policy == groupingPolicies().end()) {
+        std::string errMsg = "Channel grouping " + name + " not found, possible values are:";
+        for (auto const& known : groupingPolicies())
+            errMsg += " " + known.first;
+        la->response->set_string("error", errMsg);
+        return false;
+    }
+
+    groups = policy->second(groupSize);
+    std::bitset<128> seen;
+    bool valid = true;
+    for (auto const& group : groups) {
+        valid &= !group.empty();
+        for (auto ch : group) {
+            valid &= (ch < 128) && !seen.test(ch % 128);
+            seen.set(ch % 128);
+        }
+    }
+    if (!valid || !seen.all()) {
+        la->response->set_string("error", stdsprintf("Channel grouping %s does not hold every channel exactly once", name.c_str()));
+        return false;
+    }
+    return true;
+}
+
+void genChannelScanGroupedLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, const channelGroups & groups, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+{
+    if (fw_version_check("genChannelScanGroupedLocal", la) != 3) {
+        la->response->set_string("error", "The grouped channel scan is only supported in V3 electronics");
+        return;
+    }
+
+    //Determine the inverse of the vfatmask
+    uint32_t notmask = ~mask & 0xFFFFFF;
+
+    if (!checkGenScanLocal(la, ohN, mask, currentPulse, calScaleFactor))
+        return;
+
+    const genScanPlan & plan = getGenScanPlan(la, ohN, scanReg);
+    if (!plan.valid) {
+        la->response->set_string("error", stdsprintf("Unable to resolve the registers of the scan over CFG_%s for ohN %i", scanReg.c_str(), ohN));
+        return;
+    }
+
+    //TTC Config
+    confScanTriggersLocal(la, nevts, useExtTrig);
+
+    //Configure VFAT_DAQ_MONITOR for a single channel, the channel is then rotated with the plan
+    dacMonConfLocal(la, ohN, groups.front().front());
+
+    //Pulse the first group before reading the scan register words, CFG_CAL_MODE may share a register with the scan register
+    calPulseState calState;
+    calPulseConfig calConfig = makeCalPulseConfig(ohN, mask, true, currentPulse, calScaleFactor);
+    auto pulseGroup = [&](const std::vector<uint32_t> & group) {
+        calConfig.channels.reset();
+        for (auto ch : group)
+            calConfig.channels.set(ch);
+        if (applyCalPulseConfigLocal(la, calConfig, &calState))
+            return true;
+        la->response->set_string("error", stdsprintf("Unable to configure calpulse ON for ohN %i mask %x group of chan %i", ohN, mask, group.front()));
+        return false;
+    };
+    if (useCalPulse && !pulseGroup(groups.front()))
+        return;
+
+    uint32_t regWords[oh::VFATS_PER_OH];
+    readScanRegWords(la, plan, mask, regWords);
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Scanning CFG_%s on OH%i in %u channel groups", scanReg.c_str(), ohN, unsigned(groups.size())));
+
+    const uint32_t nPoints = scanPoints(dacMin, dacMax, dacStep);
+    uint32_t goodEvents[oh::VFATS_PER_OH];
+    for (auto const& group : groups) {
+        if (scanJobCancelled() || la->response->get_key_exists("error"))
+            break;
+
+        //Moving the pulse to the next group only rewrites the channel registers that change
+        if (useCalPulse && !pulseGroup(group))
+            return;
+
+        for (uint32_t dacVal = dacMin; dacVal <= dacMax && !scanJobCancelled(); dacVal += dacStep) {
+            writeScanRegLocal(la, plan, mask, regWords, dacVal);
+            for (auto ch : group) {
+                writeRegHandle(plan.daqMonChanSelect, ch, la->response);
+                genScanBurstLocal(la, plan, nevts, useExtTrig, goodEvents);
+
+                for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+                    if ((notmask >> vfatN) & 0x1)
+                        outData[scanDataIndex(nPoints, ch, vfatN, (dacVal-dacMin)/dacStep)] = goodEvents[vfatN];
+                }
+                scanJobStep(dacVal);
+            }
+        }
+    }
+
+    //Also turned off after an error, the error of the scan is kept in the response
+    if (useCalPulse) {
+        calConfig.mode = CALPULSE_OFF;
+        applyCalPulseConfigLocal(la, calConfig, &calState);
+    }
+}
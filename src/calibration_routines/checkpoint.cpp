@@ -0,0 +1,199 @@
+/*! \file calibration_routines/checkpoint.cpp
+ *  \brief Checkpoint and resume of the scans streamed to a scan result file
+ */
+
+#include "calibration_routines/checkpoint.h"
+#include "calibration_routines/cal_pulse.h"
+#include "calibration_routines/scan_jobs.h"
+#include "calibration_routines.h"
+#include "hw_constants.h"
+
+#include <cstring>
+
+namespace {
+    const char* const GLOBAL_SNAPSHOT_REGS[] = {
+        "GEM_AMC.TTC.CTRL.L1A_ENABLE",
+        "GEM_AMC.TTC.GENERATOR.ENABLE",
+        "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT",
+        "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_GAP",
+        "GEM_AMC.TTC.GENERATOR.CYCLIC_CALPULSE_TO_L1A_GAP",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.OH_SELECT",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_SELECT",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_GLOBAL_OR",
+        "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE",
+    };
+
+    std::string headerString(const char *field, size_t size)
+    {
+        return std::string(field, strnlen(field, size));
+    }
+
+    /*!
+     * \brief Number of records written per scan step
+     */
+    uint32_t recordsPerStep(const scanResultHeader & hdr)
+    {
+        const std::string scanType = headerString(hdr.scanType, sizeof(hdr.scanType));
+        if (scanType == "genScanMultiLink" || scanType == "sbitRateScan")
+            return __builtin_popcount(hdr.ohMask & 0xfff);
+        return 1;
+    }
+
+    uint32_t totalSteps(const scanResultHeader & hdr)
+    {
+        const std::string scanType = headerString(hdr.scanType, sizeof(hdr.scanType));
+        uint32_t nPoints = scanPoints(hdr.dacMin, hdr.dacMax, hdr.dacStep);
+        return (scanType == "genChannelScan") ? 128*nPoints : nPoints;
+    }
+}
+
+std::vector<uint32_t> snapshotScanStateLocal(localArgs *la, const scanResultHeader & hdr)
+{
+    const std::string scanType = headerString(hdr.scanType, sizeof(hdr.scanType));
+    const std::string scanReg  = headerString(hdr.scanReg, sizeof(hdr.scanReg));
+    std::vector<uint32_t> state;
+
+    auto snapshot = [&](const std::string & regName) {
+        RegHandle reg = getRegHandle(la, regName);
+        if (reg.address == 0xdeaddead)
+            return;
+        state.push_back(reg.address);
+        state.push_back(reg.mask);
+        state.push_back(readRegHandle(reg, la->response));
+    };
+
+    for (auto regName : GLOBAL_SNAPSHOT_REGS)
+        snapshot(regName);
+
+    const bool allChannels = (scanType == "genChannelScan") || (scanType == "sbitRateScan" && hdr.ch < 128);
+    for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        if (!((hdr.ohMask >> ohN) & 0x1))
+            continue;
+        snapshot(stdsprintf("GEM_AMC.OH.OH%i.FPGA.TRIG.CTRL.VFAT_MASK",ohN));
+        snapshot(stdsprintf("GEM_AMC.OH.OH%i.FPGA.TRIG.CNT.SBIT_CNT_PERSIST",ohN));
+
+        for (uint32_t vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            if ((hdr.vfatMask[ohN] >> vfatN) & 0x1)
+                continue;
+            snapshot(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str()));
+            if (allChannels) {
+                for (uint32_t chan = 0; chan < 128; ++chan)
+                    snapshot(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan));
+            } else if (hdr.ch < 128) {
+                snapshot(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,hdr.ch));
+            }
+        }
+    }
+    return state;
+}
+
+void restoreScanStateLocal(localArgs *la, const ScanResultFile & file)
+{
+    const uint32_t nRestore = file.header().nRestore;
+    const uint32_t *state   = file.restoreState();
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Restoring %u registers from the snapshot in %s", nRestore, file.path().c_str()));
+
+    for (uint32_t i = nRestore; i > 0; --i) {
+        RegHandle reg;
+        reg.address = state[3*(i-1)];
+        reg.mask    = state[3*(i-1)+1];
+        writeRegHandle(reg, state[3*(i-1)+2], la->response);
+    }
+}
+
+uint32_t scanStepsRemainingLocal(localArgs *la, const std::string & path)
+{
+    std::unique_ptr<ScanResultFile> file = reopenScanResultFile(la, path);
+    if (!file)
+        return 0;
+    const scanResultHeader & hdr = file->header();
+    const uint32_t done = hdr.nRecords/recordsPerStep(hdr);
+    return totalSteps(hdr) > done ? totalSteps(hdr) - done : 0;
+}
+
+void resumeScanLocal(localArgs *la, const std::string & path, bool restoreOnly)
+{
+    std::unique_ptr<ScanResultFile> file = reopenScanResultFile(la, path);
+    if (!file)
+        return;
+
+    const scanResultHeader hdr = file->header();
+    const std::string scanType = headerString(hdr.scanType, sizeof(hdr.scanType));
+    const std::string scanReg  = headerString(hdr.scanReg, sizeof(hdr.scanReg));
+    if (hdr.complete) {
+        la->response->set_string("error", stdsprintf("The scan in %s is already complete", path.c_str()));
+        return;
+    }
+
+    // The interrupted scan did not run its cleanup, the registers must be put back before it reads them again
+    restoreScanStateLocal(la, *file);
+    if (restoreOnly)
+        return;
+
+    const uint32_t perStep   = recordsPerStep(hdr);
+    const uint32_t stepsDone = hdr.nRecords/perStep;
+    const uint32_t nPoints   = scanPoints(hdr.dacMin, hdr.dacMax, hdr.dacStep);
+    file->truncate(stepsDone*perStep);
+
+    const bool useCalPulse  = hdr.flags & 0x1;
+    const bool currentPulse = hdr.flags & 0x2;
+    const bool useExtTrig   = hdr.flags & 0x4;
+    const uint32_t ohN      = __builtin_ctz(hdr.ohMask | 0x1000);
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Resuming %s over CFG_%s from step %u of %u", scanType.c_str(), scanReg.c_str(), stepsDone, totalSteps(hdr)));
+
+    ScanResultSink sink(la, std::move(file));
+    if (scanType == "genScan") {
+        if (stepsDone < nPoints) {
+            uint32_t dacMin = hdr.dacMin + stepsDone*hdr.dacStep;
+            std::vector<uint32_t> outData(oh::VFATS_PER_OH*scanPoints(dacMin, hdr.dacMax, hdr.dacStep));
+            genScanLocal(la, outData.data(), ohN, hdr.vfatMask[ohN], hdr.ch, useCalPulse, currentPulse, hdr.calScaleFactor, hdr.nevts, dacMin, hdr.dacMax, hdr.dacStep, scanReg, false, useExtTrig);
+        }
+    } else if (scanType == "genChannelScan") {
+        std::vector<uint32_t> outData(oh::VFATS_PER_OH*nPoints);
+        calPulseState calState;
+        for (uint32_t ch = stepsDone/nPoints; ch < 128 && !scanJobCancelled() && !la->response->get_key_exists("error"); ++ch) {
+            uint32_t dacMin = hdr.dacMin + ((ch == stepsDone/nPoints) ? (stepsDone%nPoints)*hdr.dacStep : 0);
+            genScanLocal(la, outData.data(), ohN, hdr.vfatMask[ohN], ch, useCalPulse, currentPulse, hdr.calScaleFactor, hdr.nevts, dacMin, hdr.dacMax, hdr.dacStep, scanReg, false, useExtTrig, &calState);
+        }
+    } else if (scanType == "genScanMultiLink") {
+        if (stepsDone < nPoints) {
+            uint32_t dacMin = hdr.dacMin + stepsDone*hdr.dacStep;
+            std::vector<uint32_t> outData(scanDataIndex(scanPoints(dacMin, hdr.dacMax, hdr.dacStep), amc::OH_PER_AMC, 0, 0));
+            genScanMultiLinkLocal(la, outData.data(), hdr.ohMask, hdr.ch, useCalPulse, currentPulse, hdr.calScaleFactor, hdr.nevts, dacMin, hdr.dacMax, hdr.dacStep, scanReg, useExtTrig);
+        }
+    } else if (scanType == "sbitRateScan") {
+        if (stepsDone < nPoints) {
+            uint32_t dacMin  = hdr.dacMin + stepsDone*hdr.dacStep;
+            uint32_t nLeft   = scanPoints(dacMin, hdr.dacMax, hdr.dacStep);
+            std::vector<uint32_t> outDataTrigRatePerVFAT(amc::OH_PER_AMC*oh::VFATS_PER_OH*nLeft);
+            std::vector<uint32_t> outDataDacValPerOH(amc::OH_PER_AMC*nLeft);
+            std::vector<uint32_t> outDataTrigRatePerOH(amc::OH_PER_AMC*nLeft);
+            sbitRateWindow window;
+            window.minTimeMs       = hdr.rateMinTimeMs;
+            window.maxTimeMs       = hdr.rateMaxTimeMs;
+            window.targetPrecision = hdr.rateTargetPrecision;
+            window.quietPoints     = hdr.rateQuietPoints;
+            sbitRateScanParallelLocal(la, outDataDacValPerOH.data(), outDataTrigRatePerVFAT.data(), outDataTrigRatePerOH.data(), hdr.ch, dacMin, hdr.dacMax, hdr.dacStep, scanReg, hdr.ohMask,
+                                      (hdr.flags & 0x8) ? &window : nullptr);
+        }
+    } else {
+        la->response->set_string("error", stdsprintf("Resuming %s scans is not supported", scanType.c_str()));
+    }
+}
+
+void resumeScan(const RPCMsg *request, RPCMsg *response)
+{
+    GETLOCALARGS(response);
+
+    const std::string path = request->get_string("resultFile");
+    bool restoreOnly = request->get_key_exists("restoreOnly") && request->get_word("restoreOnly");
+    resumeScanLocal(&la, path, restoreOnly);
+
+    std::unique_ptr<ScanResultFile> file = reopenScanResultFile(&la, path);
+    if (file)
+        response->set_word("nRecords", file->header().nRecords);
+
+    rtxn.abort();
+}
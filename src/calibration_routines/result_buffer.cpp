@@ -0,0 +1,74 @@
+/*! \file calibration_routines/result_buffer.cpp
+ *  \brief Bounded, pooled storage for the results of the calibration scans
+ */
+
+#include "calibration_routines/result_buffer.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace {
+    struct ResultArray {
+        std::vector<uint32_t> words;
+        size_t size = 0; ///< words of the last result, the vector may be larger
+    };
+
+    std::map<std::string, ResultArray> resultPool;
+}
+
+bool checkScanRange(localArgs *la, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep)
+{
+    if (dacStep == 0 || dacMax < dacMin) {
+        la->response->set_string("error", stdsprintf("Invalid scan range: dacMin %u, dacMax %u, dacStep %u", dacMin, dacMax, dacStep));
+        return false;
+    }
+    return true;
+}
+
+uint32_t * scanResultBuffer(localArgs *la, const std::string & key, size_t nWords)
+{
+    if (nWords > SCAN_MAX_BUFFER_WORDS) {
+        la->response->set_string("error", stdsprintf("Result %s of %zu words exceeds the limit of %zu words, use a result file instead", key.c_str(), nWords, SCAN_MAX_BUFFER_WORDS));
+        return nullptr;
+    }
+
+    ResultArray & result = resultPool[key];
+    if (result.words.capacity() > 4*nWords)
+        std::vector<uint32_t>().swap(result.words); //Do not keep a large buffer around for small scans
+    result.words.assign(std::max(nWords, size_t(1)), 0);
+    result.size = nWords;
+    return result.words.data();
+}
+
+void setScanResultArray(localArgs *la, const std::string & key, size_t nWords)
+{
+    ResultArray & result = resultPool[key];
+    nWords = std::min(nWords, result.words.size());
+    if (nWords > SCAN_MAX_RESPONSE_WORDS)
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Result %s of %zu words is returned in chunks of %zu words", key.c_str(), nWords, SCAN_MAX_RESPONSE_WORDS));
+
+    result.size = nWords;
+    la->response->set_word_array(key, result.words.data(), std::min(nWords, SCAN_MAX_RESPONSE_WORDS));
+    la->response->set_word(key+"Size", nWords);
+}
+
+void fetchScanResultBuffer(const RPCMsg *request, RPCMsg *response)
+{
+    const std::string key = request->get_string("key");
+    auto result = resultPool.find(key);
+    if (result == resultPool.end()) {
+        response->set_string("error", stdsprintf("No result %s in this client", key.c_str()));
+        return;
+    }
+
+    size_t size   = result->second.size;
+    size_t offset = request->get_key_exists("offset") ? request->get_word("offset") : 0;
+    size_t count  = request->get_key_exists("count") ? request->get_word("count") : SCAN_MAX_RESPONSE_WORDS;
+    offset = std::min(offset, size);
+    count  = std::min(std::min(count, SCAN_MAX_RESPONSE_WORDS), size-offset);
+
+    response->set_word_array("data", result->second.words.data()+offset, count);
+    response->set_word("offset", offset);
+    response->set_word("size", size);
+}
@@ -0,0 +1,330 @@
+/*! \file calibration_routines/result_file.cpp
+ *  \brief Memory mapped, append-only files receiving the points of a scan while it runs
+ */
+
+#include "calibration_routines/result_file.h"
+#include "amc.h"
+#include "calibration_routines.h"
+#include "calibration_routines/checkpoint.h"
+#include "calibration_routines/scan_jobs.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    constexpr uint32_t SCAN_RESULT_MAX_CHUNK = 16384; ///< words per readScanResultFile call
+
+    ScanResultFile *activeFile = nullptr;
+
+    size_t recordsEnd(const scanResultHeader & hdr)
+    {
+        return hdr.headerSize + size_t(hdr.maxRecords)*hdr.recordWords*sizeof(uint32_t);
+    }
+
+    size_t fileSize(const scanResultHeader & hdr)
+    {
+        return hdr.restoreOffset + size_t(hdr.nRestore)*3*sizeof(uint32_t);
+    }
+
+    bool validHeader(const scanResultHeader & hdr, size_t size)
+    {
+        return hdr.magic == SCAN_RESULT_MAGIC && hdr.version == SCAN_RESULT_VERSION && hdr.recordWords
+            && hdr.headerSize == SCAN_RESULT_HEADER_SIZE && hdr.restoreOffset >= recordsEnd(hdr) && size >= fileSize(hdr);
+    }
+}
+
+ScanResultFile::ScanResultFile(void *mapping, size_t size, const std::string & path) :
+    m_header(static_cast<scanResultHeader*>(mapping)),
+    m_records(reinterpret_cast<uint32_t*>(static_cast<char*>(mapping) + SCAN_RESULT_HEADER_SIZE)),
+    m_size(size),
+    m_path(path)
+{
+}
+
+ScanResultFile::~ScanResultFile()
+{
+    msync(m_header, m_size, MS_SYNC);
+    munmap(m_header, m_size);
+}
+
+void ScanResultFile::append(uint32_t ohN, uint32_t ch, uint32_t dacVal, const uint32_t *payload)
+{
+    const uint32_t n = m_header->nRecords;
+    if (n >= m_header->maxRecords) {
+        LOGGER->log_message(LogManager::WARNING, stdsprintf("Scan result file %s is full, dropping the point OH%i ch %i value %i", m_path.c_str(), ohN, ch, dacVal));
+        return;
+    }
+
+    uint32_t *record = m_records + size_t(n)*m_header->recordWords;
+    record[0] = ((ohN & 0xff) << 8) | (ch & 0xff);
+    record[1] = dacVal;
+    std::copy(payload, payload+m_header->payloadWords, record+SCAN_RESULT_RECORD_HEADER_WORDS);
+
+    // The record must be in place before a reader can see it counted
+    __sync_synchronize();
+    m_header->nRecords    = n+1;
+    m_header->updatedTime = time(NULL);
+    msync(m_header, m_size, MS_ASYNC);
+}
+
+void ScanResultFile::truncate(uint32_t nRecords)
+{
+    if (nRecords < m_header->nRecords) {
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Dropping %u records of the incomplete step from %s", m_header->nRecords-nRecords, m_path.c_str()));
+        m_header->nRecords = nRecords;
+        msync(m_header, m_size, MS_ASYNC);
+    }
+}
+
+const uint32_t * ScanResultFile::restoreState() const
+{
+    return reinterpret_cast<const uint32_t*>(reinterpret_cast<const char*>(m_header) + m_header->restoreOffset);
+}
+
+void ScanResultFile::finish()
+{
+    __sync_synchronize();
+    m_header->complete    = 1;
+    m_header->updatedTime = time(NULL);
+}
+
+void initScanResultHeader(localArgs *la, scanResultHeader & hdr, const std::string & scanType, const std::string & scanReg, uint32_t payloadWords, uint32_t maxRecords)
+{
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.magic        = SCAN_RESULT_MAGIC;
+    hdr.version      = SCAN_RESULT_VERSION;
+    hdr.headerSize   = SCAN_RESULT_HEADER_SIZE;
+    hdr.payloadWords = payloadWords;
+    hdr.recordWords  = SCAN_RESULT_RECORD_HEADER_WORDS + payloadWords;
+    hdr.maxRecords   = maxRecords;
+    const firmwareIdentity fw = getFirmwareIdentity(la);
+    hdr.fwMajor      = fw.releaseMajor;
+    hdr.fwMinor      = fw.releaseMinor;
+    hdr.fwBuild      = fw.releaseBuild;
+    hdr.createdTime  = time(NULL);
+    hdr.updatedTime  = hdr.createdTime;
+    strncpy(hdr.scanType, scanType.c_str(), sizeof(hdr.scanType)-1);
+    strncpy(hdr.scanReg, scanReg.c_str(), sizeof(hdr.scanReg)-1);
+}
+
+std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const scanResultHeader & proto, const std::vector<uint32_t> & restoreState)
+{
+    static_assert(sizeof(scanResultHeader) <= SCAN_RESULT_HEADER_SIZE, "scanResultHeader does not fit in the header block");
+
+    if (!allowedDataPath(path)) {
+        la->response->set_string("error", stdsprintf("Scan result file %s not allowed, it must be below /mnt/persistent/, /dev/shm/ or /tmp/", path.c_str()));
+        return nullptr;
+    }
+
+    scanResultHeader hdr = proto;
+    hdr.nRestore      = restoreState.size()/3;
+    hdr.restoreOffset = recordsEnd(hdr);
+
+    const size_t size = fileSize(hdr);
+    int fd = openDataFile(path, O_RDWR|O_CREAT|O_TRUNC);
+    if (fd < 0) {
+        la->response->set_string("error", stdsprintf("Unable to create the scan result file %s: %s", path.c_str(), strerror(errno)));
+        return nullptr;
+    }
+    if (ftruncate(fd, size) != 0) {
+        la->response->set_string("error", stdsprintf("Unable to resize the scan result file %s: %s", path.c_str(), strerror(errno)));
+        close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        la->response->set_string("error", stdsprintf("Unable to map the scan result file %s: %s", path.c_str(), strerror(errno)));
+        return nullptr;
+    }
+
+    std::memcpy(static_cast<char*>(addr) + hdr.restoreOffset, restoreState.data(), hdr.nRestore*3*sizeof(uint32_t));
+    std::memcpy(addr, &hdr, sizeof(hdr));
+    msync(addr, size, MS_SYNC); //The snapshot must survive whatever happens during the scan
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Streaming %s results to %s (%u records of %u words, %u registers in the snapshot)",
+                                                     hdr.scanType, path.c_str(), hdr.maxRecords, hdr.recordWords, hdr.nRestore));
+    return std::unique_ptr<ScanResultFile>(new ScanResultFile(addr, size, path));
+}
+
+std::unique_ptr<ScanResultFile> reopenScanResultFile(localArgs *la, const std::string & path)
+{
+    if (!allowedDataPath(path)) {
+        la->response->set_string("error", stdsprintf("Scan result file %s not allowed, it must be below /mnt/persistent/, /dev/shm/ or /tmp/", path.c_str()));
+        return nullptr;
+    }
+
+    int fd = openDataFile(path, O_RDWR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        la->response->set_string("error", stdsprintf("Unable to open the scan result file %s: %s", path.c_str(), strerror(errno)));
+        if (fd >= 0)
+            close(fd);
+        return nullptr;
+    }
+    scanResultHeader hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != ssize_t(sizeof(hdr)) || !validHeader(hdr, st.st_size)) {
+        la->response->set_string("error", stdsprintf("%s is not a scan result file of version %u", path.c_str(), SCAN_RESULT_VERSION));
+        close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        la->response->set_string("error", stdsprintf("Unable to map the scan result file %s: %s", path.c_str(), strerror(errno)));
+        return nullptr;
+    }
+    return std::unique_ptr<ScanResultFile>(new ScanResultFile(addr, st.st_size, path));
+}
+
+std::unique_ptr<ScanResultFile> openScanResultFile(localArgs *la, const std::string & path, const std::string & scanType, const std::string & scanReg, uint32_t ohMask, uint32_t vfatMask, uint32_t ch, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, uint32_t flags, uint32_t calScaleFactor, const sbitRateWindow *window)
+{
+    const uint32_t nDacVals = scanPoints(dacMin, dacMax, dacStep);
+    const uint32_t nOH      = __builtin_popcount(ohMask & 0xfff);
+
+    uint32_t payloadWords = oh::VFATS_PER_OH, maxRecords = 0;
+    if (scanType == "genScan")
+        maxRecords = nDacVals;
+    else if (scanType == "genChannelScan")
+        maxRecords = 128*nDacVals;
+    else if (scanType == "genScanMultiLink")
+        maxRecords = nOH*nDacVals;
+    else if (scanType == "sbitRateScan") {
+        payloadWords = oh::VFATS_PER_OH+1; //Per VFAT rates and the overall rate
+        maxRecords   = nOH*nDacVals;
+    }
+    if (!maxRecords) {
+        la->response->set_string("error", stdsprintf("Streaming of the results is not supported for %s", scanType.c_str()));
+        return nullptr;
+    }
+
+    scanResultHeader hdr;
+    initScanResultHeader(la, hdr, scanType, scanReg, payloadWords, maxRecords);
+    hdr.ohMask         = ohMask;
+    hdr.ch             = ch;
+    hdr.nevts          = nevts;
+    hdr.dacMin         = dacMin;
+    hdr.dacMax         = dacMax;
+    hdr.dacStep        = dacStep;
+    hdr.flags          = flags;
+    hdr.calScaleFactor = calScaleFactor;
+    if (window) {
+        hdr.flags              |= 0x8;
+        hdr.rateMinTimeMs       = window->minTimeMs;
+        hdr.rateMaxTimeMs       = window->maxTimeMs;
+        hdr.rateTargetPrecision = window->targetPrecision;
+        hdr.rateQuietPoints     = window->quietPoints;
+    }
+    //Only genScan and genChannelScan take a VFAT mask, the multi-link scans read the mask of every optohybrid
+    const bool singleOHScan = (scanType == "genScan" || scanType == "genChannelScan");
+    for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        if (!((ohMask >> ohN) & 0x1))
+            hdr.vfatMask[ohN] = 0xffffff;
+        else if (singleOHScan)
+            hdr.vfatMask[ohN] = vfatMask;
+        else
+            hdr.vfatMask[ohN] = getOHVFATMaskLocal(la, ohN);
+    }
+    return openScanResultFile(la, path, hdr, snapshotScanStateLocal(la, hdr));
+}
+
+void scanResultAppend(uint32_t ohN, uint32_t ch, uint32_t dacVal, const uint32_t *payload)
+{
+    if (activeFile)
+        activeFile->append(ohN, ch, dacVal, payload);
+}
+
+ScanResultSink::ScanResultSink(localArgs *la, std::unique_ptr<ScanResultFile> file) :
+    m_la(la),
+    m_file(std::move(file))
+{
+    if (m_file)
+        activeFile = m_file.get();
+}
+
+ScanResultSink::~ScanResultSink()
+{
+    if (!m_file)
+        return;
+    if (!m_la->response->get_key_exists("error") && !scanJobCancelled())
+        m_file->finish();
+    activeFile = nullptr;
+}
+
+void readScanResultFile(const RPCMsg *request, RPCMsg *response)
+{
+    const std::string path = request->get_string("path");
+    if (!allowedDataPath(path)) {
+        response->set_string("error", stdsprintf("Scan result file %s not allowed", path.c_str()));
+        return;
+    }
+
+    int fd = openDataFile(path, O_RDONLY);
+    if (fd < 0) {
+        response->set_string("error", stdsprintf("Unable to open the scan result file %s: %s", path.c_str(), strerror(errno)));
+        return;
+    }
+
+    scanResultHeader hdr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || pread(fd, &hdr, sizeof(hdr), 0) != ssize_t(sizeof(hdr)) || !validHeader(hdr, st.st_size)) {
+        response->set_string("error", stdsprintf("%s is not a scan result file of version %u", path.c_str(), SCAN_RESULT_VERSION));
+        close(fd);
+        return;
+    }
+
+    uint32_t first = request->get_key_exists("first") ? request->get_word("first") : 0;
+    uint32_t count = SCAN_RESULT_MAX_CHUNK/hdr.recordWords;
+    if (request->get_key_exists("count"))
+        count = std::min(count, request->get_word("count"));
+    first = std::min(first, hdr.nRecords);
+    count = std::min(count, hdr.nRecords-first);
+
+    std::vector<uint32_t> data(size_t(count)*hdr.recordWords);
+    ssize_t nBytes = data.size()*sizeof(uint32_t);
+    if (nBytes && pread(fd, data.data(), nBytes, hdr.headerSize + off_t(first)*hdr.recordWords*sizeof(uint32_t)) != nBytes) {
+        response->set_string("error", stdsprintf("Unable to read the scan result file %s: %s", path.c_str(), strerror(errno)));
+        close(fd);
+        return;
+    }
+    close(fd);
+
+    response->set_word("version", hdr.version);
+    response->set_word("recordWords", hdr.recordWords);
+    response->set_word("payloadWords", hdr.payloadWords);
+    response->set_word("maxRecords", hdr.maxRecords);
+    response->set_word("nRecords", hdr.nRecords);
+    response->set_word("complete", hdr.complete);
+    response->set_word("fwMajor", hdr.fwMajor);
+    response->set_word("fwMinor", hdr.fwMinor);
+    response->set_word("fwBuild", hdr.fwBuild);
+    response->set_word("createdTime", hdr.createdTime);
+    response->set_word("updatedTime", hdr.updatedTime);
+    response->set_word("ohMask", hdr.ohMask);
+    response->set_word_array("vfatMask", hdr.vfatMask, amc::OH_PER_AMC);
+    response->set_word("ch", hdr.ch);
+    response->set_word("nevts", hdr.nevts);
+    response->set_word("dacMin", hdr.dacMin);
+    response->set_word("dacMax", hdr.dacMax);
+    response->set_word("dacStep", hdr.dacStep);
+    response->set_word("flags", hdr.flags);
+    response->set_word("calScaleFactor", hdr.calScaleFactor);
+    if (hdr.flags & 0x8) {
+        response->set_word("rateMinTimeMs", hdr.rateMinTimeMs);
+        response->set_word("rateMaxTimeMs", hdr.rateMaxTimeMs);
+        response->set_word("rateTargetPrecision", hdr.rateTargetPrecision);
+        response->set_word("rateQuietPoints", hdr.rateQuietPoints);
+    }
+    response->set_word("nRestore", hdr.nRestore);
+    response->set_string("scanType", std::string(hdr.scanType, strnlen(hdr.scanType, sizeof(hdr.scanType))));
+    response->set_string("scanReg", std::string(hdr.scanReg, strnlen(hdr.scanReg, sizeof(hdr.scanReg))));
+    response->set_word("first", first);
+    response->set_word("count", count);
+    response->set_word_array("data", data);
+}
@@ -0,0 +1,56 @@
+/*! \file calibration_routines/sbit_mapping.cpp
+ *  \brief On-board analysis of the sbit mapping check
+ */
+
+#include "calibration_routines/sbit_mapping.h"
+#include "hw_constants.h"
+
+uint32_t analyzeSbitMapping(const uint32_t *data, uint32_t nevts, uint32_t vfatN, sbitMappingSummary & summary, uint32_t *mismatches)
+{
+    summary.correct.assign(128, 0);
+    summary.wrongStrip.assign(128, 0);
+    summary.missed.assign(128, 0);
+    summary.clusterSizes.assign(128*SBIT_MAPPING_CLUSTER_SIZES, 0);
+
+    uint32_t nMismatchWords = 0;
+    for (uint32_t chan = 0; chan < 128; ++chan) {
+        const uint32_t expectedSbit = sbit::channelToSbit(chan);
+        for (uint32_t iPulse = 0; iPulse < nevts; ++iPulse) {
+            const uint32_t *pulse = data + (size_t(chan)*nevts + iPulse)*SBIT_MAPPING_CLUSTERS;
+
+            //See checkSbitMappingWithCalPulseLocal for the word format
+            bool anyValid = false, covered = false;
+            for (uint32_t cluster = 0; cluster < SBIT_MAPPING_CLUSTERS; ++cluster) {
+                uint32_t word = pulse[cluster];
+                if (!((word >> 26) & 0x1))
+                    continue;
+                uint32_t clusterSize  = (word >> 27) & 0x7;
+                uint32_t vfatObserved = (word >> 21) & 0x1f;
+                uint32_t sbitObserved = (word >> 8) & 0xff;
+                anyValid = true;
+                covered |= (vfatObserved == vfatN) && (sbitObserved <= expectedSbit) && (expectedSbit <= sbitObserved + clusterSize);
+                ++summary.clusterSizes[chan*SBIT_MAPPING_CLUSTER_SIZES + clusterSize];
+            }
+
+            if (covered) {
+                ++summary.correct[chan];
+            } else if (anyValid) {
+                ++summary.wrongStrip[chan];
+                //The output never overtakes the input, so the compaction can be done in place
+                for (uint32_t cluster = 0; cluster < SBIT_MAPPING_CLUSTERS; ++cluster)
+                    mismatches[nMismatchWords++] = pulse[cluster];
+            } else {
+                ++summary.missed[chan];
+            }
+        }
+    }
+    return nMismatchWords;
+}
+
+void setSbitMappingSummary(RPCMsg *response, const sbitMappingSummary & summary)
+{
+    response->set_word_array("correct", summary.correct);
+    response->set_word_array("wrongStrip", summary.wrongStrip);
+    response->set_word_array("missed", summary.missed);
+    response->set_word_array("clusterSizes", summary.clusterSizes);
+}
@@ -0,0 +1,147 @@
+/*! \file calibration_routines/scan_engine.cpp
+ *  \brief Register plan and step execution of the generic DAC scan for v3 electronics
+ */
+
+#include "calibration_routines/scan_engine.h"
+#include "vfat3.h"
+
+#include <chrono>
+#include <map>
+#include <thread>
+
+namespace {
+    std::map<std::string, ATGenerationCache<genScanPlan> > genScanPlans; ///< key is "OH<ohN>.<scanReg>"
+
+    genScanPlan buildGenScanPlan(localArgs *la, uint32_t ohN, const std::string & scanReg)
+    {
+        genScanPlan plan;
+        bool found = true;
+        auto resolve = [&](const std::string & regName) {
+            RegHandle reg = getRegHandle(la, regName);
+            found &= (reg.address != 0xdeaddead);
+            return reg;
+        };
+
+        for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            plan.scanReg[vfatN]          = resolve(stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str()));
+            plan.goodEventsCount[vfatN]  = resolve(stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT",vfatN)).address;
+            plan.channelFireCount[vfatN] = resolve(stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.CHANNEL_FIRE_COUNT",vfatN)).address;
+        }
+
+        plan.daqMonReset      = resolve("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.RESET");
+        plan.daqMonEnable     = resolve("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE");
+        plan.daqMonOHSelect   = resolve("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.OH_SELECT");
+        plan.daqMonChanSelect = resolve("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_SELECT");
+        plan.ttcCyclicStart   = resolve("GEM_AMC.TTC.GENERATOR.CYCLIC_START");
+        plan.ttcGenEnable     = resolve("GEM_AMC.TTC.GENERATOR.ENABLE");
+        plan.ttcCyclicRunning = resolve("GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING");
+        plan.ttcL1AEnable     = resolve("GEM_AMC.TTC.CTRL.L1A_ENABLE");
+        plan.ttcCntReset      = resolve("GEM_AMC.TTC.CTRL.CNT_RESET");
+        plan.l1aCount         = resolve("GEM_AMC.TTC.CMD_COUNTERS.L1A").address;
+
+        plan.valid = found;
+        return plan;
+    }
+}
+
+const genScanPlan & getGenScanPlan(localArgs *la, uint32_t ohN, const std::string & scanReg)
+{
+    return genScanPlans[stdsprintf("OH%i.%s",ohN,scanReg.c_str())].get(la, [&](localArgs *la) {
+            LOGGER->log_message(LogManager::DEBUG, stdsprintf("Building the scan plan for OH%i CFG_%s",ohN,scanReg.c_str()));
+            return buildGenScanPlan(la, ohN, scanReg);
+        });
+}
+
+bool checkGenScanLocal(localArgs *la, uint32_t ohN, uint32_t mask, bool currentPulse, uint32_t calScaleFactor)
+{
+    uint32_t notmask = ~mask & 0xFFFFFF;
+    uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
+    if ((notmask & goodVFATs) != notmask) {
+        la->response->set_string("error", stdsprintf("One of the unmasked VFATs is not Synced. goodVFATs: %x\tnotmask: %x",goodVFATs,notmask));
+        return false;
+    }
+
+    if (currentPulse && calScaleFactor > 3) {
+        la->response->set_string("error", stdsprintf("Bad value for CFG_CAL_FS: %x, Possible values are {0b00, 0b01, 0b10, 0b11}. Exiting.",calScaleFactor));
+        return false;
+    }
+    return true;
+}
+
+void confScanTriggersLocal(localArgs *la, uint32_t nevts, bool useExtTrig)
+{
+    if (useExtTrig) {
+        writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x0);
+        writeReg(la, "GEM_AMC.TTC.CTRL.CNT_RESET", 0x1);
+    } else {
+        writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT", nevts);
+        writeReg(la, "GEM_AMC.TTC.GENERATOR.SINGLE_RESYNC", 0x1);
+    }
+}
+
+void readScanRegWords(localArgs *la, const genScanPlan & plan, uint32_t mask, uint32_t *regWords)
+{
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        regWords[vfatN] = 0x0;
+        if (((mask >> vfatN) & 0x1) || plan.scanReg[vfatN].mask == 0xFFFFFFFF) continue;
+        regWords[vfatN] = readRawAddress(plan.scanReg[vfatN].address, la->response);
+    }
+}
+
+void writeScanRegLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal)
+{
+    uint32_t addrs[oh::VFATS_PER_OH], words[oh::VFATS_PER_OH];
+    size_t nWrites = 0;
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        if ((mask >> vfatN) & 0x1) continue;
+        RegHandle const& reg = plan.scanReg[vfatN];
+        addrs[nWrites] = reg.address;
+        words[nWrites] = (reg.mask == 0xFFFFFFFF) ? dacVal : (((dacVal << __builtin_ctz(reg.mask)) & reg.mask) | (regWords[vfatN] & ~reg.mask));
+        ++nWrites;
+    }
+    writeAddressList(addrs, words, nWrites, la->response);
+}
+
+void sendScanTriggersLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig)
+{
+    if (useExtTrig) {
+        writeRegHandle(plan.ttcCntReset, 0x1, la->response);
+        writeRegHandle(plan.ttcL1AEnable, 0x1, la->response);
+
+        uint32_t l1aCnt = 0;
+        while (l1aCnt < nevts) {
+            l1aCnt = readRawAddress(plan.l1aCount, la->response);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        writeRegHandle(plan.ttcL1AEnable, 0x0, la->response);
+    } else {
+        writeRegHandle(plan.ttcCyclicStart, 0x1, la->response);
+        if (readRegHandle(plan.ttcGenEnable, la->response)) { //TTC Commands from TTC.GENERATOR
+            while (readRegHandle(plan.ttcCyclicRunning, la->response)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        } //End TTC Commands from TTC.GENERATOR
+    }
+}
+
+void genScanBurstLocal(localArgs *la, const genScanPlan & plan, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents)
+{
+    //Reset and enable the VFAT_DAQ_MONITOR
+    writeRegHandle(plan.daqMonReset, 0x1, la->response);
+    writeRegHandle(plan.daqMonEnable, 0x1, la->response);
+
+    sendScanTriggersLocal(la, plan, nevts, useExtTrig);
+
+    //Stop the DAQ monitor counters from incrementing
+    writeRegHandle(plan.daqMonEnable, 0x0, la->response);
+
+    //Read the DAQ Monitor counters of all VFATs at once
+    readAddressList(plan.goodEventsCount.data(), goodEvents, oh::VFATS_PER_OH, la->response);
+}
+
+void genScanStepLocal(localArgs *la, const genScanPlan & plan, uint32_t mask, const uint32_t *regWords, uint32_t dacVal, uint32_t nevts, bool useExtTrig, uint32_t *goodEvents)
+{
+    writeScanRegLocal(la, plan, mask, regWords, dacVal);
+    genScanBurstLocal(la, plan, nevts, useExtTrig, goodEvents);
+}
@@ -0,0 +1,694 @@
+/*! \file calibration_routines/scan_jobs.cpp
+ *  \brief Asynchronous execution of the long calibration scans
+ */
+
+#include "calibration_routines/scan_jobs.h"
+#include "calibration_routines/cal_pulse.h"
+#include "calibration_routines/checkpoint.h"
+#include "calibration_routines/result_file.h"
+#include "amc.h"
+#include "calibration_routines.h"
+#include "hw_constants.h"
+#include "utils/worker.h"
+#include "LockTools.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+    constexpr const char* SCAN_JOBS_SHM_FILE   = "/dev/shm/ctp7_scan_jobs";
+    constexpr const char* SCAN_JOB_RESULTS_FMT = "/dev/shm/ctp7_scan_job_%u.dat";
+    constexpr uint32_t SCAN_JOBS_VERSION     = 4;
+    constexpr size_t   N_SCAN_JOBS           = 8;  ///< finished jobs are kept until their slot is needed
+    constexpr size_t   SCAN_JOB_MAX_RESULTS  = 4;
+    constexpr size_t   SCAN_JOB_MAX_RESTORE  = 8;
+    constexpr size_t   SCAN_JOB_NAME_SIZE    = 32;
+    constexpr size_t   SCAN_JOB_ERROR_SIZE   = 256;
+    constexpr size_t   SCAN_JOB_PATH_SIZE    = 128;
+    constexpr uint32_t SCAN_JOB_MAX_CHUNK    = 16384; ///< words per fetchScanResults call
+
+    enum ScanJobStatus : uint32_t {
+        JOB_FREE = 0,
+        JOB_RUNNING,
+        JOB_DONE,
+        JOB_FAILED,
+        JOB_CANCELLED
+    };
+    const char* const STATUS_NAMES[] = {"FREE", "RUNNING", "DONE", "FAILED", "CANCELLED"};
+
+    /*!
+     * \brief Union of the RPC keys of the supported scans
+     */
+    struct ScanJobParams {
+        char     scanType[SCAN_JOB_NAME_SIZE];
+        char     scanReg[SCAN_JOB_NAME_SIZE];
+        uint32_t ohN;
+        uint32_t ohMask;
+        uint32_t mask;
+        uint32_t ch;
+        uint32_t useCalPulse;
+        uint32_t currentPulse;
+        uint32_t calScaleFactor;
+        uint32_t nevts;
+        uint32_t dacMin;
+        uint32_t dacMax;
+        uint32_t dacStep;
+        uint32_t useExtTrig;
+        uint32_t useUltra;
+        uint32_t dacSelect;
+        uint32_t useExtRefADC;
+        uint32_t nReads;
+        uint32_t stopOnVariance;
+        uint32_t useRateWindow;   ///< sbitRateScan integration window, see sbitRateWindow
+        uint32_t rateMinTimeMs;
+        uint32_t rateMaxTimeMs;
+        uint32_t rateTargetPrecision;
+        uint32_t rateQuietPoints;
+        uint32_t NOH; ///< 0 to use GEM_SYSTEM.CONFIG.NUM_OF_OH
+        char     resultFile[SCAN_JOB_PATH_SIZE]; ///< scan result file the points are streamed to, empty for none
+    };
+
+    struct ScanJobResult {
+        char     name[SCAN_JOB_NAME_SIZE];
+        uint32_t offset; ///< in words from the start of the results file
+        uint32_t size;   ///< in words
+    };
+
+    struct ScanJobSlot {
+        uint32_t id;
+        uint32_t status;
+        pid_t    pid;
+        uint32_t cancel;
+        uint32_t stepsDone;
+        uint32_t stepsTotal;
+        uint32_t dacVal;
+        uint64_t startNs; ///< CLOCK_MONOTONIC
+        uint64_t endNs;
+        ScanJobParams params;
+        uint32_t  nRestore; ///< registers restored when the job is cancelled
+        uint32_t  restoreAddr[SCAN_JOB_MAX_RESTORE];
+        uint32_t  restoreMask[SCAN_JOB_MAX_RESTORE];
+        uint32_t  restoreVal[SCAN_JOB_MAX_RESTORE];
+        uint32_t  nResults;
+        ScanJobResult results[SCAN_JOB_MAX_RESULTS];
+        char      error[SCAN_JOB_ERROR_SIZE];
+    };
+
+    /*!
+     * \brief Layout of the shared memory file
+     */
+    struct ScanJobTable {
+        uint32_t version;
+        uint32_t nextId;
+        ScanJobSlot slots[N_SCAN_JOBS];
+    };
+
+    typedef std::vector<std::pair<std::string, std::vector<uint32_t> > > ScanResults;
+
+    ScanJobTable *table = nullptr;
+    int jobsLockID = -1;
+    std::mutex jobsMutex;
+    ScanJobSlot *currentJob = nullptr; ///< only set in the worker process of a job
+
+    /*!
+     * \brief Scoped lock held while accessing the job table, excludes both other processes and other threads
+     */
+    class JobsLock {
+    public:
+        JobsLock() : m_guard(jobsMutex) { namedlock_lock(jobsLockID); }
+        ~JobsLock() { namedlock_unlock(jobsLockID); }
+    private:
+        std::lock_guard<std::mutex> m_guard;
+    };
+
+    std::string resultsFile(uint32_t jobId)
+    {
+        return stdsprintf(SCAN_JOB_RESULTS_FMT, jobId);
+    }
+
+    /*!
+     * \brief Maps the job table, creating and initializing it if needed
+     */
+    ScanJobTable* mapJobTable()
+    {
+        if (table)
+            return table;
+
+        if (jobsLockID < 0)
+            jobsLockID = namedlock_init("calibration_routines", "scan_jobs");
+        if (jobsLockID < 0) {
+            LOGGER->log_message(LogManager::ERROR, "Unable to initialize the scan jobs lock");
+            return nullptr;
+        }
+
+        int fd = open(SCAN_JOBS_SHM_FILE, O_RDWR|O_CREAT, 0664);
+        if (fd < 0) {
+            LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to open %s: %s", SCAN_JOBS_SHM_FILE, strerror(errno)));
+            return nullptr;
+        }
+        if (ftruncate(fd, sizeof(ScanJobTable)) != 0) {
+            LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to resize %s: %s", SCAN_JOBS_SHM_FILE, strerror(errno)));
+            close(fd);
+            return nullptr;
+        }
+        void *addr = mmap(nullptr, sizeof(ScanJobTable), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to map %s: %s", SCAN_JOBS_SHM_FILE, strerror(errno)));
+            return nullptr;
+        }
+
+        ScanJobTable *tbl = static_cast<ScanJobTable*>(addr);
+        std::lock_guard<std::mutex> guard(jobsMutex);
+        namedlock_lock(jobsLockID);
+        if (tbl->version != SCAN_JOBS_VERSION) {
+            std::memset(tbl, 0, sizeof(ScanJobTable));
+            tbl->version = SCAN_JOBS_VERSION;
+            tbl->nextId  = 1;
+        }
+        namedlock_unlock(jobsLockID);
+        table = tbl;
+        return table;
+    }
+
+    /*!
+     * \brief Returns the slot of a job, nullptr if unknown. Must be called with the lock held
+     * \details A running job whose worker went away is marked as failed
+     */
+    ScanJobSlot* findJob(uint32_t jobId)
+    {
+        for (auto & slot : table->slots) {
+            if (slot.status == JOB_FREE || slot.id != jobId)
+                continue;
+            if (slot.status == JOB_RUNNING && slot.pid && !processAlive(slot.pid)) {
+                slot.status = JOB_FAILED;
+                slot.endNs  = monotonicNs();
+                strncpy(slot.error, "Worker process terminated unexpectedly", SCAN_JOB_ERROR_SIZE-1);
+            }
+            return &slot;
+        }
+        return nullptr;
+    }
+
+    uint32_t nDacValues(ScanJobParams const& params)
+    {
+        return scanPoints(params.dacMin, params.dacMax, params.dacStep);
+    }
+
+    /*!
+     * \brief Number of points of a DAC scan over the range of dacSelect, 0 if dacSelect is unknown
+     */
+    uint32_t nDacScanValues(ScanJobParams const& params)
+    {
+        vfat3DACAndSize dacInfo;
+        auto dac = dacInfo.map_dacInfo.find(params.dacSelect);
+        if (dac == dacInfo.map_dacInfo.end())
+            return 0;
+        return scanPoints(std::get<1>(dac->second), std::get<2>(dac->second), params.dacStep);
+    }
+
+    unsigned int numberOfOH(localArgs *la, uint32_t NOH_requested)
+    {
+        unsigned int NOH = getFirmwareIdentity(la).numOfOH;
+        if (NOH_requested && NOH_requested <= NOH)
+            NOH = NOH_requested;
+        return std::min(NOH, amc::OH_PER_AMC);
+    }
+
+    /*!
+     * \brief Number of points of a scan, used for the progress report
+     * \return 0 if the scan type is not supported, or if its parameters are invalid (the error is then set in the response)
+     */
+    uint32_t countSteps(localArgs *la, ScanJobParams const& params)
+    {
+        const std::string scanType(params.scanType);
+        if (scanType == "genScan" || scanType == "genScanMultiLink" || scanType == "sbitRateScan")
+            return nDacValues(params);
+        if (scanType == "genChannelScan")
+            return 128*nDacValues(params);
+        if (scanType == "resume")
+            return scanStepsRemainingLocal(la, params.resultFile);
+        if (scanType == "dacScanMultiLink") {
+            uint32_t nDac = nDacScanValues(params);
+            if (!nDac) {
+                la->response->set_string("error", stdsprintf("Monitoring Select value %u not found", params.dacSelect));
+                return 0;
+            }
+            uint32_t ohMask = params.ohMask & ((0x1 << numberOfOH(la, params.NOH)) - 1);
+            return __builtin_popcount(ohMask)*nDac;
+        }
+        return 0;
+    }
+
+    /*!
+     * \brief Executes the scan in the worker process
+     */
+    ScanResults runScan(localArgs *la, ScanJobParams const& p)
+    {
+        const std::string scanType(p.scanType);
+        const std::string scanReg(p.scanReg);
+        ScanResults results;
+
+        if (scanType == "resume") {
+            resumeScanLocal(la, p.resultFile);
+            return results;
+        }
+
+        sbitRateWindow window;
+        window.minTimeMs       = p.rateMinTimeMs;
+        window.maxTimeMs       = p.rateMaxTimeMs;
+        window.targetPrecision = p.rateTargetPrecision;
+        window.quietPoints     = p.rateQuietPoints;
+        const sbitRateWindow *rateWindow = (scanType == "sbitRateScan" && p.useRateWindow) ? &window : nullptr;
+
+        std::unique_ptr<ScanResultFile> resultFile;
+        if (p.resultFile[0]) {
+            resultFile = openScanResultFile(la, p.resultFile, scanType, scanReg, scanType == "genScan" || scanType == "genChannelScan" ? 0x1 << p.ohN : p.ohMask,
+                                            p.mask, scanType == "genChannelScan" ? 128 : p.ch, p.nevts, p.dacMin, p.dacMax, p.dacStep,
+                                            scanResultFlags(p.useCalPulse, p.currentPulse, p.useExtTrig), p.calScaleFactor, rateWindow);
+            if (!resultFile)
+                return results;
+        }
+        ScanResultSink sink(la, std::move(resultFile));
+
+        if (scanType == "genScan") {
+            std::vector<uint32_t> outData(oh::VFATS_PER_OH*nDacValues(p));
+            genScanLocal(la, outData.data(), p.ohN, p.mask, p.ch, p.useCalPulse, p.currentPulse, p.calScaleFactor, p.nevts, p.dacMin, p.dacMax, p.dacStep, scanReg, p.useUltra, p.useExtTrig);
+            results.emplace_back("data", std::move(outData));
+        } else if (scanType == "genChannelScan") {
+            const uint32_t chSize = oh::VFATS_PER_OH*nDacValues(p);
+            std::vector<uint32_t> outData(128*chSize);
+            calPulseState calState;
+            for (uint32_t ch = 0; ch < 128 && !scanJobCancelled(); ++ch) {
+                genScanLocal(la, &(outData[ch*chSize]), p.ohN, p.mask, ch, p.useCalPulse, p.currentPulse, p.calScaleFactor, p.nevts, p.dacMin, p.dacMax, p.dacStep, scanReg, p.useUltra, p.useExtTrig, &calState);
+            }
+            results.emplace_back("data", std::move(outData));
+        } else if (scanType == "genScanMultiLink") {
+            std::vector<uint32_t> outData(scanDataIndex(nDacValues(p), amc::OH_PER_AMC, 0, 0));
+            genScanMultiLinkLocal(la, outData.data(), p.ohMask, p.ch, p.useCalPulse, p.currentPulse, p.calScaleFactor, p.nevts, p.dacMin, p.dacMax, p.dacStep, scanReg, p.useExtTrig);
+            results.emplace_back("data", std::move(outData));
+        } else if (scanType == "dacScanMultiLink") {
+            uint32_t nDac = nDacScanValues(p);
+            unsigned int NOH = numberOfOH(la, p.NOH);
+            std::vector<uint32_t> dacScanResultsAll;
+            for (unsigned int ohN = 0; ohN < NOH; ++ohN) {
+                std::vector<uint32_t> dacScanResults;
+                if (((p.ohMask >> ohN) & 0x1) && !scanJobCancelled())
+                    dacScanResults = dacScanLocal(la, ohN, p.dacSelect, p.dacStep, getOHVFATMaskLocal(la, ohN), p.useExtRefADC, p.nReads, p.stopOnVariance);
+                if (dacScanResults.empty())
+                    dacScanResults.assign(oh::VFATS_PER_OH*nDac, 0xdeaddead);
+                dacScanResultsAll.insert(dacScanResultsAll.end(), dacScanResults.begin(), dacScanResults.end());
+            }
+            results.emplace_back("dacScanResultsAll", std::move(dacScanResultsAll));
+        } else if (scanType == "sbitRateScan") {
+            const uint32_t nDac = nDacValues(p);
+            std::vector<uint32_t> outDataTrigRatePerVFAT(amc::OH_PER_AMC*oh::VFATS_PER_OH*nDac);
+            std::vector<uint32_t> outDataDacValPerOH(amc::OH_PER_AMC*nDac);
+            std::vector<uint32_t> outDataTrigRatePerOH(amc::OH_PER_AMC*nDac);
+            sbitRateScanParallelLocal(la, outDataDacValPerOH.data(), outDataTrigRatePerVFAT.data(), outDataTrigRatePerOH.data(), p.ch, p.dacMin, p.dacMax, p.dacStep, scanReg, p.ohMask, rateWindow);
+            results.emplace_back("outDataVFATRate", std::move(outDataTrigRatePerVFAT));
+            results.emplace_back("outDataDacValue", std::move(outDataDacValPerOH));
+            results.emplace_back("outDataCTP7Rate", std::move(outDataTrigRatePerOH));
+        }
+        return results;
+    }
+
+    /*!
+     * \brief Writes the result arrays back to back and fills their layout in the slot
+     * \return false in case of error, with the error stored in the slot
+     */
+    bool writeResults(ScanJobSlot *slot, ScanResults const& results)
+    {
+        const std::string path = resultsFile(slot->id);
+        int fd = open(path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0664);
+        if (fd < 0) {
+            strncpy(slot->error, stdsprintf("Unable to create %s: %s", path.c_str(), strerror(errno)).c_str(), SCAN_JOB_ERROR_SIZE-1);
+            return false;
+        }
+
+        ScanJobResult layout[SCAN_JOB_MAX_RESULTS];
+        uint32_t offset = 0, nResults = 0;
+        for (auto const& result : results) {
+            if (nResults == SCAN_JOB_MAX_RESULTS)
+                break;
+            const size_t nBytes = result.second.size()*sizeof(uint32_t);
+            if (write(fd, result.second.data(), nBytes) != ssize_t(nBytes)) {
+                strncpy(slot->error, stdsprintf("Unable to write %s: %s", path.c_str(), strerror(errno)).c_str(), SCAN_JOB_ERROR_SIZE-1);
+                close(fd);
+                return false;
+            }
+            std::memset(layout[nResults].name, 0, SCAN_JOB_NAME_SIZE);
+            strncpy(layout[nResults].name, result.first.c_str(), SCAN_JOB_NAME_SIZE-1);
+            layout[nResults].offset = offset;
+            layout[nResults].size   = result.second.size();
+            offset += result.second.size();
+            ++nResults;
+        }
+        close(fd);
+
+        JobsLock lock;
+        std::copy(layout, layout+nResults, slot->results);
+        slot->nResults = nResults;
+        return true;
+    }
+
+    /*!
+     * \brief Body of the worker process, never returns
+     */
+    void runWorker(ScanJobSlot *slot)
+    {
+        currentJob = slot;
+
+        ScanJobParams params;
+        {
+            JobsLock lock;
+            params = slot->params;
+        }
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Scan job %u (%s) started in process %i", slot->id, params.scanType, getpid()));
+
+        uint32_t status = JOB_DONE;
+        std::string error;
+        ScanResults results;
+        try {
+            RPCMsg scratch("scanJob");
+            RPCMsg *response = &scratch;
+            GETLOCALARGS(response);
+
+            results = runScan(&la, params);
+            if (scratch.get_key_exists("error"))
+                error = scratch.get_string("error");
+
+            if (scanJobCancelled()) {
+                uint32_t nRestore;
+                {
+                    JobsLock lock;
+                    nRestore = slot->nRestore;
+                }
+                for (uint32_t i = 0; i < nRestore; ++i) {
+                    RegHandle reg;
+                    reg.address = slot->restoreAddr[i];
+                    reg.mask    = slot->restoreMask[i];
+                    writeRegHandle(reg, slot->restoreVal[i], response);
+                }
+            }
+            rtxn.abort();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+
+        if (scanJobCancelled())
+            status = JOB_CANCELLED;
+        else if (!error.empty())
+            status = JOB_FAILED;
+
+        // Partial results of a cancelled or failed scan are still made available
+        if (!writeResults(slot, results))
+            status = JOB_FAILED;
+
+        {
+            JobsLock lock;
+            if (!error.empty())
+                strncpy(slot->error, error.c_str(), SCAN_JOB_ERROR_SIZE-1);
+            slot->status = status;
+            slot->endNs  = monotonicNs();
+        }
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Scan job %u finished with status %s", slot->id, STATUS_NAMES[status]));
+        _exit(0);
+    }
+
+    /*!
+     * \brief Registers restored when a job is cancelled, the scans leave the TTC and the DAQ monitor configured otherwise
+     */
+    const char* const RESTORE_REGS[] = {
+        "GEM_AMC.TTC.CTRL.L1A_ENABLE",
+        "GEM_AMC.TTC.GENERATOR.ENABLE",
+        "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE",
+        "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.OH_SELECT",
+    };
+
+    void readParams(const RPCMsg *request, ScanJobParams & params)
+    {
+        auto word = [&](const char *key, uint32_t defVal) {
+            return request->get_key_exists(key) ? request->get_word(key) : defVal;
+        };
+        std::memset(&params, 0, sizeof(params));
+        strncpy(params.scanType, request->get_string("scanType").c_str(), SCAN_JOB_NAME_SIZE-1);
+        if (request->get_key_exists("scanReg"))
+            strncpy(params.scanReg, request->get_string("scanReg").c_str(), SCAN_JOB_NAME_SIZE-1);
+        params.ohN            = word("ohN", 0);
+        params.ohMask         = word("ohMask", 0xfff);
+        params.mask           = word("mask", 0);
+        params.ch             = word("ch", 128);
+        params.useCalPulse    = word("useCalPulse", 0);
+        params.currentPulse   = word("currentPulse", 0);
+        params.calScaleFactor = word("calScaleFactor", 0);
+        params.nevts          = word("nevts", 0);
+        params.dacMin         = word("dacMin", 0);
+        params.dacMax         = word("dacMax", 0);
+        params.dacStep        = word("dacStep", 1);
+        params.useExtTrig     = word("useExtTrig", 0);
+        params.useUltra       = request->get_key_exists("useUltra");
+        params.dacSelect      = word("dacSelect", 0);
+        params.useExtRefADC   = word("useExtRefADC", 0);
+        params.nReads         = word("nReads", 100);
+        params.stopOnVariance = word("stopOnVariance", 0);
+        std::unique_ptr<sbitRateWindow> window = getSbitRateWindow(request);
+        if (window) {
+            params.useRateWindow       = 1;
+            params.rateMinTimeMs       = window->minTimeMs;
+            params.rateMaxTimeMs       = window->maxTimeMs;
+            params.rateTargetPrecision = window->targetPrecision;
+            params.rateQuietPoints     = window->quietPoints;
+        }
+        params.NOH            = word("NOH", 0);
+        if (request->get_key_exists("resultFile"))
+            strncpy(params.resultFile, request->get_string("resultFile").c_str(), SCAN_JOB_PATH_SIZE-1);
+    }
+}
+
+bool scanJobCancelled()
+{
+    if (!currentJob)
+        return false;
+    JobsLock lock;
+    return currentJob->cancel;
+}
+
+void scanJobStep(uint32_t dacVal)
+{
+    if (!currentJob)
+        return;
+    JobsLock lock;
+    ++currentJob->stepsDone;
+    currentJob->dacVal = dacVal;
+}
+
+void submitScan(const RPCMsg *request, RPCMsg *response)
+{
+    GETLOCALARGS(response);
+
+    if (!mapJobTable()) {
+        response->set_string("error", "Scan job table not available");
+        rtxn.abort();
+        return;
+    }
+
+    ScanJobParams params;
+    readParams(request, params);
+    if (params.dacStep == 0 || params.dacMax < params.dacMin) {
+        response->set_string("error", stdsprintf("Invalid DAC range: dacMin %u dacMax %u dacStep %u", params.dacMin, params.dacMax, params.dacStep));
+        rtxn.abort();
+        return;
+    }
+    uint32_t stepsTotal = countSteps(&la, params);
+    if (!stepsTotal && !response->get_key_exists("error") && !strcmp(params.scanType, "resume")) {
+        response->set_string("error", stdsprintf("Nothing left to resume in %s", params.resultFile));
+    }
+    if (response->get_key_exists("error")) {
+        rtxn.abort();
+        return;
+    }
+    if (!stepsTotal) {
+        response->set_string("error", stdsprintf("Unsupported scanType %s, possible values are genScan, genChannelScan, genScanMultiLink, dacScanMultiLink, sbitRateScan and resume", params.scanType));
+        rtxn.abort();
+        return;
+    }
+
+    ScanJobSlot *slot = nullptr;
+    {
+        JobsLock lock;
+        ScanJobSlot *oldest = nullptr;
+        for (auto & s : table->slots) {
+            if (s.status == JOB_RUNNING && findJob(s.id)->status == JOB_RUNNING) {
+                response->set_string("error", stdsprintf("Scan job %u is still running", s.id));
+                rtxn.abort();
+                return;
+            }
+            if (s.status == JOB_FREE)
+                slot = &s;
+            else if (!oldest || s.endNs < oldest->endNs)
+                oldest = &s;
+        }
+        if (!slot) {
+            slot = oldest;
+            unlink(resultsFile(slot->id).c_str());
+        }
+
+        std::memset(slot, 0, sizeof(ScanJobSlot));
+        slot->id         = table->nextId++;
+        slot->status     = JOB_RUNNING;
+        slot->stepsTotal = stepsTotal;
+        slot->startNs    = monotonicNs();
+        slot->params     = params;
+        for (auto regName : RESTORE_REGS) {
+            RegHandle reg = getRegHandle(&la, regName);
+            if (reg.address == 0xdeaddead)
+                continue;
+            slot->restoreAddr[slot->nRestore] = reg.address;
+            slot->restoreMask[slot->nRestore] = reg.mask;
+            slot->restoreVal[slot->nRestore] = readRegHandle(reg, response);
+            ++slot->nRestore;
+        }
+    }
+    const uint32_t jobId = slot->id;
+
+    auto recordWorker = [slot](pid_t worker) {
+        JobsLock lock;
+        slot->pid = worker;
+    };
+    if (!startWorker([slot]() { runWorker(slot); }, recordWorker)) {
+        JobsLock lock;
+        slot->status = JOB_FAILED;
+        slot->endNs  = monotonicNs();
+        strncpy(slot->error, "Unable to start the worker process", SCAN_JOB_ERROR_SIZE-1);
+        response->set_string("error", stdsprintf("Unable to start the worker process of scan job %u", jobId));
+        rtxn.abort();
+        return;
+    }
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Submitted scan job %u: %s with %u points", jobId, params.scanType, stepsTotal));
+    response->set_word("jobId", jobId);
+    rtxn.abort();
+}
+
+void getScanProgress(const RPCMsg *request, RPCMsg *response)
+{
+    if (!mapJobTable()) {
+        response->set_string("error", "Scan job table not available");
+        return;
+    }
+
+    uint32_t jobId = request->get_word("jobId");
+    JobsLock lock;
+    ScanJobSlot *slot = findJob(jobId);
+    if (!slot) {
+        response->set_string("error", stdsprintf("Unknown scan job %u", jobId));
+        return;
+    }
+
+    const uint64_t elapsedNs = (slot->status == JOB_RUNNING ? monotonicNs() : slot->endNs) - slot->startNs;
+    uint64_t etaNs = 0;
+    if (slot->status == JOB_RUNNING && slot->stepsDone)
+        etaNs = elapsedNs*(slot->stepsTotal - std::min(slot->stepsDone, slot->stepsTotal))/slot->stepsDone;
+
+    response->set_string("status", STATUS_NAMES[slot->status]);
+    response->set_string("scanType", slot->params.scanType);
+    response->set_word("stepsDone", slot->stepsDone);
+    response->set_word("stepsTotal", slot->stepsTotal);
+    response->set_word("percent", slot->stepsTotal ? std::min(100u, 100*slot->stepsDone/slot->stepsTotal) : 0);
+    response->set_word("dacVal", slot->dacVal);
+    response->set_word("elapsedMs", elapsedNs/1000000);
+    response->set_word("etaMs", etaNs/1000000);
+    if (slot->error[0])
+        response->set_string("jobError", slot->error);
+
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < slot->nResults; ++i)
+        names.push_back(slot->results[i].name);
+    response->set_string_array("results", names);
+}
+
+void cancelScan(const RPCMsg *request, RPCMsg *response)
+{
+    if (!mapJobTable()) {
+        response->set_string("error", "Scan job table not available");
+        return;
+    }
+
+    uint32_t jobId = request->get_word("jobId");
+    JobsLock lock;
+    ScanJobSlot *slot = findJob(jobId);
+    if (!slot) {
+        response->set_string("error", stdsprintf("Unknown scan job %u", jobId));
+        return;
+    }
+    if (slot->status == JOB_RUNNING) {
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Cancelling scan job %u", jobId));
+        slot->cancel = 1;
+    }
+    response->set_string("status", STATUS_NAMES[slot->status]);
+}
+
+void fetchScanResults(const RPCMsg *request, RPCMsg *response)
+{
+    if (!mapJobTable()) {
+        response->set_string("error", "Scan job table not available");
+        return;
+    }
+
+    uint32_t jobId  = request->get_word("jobId");
+    uint32_t offset = request->get_key_exists("offset") ? request->get_word("offset") : 0;
+    uint32_t count  = request->get_key_exists("count") ? request->get_word("count") : SCAN_JOB_MAX_CHUNK;
+    count = std::min(count, SCAN_JOB_MAX_CHUNK);
+
+    ScanJobResult result;
+    {
+        JobsLock lock;
+        ScanJobSlot *slot = findJob(jobId);
+        if (!slot) {
+            response->set_string("error", stdsprintf("Unknown scan job %u", jobId));
+            return;
+        }
+        if (slot->status == JOB_RUNNING || !slot->nResults) {
+            response->set_string("error", stdsprintf("Scan job %u has no results (status %s)", jobId, STATUS_NAMES[slot->status]));
+            return;
+        }
+        const std::string name = request->get_key_exists("name") ? request->get_string("name") : slot->results[0].name;
+        auto res = std::find_if(slot->results, slot->results+slot->nResults,
+                                [&](ScanJobResult const& r) { return name == r.name; });
+        if (res == slot->results+slot->nResults) {
+            response->set_string("error", stdsprintf("Scan job %u has no result %s", jobId, name.c_str()));
+            return;
+        }
+        result = *res;
+    }
+
+    offset = std::min(offset, result.size);
+    count  = std::min(count, result.size-offset);
+    std::vector<uint32_t> data(count);
+
+    const std::string path = resultsFile(jobId);
+    int fd = open(path.c_str(), O_RDONLY);
+    ssize_t nBytes = count*sizeof(uint32_t);
+    if (fd < 0 || pread(fd, data.data(), nBytes, off_t(result.offset+offset)*sizeof(uint32_t)) != nBytes) {
+        response->set_string("error", stdsprintf("Unable to read %s: %s", path.c_str(), strerror(errno)));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    close(fd);
+
+    response->set_word_array("data", data);
+    response->set_word("offset", offset);
+    response->set_word("size", result.size);
+}
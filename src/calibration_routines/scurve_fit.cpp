@@ -0,0 +1,55 @@
+/*! \file calibration_routines/scurve_fit.cpp
+ *  \brief On-board analysis of the S-curves of a channel scan
+ */
+
+#include "calibration_routines/scurve_fit.h"
+#include "calibration_routines/result_file.h"
+#include "hw_constants.h"
+
+namespace {
+    uint32_t toFixedPoint(float value)
+    {
+        if (!(value > 0.))
+            return 0;
+        float scaled = value*SCURVE_FIXED_POINT_SCALE;
+        return (scaled >= 4294967040.) ? 0xFFFFFFFF : uint32_t(scaled + 0.5);
+    }
+}
+
+void fitSCurvesLocal(const uint32_t *data, const uint32_t *dacPoints, uint32_t nPoints, uint32_t nevts, uint32_t mask, uint32_t ch, std::vector<uint32_t> *results)
+{
+    std::vector<float> x(dacPoints, dacPoints + nPoints);
+
+    uint32_t nDead = 0, nNoisy = 0, nNoTurnOn = 0;
+    for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        size_t idx = vfatN*128 + ch;
+        if ((mask >> vfatN) & 0x1) {
+            results[0][idx] = 0;
+            results[1][idx] = 0;
+            results[2][idx] = 0;
+            results[3][idx] = SCURVE_FLAG_MASKED;
+            continue;
+        }
+
+        scurveFitResult fit = fitSCurve(data + scanDataIndex(nPoints, 0, vfatN, 0), x.data(), nPoints, nevts);
+        results[0][idx] = toFixedPoint(fit.threshold);
+        results[1][idx] = toFixedPoint(fit.noise);
+        results[2][idx] = toFixedPoint(fit.chi2ndf);
+        results[3][idx] = fit.flags;
+
+        nDead     += (fit.flags & SCURVE_FLAG_DEAD) ? 1 : 0;
+        nNoisy    += (fit.flags & SCURVE_FLAG_NOISY) ? 1 : 0;
+        nNoTurnOn += (fit.flags & SCURVE_FLAG_NO_TURNON) ? 1 : 0;
+    }
+
+    if (logLevelEnabled(LogManager::DEBUG))
+        LOGGER->log_message(LogManager::DEBUG, stdsprintf("S-curve analysis of channel %i: %u dead, %u noisy, %u without turn-on", ch, nDead, nNoisy, nNoTurnOn));
+}
+
+void setSCurveFitResults(RPCMsg *response, std::vector<uint32_t> *results)
+{
+    response->set_word_array("scurveThreshold", results[0]);
+    response->set_word_array("scurveNoise", results[1]);
+    response->set_word_array("scurveChi2", results[2]);
+    response->set_word_array("scurveFlags", results[3]);
+}
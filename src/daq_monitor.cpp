@@ -8,7 +8,9 @@
 #include <chrono>
 #include <thread>
 #include "daq_monitor.h"
+#include "daq_monitor/sampler.h"
 #include "hw_constants.h"
+#include <array>
 #include <string>
 #include "utils.h"
 
@@ -33,7 +35,7 @@ void getmonTRIGGERmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
   la->response->set_word("OR_TRIGGER_RATE",readReg(la,"GEM_AMC.TRIGGER.STATUS.OR_TRIGGER_RATE"));
-  int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  int NOH_local = getFirmwareIdentity(la).numOfOH;
   if (NOH_local < NOH) NOH = NOH_local;
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
@@ -50,7 +52,7 @@ void getmonTRIGGERmain(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -72,7 +74,7 @@ void getmonTRIGGERmain(const RPCMsg *request, RPCMsg *response)
 void getmonTRIGGEROHmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
-  int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  int NOH_local = getFirmwareIdentity(la).numOfOH;
   if (NOH_local < NOH) NOH = NOH_local;
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
@@ -126,7 +128,7 @@ void getmonTRIGGEROHmain(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -170,7 +172,7 @@ void getmonDAQmain(const RPCMsg *request, RPCMsg *response)
 void getmonDAQOHmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
-  int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  int NOH_local = getFirmwareIdentity(la).numOfOH;
   if (NOH_local < NOH) NOH = NOH_local;
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
@@ -214,7 +216,7 @@ void getmonDAQOHmain(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -272,7 +274,7 @@ void getmonGBTLink(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
 
   if (request->get_key_exists("NOH")) {
     unsigned int NOH_requested = request->get_word("NOH");
@@ -295,7 +297,7 @@ void getmonOHLink(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
 
   if (request->get_key_exists("NOH")) {
     unsigned int NOH_requested = request->get_word("NOH");
@@ -318,7 +320,7 @@ void getmonOHLink(const RPCMsg *request, RPCMsg *response)
 
 void getmonOHmainLocal(localArgs * la, int NOH, int ohMask)
 {
-  int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  int NOH_local = getFirmwareIdentity(la).numOfOH;
   if (NOH_local < NOH) NOH = NOH_local;
   std::string t1,t2;
   for (int ohN = 0; ohN < NOH; ohN++) {
@@ -395,7 +397,7 @@ void getmonOHmain(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -423,7 +425,7 @@ void getmonOHSCAmainLocal(localArgs *la, int NOH, int ohMask)
 
     //Turn on monitoring for requested links
     writeReg(la, "GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.MONITORING_OFF", (~ohMask) & 0x3fc);
-    int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    int NOH_local = getFirmwareIdentity(la).numOfOH;
     if (NOH_local < NOH) NOH = NOH_local;
 
     for (int ohN = 0; ohN < NOH; ++ohN) { //Loop over all optohybrids
@@ -546,7 +548,7 @@ void getmonOHSCAmain(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -561,7 +563,11 @@ void getmonOHSCAmain(const RPCMsg *request, RPCMsg *response)
     NOH = NOH_requested;
   }
 
-  getmonOHSCAmainLocal(&la, NOH, ohMask);
+  if (request->get_key_exists("useCache") && request->get_word("useCache")) {
+    getmonCachedLocal(&la, moncat::OHSCA, NOH, ohMask);
+  } else {
+    getmonOHSCAmainLocal(&la, NOH, ohMask);
+  }
   rtxn.abort();
 }
 
@@ -569,7 +575,7 @@ void getmonOHSysmonLocal(localArgs *la, int NOH, int ohMask, bool doReset)
 {
     std::string strKeyName;
     std::string strRegBase;
-    int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    int NOH_local = getFirmwareIdentity(la).numOfOH;
     if (NOH_local < NOH) NOH = NOH_local;
 
     if (fw_version_check("getmonOHSysmon", la) == 3) {
@@ -701,7 +707,7 @@ void getmonOHSysmon(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
   int ohMask = 0xfff;
   if (request->get_key_exists("ohMask")) {
     ohMask = request->get_word("ohMask");
@@ -718,13 +724,17 @@ void getmonOHSysmon(const RPCMsg *request, RPCMsg *response)
 
   bool doReset = request->get_word("doReset");
 
-  getmonOHSysmonLocal(&la, NOH, ohMask, doReset);
+  if (request->get_key_exists("useCache") && request->get_word("useCache")) {
+    getmonCachedLocal(&la, moncat::OHSYSMON, NOH, ohMask);
+  } else {
+    getmonOHSysmonLocal(&la, NOH, ohMask, doReset);
+  }
   rtxn.abort();
 } //End getmonOHSysmon()
 
 void getmonSCALocal(localArgs * la, int NOH)
 {
-  int NOH_local = readReg(la,"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  int NOH_local = getFirmwareIdentity(la).numOfOH;
   if (NOH_local < NOH) NOH = NOH_local;
   std::string t1,t2;
   la->response->set_word("SCA.STATUS.READY", readReg(la, "GEM_AMC.SLOW_CONTROL.SCA.STATUS.READY"));
@@ -746,17 +756,27 @@ void getmonSCA(const RPCMsg *request, RPCMsg *response)
   rtxn.abort();
 } //End getmonSCA()
 
-void getmonVFATLinkLocal(localArgs * la, int NOH, bool doReset)
+void getmonVFATLinkLocal(localArgs * la, int NOH, bool doReset, uint32_t nOrbits, bool snapshot)
 {
     //Reset Requested?
+    auto tRef = std::chrono::steady_clock::now();
     if (doReset) {
          writeReg(la, "GEM_AMC.GEM_SYSTEM.CTRL.LINK_RESET", 0x1);
-         std::this_thread::sleep_for(std::chrono::microseconds(92)); // FIXME sleep for N orbits
+         tRef = std::chrono::steady_clock::now();
+         std::this_thread::sleep_for(std::chrono::nanoseconds(static_cast<uint64_t>(nOrbits)*ORBIT_LENGTH_NS));
     }
 
+    auto usSinceRef = [&tRef]() -> uint32_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tRef).count();
+    };
+
     std::string regName, respName; //regName used for read/write, respName sets word in RPC response
     bool vfatOutOfSync = false;
+    uint32_t readStart = usSinceRef();
     for (int ohN=0; ohN < NOH; ++ohN) {
+        if (snapshot) {
+            la->response->set_word(stdsprintf("OH%i.WINDOW_START_US",ohN),usSinceRef());
+        }
         for (unsigned int vfatN=0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
             //Sync Error Counters
             respName = stdsprintf("OH%i.VFAT%i.SYNC_ERR_CNT",ohN,vfatN);
@@ -777,8 +797,16 @@ void getmonVFATLinkLocal(localArgs * la, int NOH, bool doReset)
             regName = stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT%i.DAQ_CRC_ERROR_CNT",ohN,vfatN);
             la->response->set_word(respName,readReg(la,regName));
         } //End Loop Over VFAT's
+        if (snapshot) {
+            la->response->set_word(stdsprintf("OH%i.WINDOW_END_US",ohN),usSinceRef());
+        }
     } //End Loop Over All OH's
 
+    if (snapshot) {
+        la->response->set_word("SNAPSHOT.RESET",doReset);
+        la->response->set_word("SNAPSHOT.READ_US",usSinceRef()-readStart);
+    }
+
     //Set OOS flag (out of sync)
     if (vfatOutOfSync) {
         la->response->set_string("warning","One or more VFATs found to be out of sync\n");
@@ -791,7 +819,7 @@ void getmonVFATLink(const RPCMsg *request, RPCMsg *response)
 {
   GETLOCALARGS(response);
 
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
 
   if (request->get_key_exists("NOH")) {
     unsigned int NOH_requested = request->get_word("NOH");
@@ -806,10 +834,97 @@ void getmonVFATLink(const RPCMsg *request, RPCMsg *response)
     doReset = request->get_word("doReset");
   }
 
-  getmonVFATLinkLocal(&la, NOH, doReset);
+  uint32_t nOrbits = 1;
+  if (request->get_key_exists("nOrbits") ) {
+    nOrbits = request->get_word("nOrbits");
+  }
+
+  bool snapshot = false;
+  if (request->get_key_exists("snapshot") ) {
+    snapshot = request->get_word("snapshot");
+  }
+
+  getmonVFATLinkLocal(&la, NOH, doReset, nOrbits, snapshot);
   rtxn.abort();
 } //End getmonVFATLink()
 
+void getmonAllLocal(localArgs * la, uint32_t categories, int NOH, int ohMask, bool doReset)
+{
+  // Categories in read order: AMC side counters first, then the links, then the slow control
+  const std::array<std::pair<uint32_t, const char*>, 11> readOrder {{
+      {moncat::TTC,       "TTC"},
+      {moncat::DAQ,       "DAQ"},
+      {moncat::DAQOH,     "DAQOH"},
+      {moncat::OH,        "OH"},
+      {moncat::TRIGGER,   "TRIGGER"},
+      {moncat::TRIGGEROH, "TRIGGEROH"},
+      {moncat::GBTLINK,   "GBTLINK"},
+      {moncat::VFATLINK,  "VFATLINK"},
+      {moncat::SCA,       "SCA"},
+      {moncat::OHSYSMON,  "OHSYSMON"},
+      {moncat::OHSCA,     "OHSCA"},
+    }};
+
+  auto passStart = std::chrono::steady_clock::now();
+  for (auto const& cat : readOrder) {
+    if (!(categories & cat.first))
+      continue;
+
+    auto catStart = std::chrono::steady_clock::now();
+    switch (cat.first) {
+    case moncat::TTC:       getmonTTCmainLocal(la);                          break;
+    case moncat::DAQ:       getmonDAQmainLocal(la);                          break;
+    case moncat::DAQOH:     getmonDAQOHmainLocal(la, NOH, ohMask);           break;
+    case moncat::OH:        getmonOHmainLocal(la, NOH, ohMask);              break;
+    case moncat::TRIGGER:   getmonTRIGGERmainLocal(la, NOH, ohMask);         break;
+    case moncat::TRIGGEROH: getmonTRIGGEROHmainLocal(la, NOH, ohMask);       break;
+    case moncat::GBTLINK:   getmonGBTLinkLocal(la, NOH, doReset);            break;
+    case moncat::VFATLINK:  getmonVFATLinkLocal(la, NOH, doReset);           break;
+    case moncat::SCA:       getmonSCALocal(la, NOH);                         break;
+    case moncat::OHSYSMON:  getmonOHSysmonLocal(la, NOH, ohMask, false);     break;
+    case moncat::OHSCA:     getmonOHSCAmainLocal(la, NOH, ohMask);           break;
+    }
+    auto catTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - catStart);
+    la->response->set_word(stdsprintf("TIME.%s_US",cat.second), catTime.count());
+  }
+  auto passTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - passStart);
+  la->response->set_word("TIME.TOTAL_US", passTime.count());
+  la->response->set_word("CATEGORIES", categories & moncat::ALL);
+} //End getmonAllLocal()
+
+void getmonAll(const RPCMsg *request, RPCMsg *response)
+{
+  GETLOCALARGS(response);
+
+  unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
+  int ohMask = 0xfff;
+  if (request->get_key_exists("ohMask")) {
+    ohMask = request->get_word("ohMask");
+  }
+
+  if (request->get_key_exists("NOH")) {
+    unsigned int NOH_requested = request->get_word("NOH");
+    if (NOH_requested > NOH) {
+      LOGGER->log_message(LogManager::WARNING, stdsprintf("NOH requested (%i) > NUM_OF_OH AMC register (%i)",NOH_requested,NOH));
+      ohMask = ohMask & (0xfff >> (NOH_MAX-NOH));
+    }
+    NOH = NOH_requested;
+  }
+
+  uint32_t categories = moncat::ALL;
+  if (request->get_key_exists("categories")) {
+    categories = request->get_word("categories");
+  }
+
+  bool doReset = false;
+  if (request->get_key_exists("doReset") ) {
+    doReset = request->get_word("doReset");
+  }
+
+  getmonAllLocal(&la, categories, NOH, ohMask, doReset);
+  rtxn.abort();
+} //End getmonAll()
+
 extern "C" {
     const char *module_version_key = "daq_monitor v1.0.1";
     int module_activity_color = 4;
@@ -831,5 +946,7 @@ extern "C" {
         modmgr->register_method("daq_monitor", "getmonOHSysmon", getmonOHSysmon);
         modmgr->register_method("daq_monitor", "getmonSCA", getmonSCA);
         modmgr->register_method("daq_monitor", "getmonVFATLink", getmonVFATLink);
+        modmgr->register_method("daq_monitor", "getmonAll", getmonAll);
+        modmgr->register_method("daq_monitor", "configureMonitorSampler", configureMonitorSampler);
     }
 }
@@ -0,0 +1,532 @@
+/*!
+ * \file daq_monitor/sampler.cpp
+ * \brief Background sampler for the monitoring values and its OpenMetrics export
+ */
+
+#include "daq_monitor/sampler.h"
+#include "daq_monitor.h"
+#include "hw_constants.h"
+#include "utils/worker.h"
+#include "LockTools.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace {
+  constexpr const char* SAMPLER_SHM_FILE    = "/dev/shm/ctp7_daq_monitor_sampler";
+  constexpr uint32_t SAMPLER_STATE_VERSION  = 3;
+  constexpr uint32_t SAMPLER_MAX_VALUES     = 72;   ///< Maximum number of values per OH and category (VFAT link counters)
+  constexpr uint32_t SAMPLER_MIN_TICK_MS    = 10;   ///< Lower bound of the time between two OH refreshes
+  constexpr uint64_t SAMPLER_MIN_TIMEOUT_NS = 2000000000ULL; ///< Minimum heartbeat age after which the active sampler is considered dead
+  constexpr size_t   SAMPLER_PATH_SIZE      = 128;  ///< Maximum length of the export path, including the terminating null
+  constexpr size_t   N_SAMPLED_CATEGORIES   = 5;
+
+  /*!
+   * \brief Description of one sampled category
+   * \details The keys are the per-OH keys of the direct read method ("OH%i." is prepended), the labels are the OpenMetrics labels of the corresponding series
+   */
+  struct SampledCategory {
+    uint32_t category;
+    const char* name;
+    const char* metric;
+    const char* help;
+    std::vector<std::string> keys;
+    std::vector<std::string> labels;
+    void (*read)(localArgs* la, int ohN);
+  };
+
+  void readGBTLinks(localArgs* la, int ohN)
+  {
+    for (auto const& flag : {"READY", "WAS_NOT_READY", "RX_HAD_OVERFLOW", "RX_HAD_UNDERFLOW"})
+      for (unsigned int gbtN = 0; gbtN < gbt::GBTS_PER_OH; ++gbtN)
+        la->response->set_word(stdsprintf("OH%i.GBT%i.%s",ohN,gbtN,flag),
+                               readReg(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.GBT%i_%s",ohN,gbtN,flag)));
+  }
+
+  void readVFATLinks(localArgs* la, int ohN)
+  {
+    for (auto const& counter : {"SYNC_ERR_CNT", "DAQ_EVENT_CNT", "DAQ_CRC_ERROR_CNT"})
+      for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN)
+        la->response->set_word(stdsprintf("OH%i.VFAT%i.%s",ohN,vfatN,counter),
+                               readReg(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT%i.%s",ohN,vfatN,counter)));
+  }
+
+  SampledCategory makeScaCategory()
+  {
+    SampledCategory cat {moncat::OHSCA, "OHSCA", "ctp7_oh_sca_adc", "SCA ADC monitoring value in ADC counts", {}, {},
+                         [](localArgs* la, int ohN) { getmonOHSCAmainLocal(la, ohN+1, 0x1 << ohN); }};
+    cat.keys = {"SCA_TEMP",
+                "BOARD_TEMP1", "BOARD_TEMP2", "BOARD_TEMP3", "BOARD_TEMP4", "BOARD_TEMP5",
+                "BOARD_TEMP6", "BOARD_TEMP7", "BOARD_TEMP8", "BOARD_TEMP9",
+                "AVCCN", "AVTTN", "1V0_INT", "1V8F", "1V5", "2V5_IO", "3V0", "1V8", "VTRX_RSSI2", "VTRX_RSSI1"};
+    for (auto const& key : cat.keys)
+      cat.labels.push_back(stdsprintf("channel=\"%s\"", key.c_str()));
+    return cat;
+  }
+
+  SampledCategory makeSysmonCategory()
+  {
+    SampledCategory cat {moncat::OHSYSMON, "OHSYSMON", "ctp7_oh_sysmon", "OH FPGA sysmon value, alarm or alarm counter", {}, {},
+                         [](localArgs* la, int ohN) { getmonOHSysmonLocal(la, ohN+1, 0x1 << ohN, false); }};
+    cat.keys = {"OVERTEMP", "CNT_OVERTEMP", "VCCAUX_ALARM", "CNT_VCCAUX_ALARM", "VCCINT_ALARM", "CNT_VCCINT_ALARM",
+                "FPGA_CORE_TEMP", "FPGA_CORE_1V0", "FPGA_CORE_2V5_IO"};
+    for (auto const& key : cat.keys)
+      cat.labels.push_back(stdsprintf("value=\"%s\"", key.c_str()));
+    return cat;
+  }
+
+  SampledCategory makeTriggerLinkCategory()
+  {
+    SampledCategory cat {moncat::TRIGGEROH, "TRIGGEROH", "ctp7_trigger_link_counter", "OH trigger link error counter", {}, {},
+                         [](localArgs* la, int ohN) { getmonTRIGGEROHmainLocal(la, ohN+1, 0x1 << ohN); }};
+    for (auto const& counter : {"MISSED_COMMA_CNT", "OVERFLOW_CNT", "UNDERFLOW_CNT", "SBIT_OVERFLOW_CNT"})
+      for (int link = 0; link < 2; ++link) {
+        cat.keys.push_back(stdsprintf("LINK%i_%s", link, counter));
+        cat.labels.push_back(stdsprintf("link=\"%i\",counter=\"%s\"", link, counter));
+      }
+    return cat;
+  }
+
+  SampledCategory makeGBTLinkCategory()
+  {
+    SampledCategory cat {moncat::GBTLINK, "GBTLINK", "ctp7_gbt_link_status", "GBT link status flag", {}, {}, readGBTLinks};
+    for (auto const& flag : {"READY", "WAS_NOT_READY", "RX_HAD_OVERFLOW", "RX_HAD_UNDERFLOW"})
+      for (unsigned int gbtN = 0; gbtN < gbt::GBTS_PER_OH; ++gbtN) {
+        cat.keys.push_back(stdsprintf("GBT%i.%s", gbtN, flag));
+        cat.labels.push_back(stdsprintf("gbt=\"%i\",flag=\"%s\"", gbtN, flag));
+      }
+    return cat;
+  }
+
+  SampledCategory makeVFATLinkCategory()
+  {
+    SampledCategory cat {moncat::VFATLINK, "VFATLINK", "ctp7_vfat_link_counter", "VFAT link counter", {}, {}, readVFATLinks};
+    for (auto const& counter : {"SYNC_ERR_CNT", "DAQ_EVENT_CNT", "DAQ_CRC_ERROR_CNT"})
+      for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+        cat.keys.push_back(stdsprintf("VFAT%i.%s", vfatN, counter));
+        cat.labels.push_back(stdsprintf("vfat=\"%i\",counter=\"%s\"", vfatN, counter));
+      }
+    return cat;
+  }
+
+  const std::array<SampledCategory, N_SAMPLED_CATEGORIES> SAMPLED_CATEGORIES {{
+      makeScaCategory(),
+      makeSysmonCategory(),
+      makeTriggerLinkCategory(),
+      makeGBTLinkCategory(),
+      makeVFATLinkCategory(),
+    }};
+
+  constexpr uint32_t SAMPLED_CATEGORIES_MASK = moncat::OHSCA | moncat::OHSYSMON | moncat::TRIGGEROH | moncat::GBTLINK | moncat::VFATLINK;
+
+  /*!
+   * \brief Cached values of one category for one OH
+   */
+  struct SampledValues {
+    uint64_t timestamp; ///< CLOCK_MONOTONIC time of the sample in ns, 0 if never sampled
+    uint32_t values[SAMPLER_MAX_VALUES];
+  };
+
+  /*!
+   * \brief Layout of the shared memory file
+   */
+  struct SamplerState {
+    uint32_t version;
+    uint32_t enabled;
+    uint32_t categories;
+    uint32_t cadenceMs;
+    uint32_t ohMask;
+    uint32_t nextOH;
+    pid_t    owner;     ///< PID of the sampler worker process, 0 if none
+    uint64_t heartbeat; ///< CLOCK_MONOTONIC time of the start or of the last sample of the worker
+    uint32_t atGeneration; ///< Address table generation the cached values were read with
+    char     exportPath[SAMPLER_PATH_SIZE]; ///< OpenMetrics export file, empty if the export is disabled
+    SampledValues cache[amc::OH_PER_AMC][N_SAMPLED_CATEGORIES];
+  };
+
+  SamplerState* state = nullptr;
+  int samplerLockID   = -1;
+  std::mutex samplerMutex; ///< the named lock does not exclude the threads of a process from each other
+
+  /*!
+   * \brief Scoped lock held while accessing the shared state, excludes both other processes and other threads
+   */
+  class SamplerLock {
+  public:
+    SamplerLock() : m_guard(samplerMutex) { namedlock_lock(samplerLockID); }
+    ~SamplerLock() { namedlock_unlock(samplerLockID); }
+  private:
+    std::lock_guard<std::mutex> m_guard;
+  };
+
+  /*!
+   * \brief Maps the shared state, creating and initializing it if needed
+   */
+  SamplerState* mapSamplerState()
+  {
+    if (state)
+      return state;
+
+    if (samplerLockID < 0)
+      samplerLockID = namedlock_init("daq_monitor", "sampler");
+    if (samplerLockID < 0) {
+      LOGGER->log_message(LogManager::ERROR, "Unable to initialize the sampler lock");
+      return nullptr;
+    }
+
+    int fd = open(SAMPLER_SHM_FILE, O_RDWR|O_CREAT, 0664);
+    if (fd < 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to open %s: %s", SAMPLER_SHM_FILE, strerror(errno)));
+      return nullptr;
+    }
+    if (ftruncate(fd, sizeof(SamplerState)) != 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to resize %s: %s", SAMPLER_SHM_FILE, strerror(errno)));
+      close(fd);
+      return nullptr;
+    }
+    void* addr = mmap(nullptr, sizeof(SamplerState), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to map %s: %s", SAMPLER_SHM_FILE, strerror(errno)));
+      return nullptr;
+    }
+
+    SamplerState* st = static_cast<SamplerState*>(addr);
+    std::lock_guard<std::mutex> guard(samplerMutex);
+    namedlock_lock(samplerLockID);
+    if (st->version != SAMPLER_STATE_VERSION) {
+      std::memset(st, 0, sizeof(SamplerState));
+      st->version    = SAMPLER_STATE_VERSION;
+      st->enabled    = 0;
+      st->categories = moncat::OHSCA | moncat::OHSYSMON;
+      st->cadenceMs  = 1000;
+      st->ohMask     = 0xfff;
+    }
+    namedlock_unlock(samplerLockID);
+    state = st;
+    return state;
+  }
+
+  /*!
+   * \brief Reads the requested categories of one OH and stores them in the cache
+   */
+  void sampleOH(int ohN, uint32_t categories)
+  {
+    RPCMsg scratch("sampler");
+    RPCMsg* response = &scratch;
+    GETLOCALARGS(response);
+
+    // Values read with a previous address table may not mean anything anymore
+    uint32_t generation = getAddressTableGeneration(&la);
+    {
+      SamplerLock lock;
+      if (state->atGeneration != generation) {
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Address table generation changed from %u to %u, clearing the monitoring cache",
+                                                         state->atGeneration, generation));
+        std::memset(state->cache, 0, sizeof(state->cache));
+        state->atGeneration = generation;
+      }
+    }
+
+    for (size_t catIdx = 0; catIdx < SAMPLED_CATEGORIES.size(); ++catIdx) {
+      auto const& cat = SAMPLED_CATEGORIES.at(catIdx);
+      if (!(categories & cat.category))
+        continue;
+
+      SampledValues sample;
+      cat.read(&la, ohN);
+      sample.timestamp = monotonicNs();
+      for (size_t i = 0; i < cat.keys.size(); ++i) {
+        std::string key = stdsprintf("OH%i.%s", ohN, cat.keys[i].c_str());
+        sample.values[i] = scratch.get_key_exists(key) ? scratch.get_word(key) : 0xdeaddead;
+      }
+
+      SamplerLock lock;
+      state->cache[ohN][catIdx] = sample;
+      state->heartbeat = sample.timestamp;
+    }
+    rtxn.abort();
+  }
+
+  /*!
+   * \brief Writes the cache in the OpenMetrics text format
+   * \details The file is written next to the target and renamed, so that a scraper never sees a partial file
+   */
+  void exportMetrics(SamplerState const& snapshot)
+  {
+    const std::string path(snapshot.exportPath);
+    const std::string tmpPath = path + ".tmp";
+    const uint64_t now = monotonicNs();
+
+    std::ostringstream out;
+
+    for (size_t catIdx = 0; catIdx < SAMPLED_CATEGORIES.size(); ++catIdx) {
+      auto const& cat = SAMPLED_CATEGORIES.at(catIdx);
+      if (!(snapshot.categories & cat.category))
+        continue;
+      out << "# HELP " << cat.metric << " " << cat.help << "\n"
+          << "# TYPE " << cat.metric << " gauge\n";
+      for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        SampledValues const& sample = snapshot.cache[ohN][catIdx];
+        if (!sample.timestamp)
+          continue;
+        for (size_t i = 0; i < cat.keys.size(); ++i) {
+          if (sample.values[i] == 0xdeaddead)
+            continue;
+          out << cat.metric << "{oh=\"" << ohN << "\"," << cat.labels[i] << "} " << sample.values[i] << "\n";
+        }
+      }
+    }
+
+    out << "# HELP ctp7_sample_age_seconds Age of the cached sample\n"
+        << "# TYPE ctp7_sample_age_seconds gauge\n";
+    for (size_t catIdx = 0; catIdx < SAMPLED_CATEGORIES.size(); ++catIdx) {
+      auto const& cat = SAMPLED_CATEGORIES.at(catIdx);
+      if (!(snapshot.categories & cat.category))
+        continue;
+      for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        SampledValues const& sample = snapshot.cache[ohN][catIdx];
+        if (sample.timestamp)
+          out << "ctp7_sample_age_seconds{oh=\"" << ohN << "\",category=\"" << cat.name << "\"} "
+              << (now - sample.timestamp)*1e-9 << "\n";
+      }
+    }
+    out << "# EOF\n";
+
+    int fd = openDataFile(tmpPath, O_WRONLY|O_CREAT|O_TRUNC);
+    if (fd < 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to write the metrics file %s: %s", tmpPath.c_str(), strerror(errno)));
+      return;
+    }
+    const std::string text = out.str();
+    bool written = write(fd, text.data(), text.size()) == ssize_t(text.size());
+    written = (close(fd) == 0) && written;
+
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to update the metrics file %s: %s", path.c_str(), strerror(errno)));
+      unlink(tmpPath.c_str());
+    }
+  }
+
+  /*!
+   * \brief Time after which a worker that did not take a sample is considered hung
+   */
+  uint64_t samplerTimeoutNs(uint32_t tickMs)
+  {
+    return std::max(uint64_t(5)*tickMs*1000000, SAMPLER_MIN_TIMEOUT_NS);
+  }
+
+  /*!
+   * \brief Time between two OH refreshes, must be called with the lock held
+   */
+  uint32_t samplerTickMs(uint32_t ohMask)
+  {
+    return std::max(state->cadenceMs/__builtin_popcount(ohMask), SAMPLER_MIN_TICK_MS);
+  }
+
+  /*!
+   * \brief Mask of the sampled OHs, must be called with the lock held
+   */
+  uint32_t sampledOHMask()
+  {
+    return state->ohMask & (0xfff >> (NOH_MAX-amc::OH_PER_AMC));
+  }
+
+  /*!
+   * \brief Main loop of the sampler worker process, one OH is refreshed per tick
+   * \details Returns when the sampler is disabled, or when another worker replaced this one
+   */
+  void samplerLoop()
+  {
+    const pid_t self = getpid();
+    {
+      SamplerLock lock;
+      state->owner     = self;
+      state->heartbeat = monotonicNs();
+    }
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Monitoring sampler started in process %i", self));
+
+    while (true) {
+      int ohN = -1;
+      uint32_t categories = 0;
+      uint32_t tickMs     = 0;
+      bool lastOfCycle    = false;
+      {
+        SamplerLock lock;
+        uint32_t ohMask = sampledOHMask();
+        if (state->owner != self) {
+          LOGGER->log_message(LogManager::INFO, stdsprintf("Monitoring sampler process %i replaced by process %i", self, state->owner));
+          return;
+        }
+        if (!state->enabled || !ohMask) {
+          LOGGER->log_message(LogManager::INFO, stdsprintf("Monitoring sampler disabled, process %i exits", self));
+          state->owner = 0;
+          return;
+        }
+        tickMs = samplerTickMs(ohMask);
+
+        // Stagger: next unmasked OH after the last sampled one
+        ohN = state->nextOH % amc::OH_PER_AMC;
+        while (!((ohMask >> ohN) & 0x1))
+          ohN = (ohN+1) % amc::OH_PER_AMC;
+        state->nextOH = ohN+1;
+        categories    = state->categories;
+        lastOfCycle   = !(ohMask >> (ohN+1));
+      }
+
+      try {
+        sampleOH(ohN, categories);
+      } catch (const std::exception& e) {
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("Monitoring sampler failed on OH%i: %s", ohN, e.what()));
+      }
+
+      // Export once per full cycle over the OHs
+      if (lastOfCycle) {
+        std::unique_ptr<SamplerState> snapshot(new SamplerState);
+        {
+          SamplerLock lock;
+          std::memcpy(snapshot.get(), state, sizeof(SamplerState));
+        }
+        if (snapshot->exportPath[0])
+          exportMetrics(*snapshot);
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(tickMs));
+    }
+  }
+}
+
+void startMonitorSampler()
+{
+  if (!mapSamplerState()) {
+    LOGGER->log_message(LogManager::ERROR, "Monitoring sampler not started");
+    return;
+  }
+
+  {
+    SamplerLock lock;
+    uint32_t ohMask = sampledOHMask();
+    if (!state->enabled || !ohMask)
+      return;
+    // owner is 0 while a worker is starting
+    const uint64_t now = monotonicNs();
+    if ((!state->owner || processAlive(state->owner)) && (now - state->heartbeat) < samplerTimeoutNs(samplerTickMs(ohMask)))
+      return;
+    if (state->owner)
+      LOGGER->log_message(LogManager::WARNING, stdsprintf("Monitoring sampler process %i stopped sampling, starting a new one", state->owner));
+    state->owner     = 0;
+    state->heartbeat = now;
+  }
+
+  // A worker exits as soon as another one claimed the ownership, so at most one keeps sampling
+  if (!startWorker(samplerLoop))
+    LOGGER->log_message(LogManager::ERROR, "Unable to start the monitoring sampler process");
+}
+
+void configureMonitorSamplerLocal(localArgs* la, bool enable, uint32_t categories, uint32_t cadenceMs, uint32_t ohMask, std::string const& exportPath)
+{
+  if (!mapSamplerState()) {
+    la->response->set_string("error", "Monitoring sampler shared state not available");
+    return;
+  }
+  if (exportPath.size() >= SAMPLER_PATH_SIZE) {
+    la->response->set_string("error", stdsprintf("Export path longer than %d characters", SAMPLER_PATH_SIZE-1));
+    return;
+  }
+  if (!exportPath.empty() && !allowedDataPath(exportPath)) {
+    la->response->set_string("error", stdsprintf("Export path %s not allowed, it must be below /mnt/persistent/, /dev/shm/ or /tmp/", exportPath.c_str()));
+    return;
+  }
+
+  {
+    SamplerLock lock;
+    state->enabled    = enable;
+    state->categories = categories & SAMPLED_CATEGORIES_MASK;
+    state->cadenceMs  = cadenceMs;
+    state->ohMask     = ohMask;
+    std::strncpy(state->exportPath, exportPath.c_str(), SAMPLER_PATH_SIZE);
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Monitoring sampler %s, categories 0x%x, cadence %d ms, ohMask 0x%x, export path '%s'",
+                                                     enable ? "enabled" : "disabled", state->categories, cadenceMs, ohMask, state->exportPath));
+  }
+  startMonitorSampler();
+}
+
+void getmonCachedLocal(localArgs* la, uint32_t categories, int NOH, int ohMask)
+{
+  if (!mapSamplerState()) {
+    la->response->set_string("error", "Monitoring sampler shared state not available");
+    return;
+  }
+
+  // Restarts the worker if it went away
+  startMonitorSampler();
+
+  std::unique_ptr<SamplerState> copy(new SamplerState);
+  {
+    SamplerLock lock;
+    std::memcpy(copy.get(), state, sizeof(SamplerState));
+  }
+  SamplerState const& snapshot = *copy;
+  const uint64_t now = monotonicNs();
+
+  if (NOH > static_cast<int>(amc::OH_PER_AMC)) NOH = amc::OH_PER_AMC;
+  for (size_t catIdx = 0; catIdx < SAMPLED_CATEGORIES.size(); ++catIdx) {
+    auto const& cat = SAMPLED_CATEGORIES.at(catIdx);
+    if (!(categories & cat.category))
+      continue;
+
+    for (int ohN = 0; ohN < NOH; ++ohN) {
+      SampledValues const& sample = snapshot.cache[ohN][catIdx];
+      bool valid = ((ohMask >> ohN) & 0x1) && sample.timestamp;
+      uint32_t age = valid ? std::min<uint64_t>((now - sample.timestamp)/1000000, 0xfffffffe) : 0xffffffff;
+      for (size_t i = 0; i < cat.keys.size(); ++i) {
+        std::string key = stdsprintf("OH%i.%s", ohN, cat.keys[i].c_str());
+        la->response->set_word(key, valid ? sample.values[i] : 0xdeaddead);
+        la->response->set_word(key+".AGE_MS", age);
+      }
+    }
+  }
+  la->response->set_word("SAMPLER.ENABLED", snapshot.enabled);
+  la->response->set_word("SAMPLER.CADENCE_MS", snapshot.cadenceMs);
+}
+
+void configureMonitorSampler(const RPCMsg *request, RPCMsg *response)
+{
+  GETLOCALARGS(response);
+
+  bool enable = request->get_word("enable");
+  uint32_t categories = moncat::OHSCA | moncat::OHSYSMON;
+  if (request->get_key_exists("categories")) {
+    categories = request->get_word("categories");
+  }
+  uint32_t cadenceMs = 1000;
+  if (request->get_key_exists("cadenceMs")) {
+    cadenceMs = request->get_word("cadenceMs");
+  }
+  uint32_t ohMask = 0xfff;
+  if (request->get_key_exists("ohMask")) {
+    ohMask = request->get_word("ohMask");
+  }
+
+  std::string exportPath;
+  if (request->get_key_exists("exportPath")) {
+    exportPath = request->get_string("exportPath");
+  }
+
+  configureMonitorSamplerLocal(&la, enable, categories, cadenceMs, ohMask, exportPath);
+  rtxn.abort();
+}
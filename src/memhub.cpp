@@ -65,6 +65,33 @@ int memhub_write(memsvc_handle_t handle, uint32_t addr, uint32_t words, const ui
     return ret;
 }
 
+int memhub_write_list(memsvc_handle_t handle, uint32_t n, const uint32_t *addrs, const uint32_t *data) {
+    int ret = 0;
+    sem_wait(semaphore);
+    busy = true;
+    for (uint32_t i = 0; i < n && ret == 0; ++i)
+        ret = memsvc_write(handle, addrs[i], 1, &data[i]);
+    sem_post(semaphore);
+    busy = false;
+    return ret;
+}
+
+int memhub_read_list(memsvc_handle_t handle, uint32_t n, const uint32_t *addrs, uint32_t *data) {
+    int ret = 0;
+    sem_wait(semaphore);
+    busy = true;
+    for (uint32_t i = 0; i < n && ret == 0;) {
+        uint32_t run = 1;
+        while (i + run < n && addrs[i+run] == addrs[i] + 4*run)
+            ++run;
+        ret = memsvc_read(handle, addrs[i], run, &data[i]);
+        i += run;
+    }
+    sem_post(semaphore);
+    busy = false;
+    return ret;
+}
+
 void die(int signo) {
     int semval = 0;
     sem_getvalue(semaphore, &semval);
@@ -2,7 +2,7 @@
 #include "optohybrid.h"
 
 void broadcastWriteLocal(localArgs * la, uint32_t ohN, std::string regName, uint32_t value, uint32_t mask) {
-  uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+  uint32_t fw_maj = getFirmwareIdentity(la).releaseMajor;
   if (fw_maj == 1) {
     char regBase [100];
     sprintf(regBase, "GEM_AMC.OH.OH%i.GEB.Broadcast",ohN);
@@ -53,7 +53,7 @@ void broadcastWrite(const RPCMsg *request, RPCMsg *response) {
 }
 
 void broadcastReadLocal(localArgs * la, uint32_t * outData, uint32_t ohN, std::string regName, uint32_t mask) {
-  uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+  uint32_t fw_maj = getFirmwareIdentity(la).releaseMajor;
   char regBase [100];
   if (fw_maj == 1) {
     sprintf(regBase,"GEM_AMC.OH.OH%i.GEB.VFATS.VFAT",ohN);
@@ -498,7 +498,7 @@ void getUltraScanResults(const RPCMsg *request, RPCMsg *response){
 
 void stopCalPulse2AllChannelsLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch_min, uint32_t ch_max){
     //Get FW release
-    uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+    uint32_t fw_maj = getFirmwareIdentity(la).releaseMajor;
 
     if (fw_maj == 1) {
         uint32_t trimVal=0;
@@ -514,12 +514,37 @@ void stopCalPulse2AllChannelsLocal(localArgs *la, uint32_t ohN, uint32_t mask, u
             }
         }
     } else if (fw_maj == 3) {
+        //Read the channel registers of each VFAT at once and write back only the words with the calpulse enabled, all VFATs in one transaction
+        std::vector<uint32_t> addrs, words, writeAddrs, writeWords;
         for (int vfatN = 0; vfatN < 24; vfatN++) {
             if ((mask >> vfatN) & 0x1) continue; //skip masked VFATs
+            addrs.clear();
+            uint32_t enableBits = 0;
             for (uint32_t chan=ch_min; chan<=ch_max; ++chan) {
-                writeReg(la, stdsprintf("GEM_AMC.OH.OH%d.GEB.VFAT%d.VFAT_CHANNELS.CHANNEL%d.CALPULSE_ENABLE", ohN, vfatN, chan), 0x0);
+                if (chan>127) {
+                    LOGGER->log_message(LogManager::ERROR, stdsprintf("OH %d: Chan %d greater than possible chan_max %d",ohN,chan,127));
+                    break;
+                }
+                RegHandle reg = getRegHandle(la, stdsprintf("GEM_AMC.OH.OH%d.GEB.VFAT%d.VFAT_CHANNELS.CHANNEL%d.CALPULSE_ENABLE", ohN, vfatN, chan));
+                if (reg.address == 0xdeaddead) {
+                    la->response->set_string("error", stdsprintf("Unable to resolve the channel registers of OH%d VFAT%d",ohN,vfatN));
+                    return;
+                }
+                addrs.push_back(reg.address);
+                enableBits = reg.mask;
+            }
+            if (addrs.empty()) continue;
+
+            words.resize(addrs.size());
+            readAddressList(addrs.data(), words.data(), addrs.size(), la->response);
+            for (size_t idx = 0; idx < addrs.size(); ++idx) {
+                if (words[idx] == 0xdeaddead || !(words[idx] & enableBits)) continue;
+                writeAddrs.push_back(addrs[idx]);
+                writeWords.push_back(words[idx] & ~enableBits);
             }
         }
+        if (!writeAddrs.empty())
+            writeAddressList(writeAddrs.data(), writeWords.data(), writeAddrs.size(), la->response);
     } else {
         LOGGER->log_message(LogManager::ERROR, stdsprintf("Unexpected value for system release major: %i",fw_maj));
     }
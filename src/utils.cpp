@@ -1,4 +1,13 @@
 #include "utils.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <time.h>
 
 memsvc_handle_t memsvc;
 
@@ -58,6 +67,25 @@ void update_address_table(const RPCMsg *request, RPCMsg *response)
   m_parsed_at.erase("top");
   xhal::utils::Node t_node;
 
+  // Bump the generation of the old DB, or seed it from the time if there is none
+  uint32_t generation = time(NULL);
+  try {
+    auto oldEnv = lmdb::env::create();
+    oldEnv.set_mapsize(LMDB_SIZE);
+    oldEnv.open(lmdb_area_file.c_str(), MDB_RDONLY, 0664);
+    auto oldTxn = lmdb::txn::begin(oldEnv, nullptr, MDB_RDONLY);
+    auto oldDbi = lmdb::dbi::open(oldTxn, nullptr);
+    LocalArgs oldLa = {.rtxn     = oldTxn,
+                       .dbi      = oldDbi,
+                       .response = response};
+    uint32_t oldGeneration = getAddressTableGeneration(&oldLa);
+    if (oldGeneration)
+      generation = oldGeneration + 1;
+    oldTxn.abort();
+  } catch (const lmdb::error& e) {
+    LOGGER->log_message(LogManager::INFO, stdsprintf("No previous address table generation found: %s", e.what()));
+  }
+
   // Remove old DB
   LOGGER->log_message(LogManager::INFO, "REMOVE OLD DB");
   std::remove(lmdb_data_file.c_str());
@@ -86,11 +114,27 @@ void update_address_table(const RPCMsg *request, RPCMsg *response)
     value.assign(t_value);
     dbi.put(wtxn, key, value);
   }
+  key.assign(AT_GENERATION_KEY);
+  value.assign(stdsprintf("%x", generation));
+  dbi.put(wtxn, key, value);
   wtxn.commit();
+  LOGGER->log_message(LogManager::INFO, stdsprintf("ADDRESS TABLE GENERATION %u", generation));
   LOGGER->log_message(LogManager::INFO, "COMMIT DB");
   wtxn.abort();
 }
 
+uint32_t getAddressTableGeneration(localArgs * la)
+{
+  lmdb::val key, db_res;
+  key.assign(AT_GENERATION_KEY);
+  if (la->dbi.get(la->rtxn,key,db_res)) {
+    std::string t_db_res = std::string(db_res.data());
+    t_db_res = t_db_res.substr(0,db_res.size());
+    return stoull(t_db_res, nullptr, 16);
+  }
+  return 0;
+}
+
 void readRegFromDB(const RPCMsg *request, RPCMsg *response)
 {
   std::string regName = request->get_string("reg_name");
@@ -501,3 +545,225 @@ extern "C" {
     modmgr->register_method("utils", "readRegFromDB",        readRegFromDB);
   }
 }
+
+namespace {
+  // Resolves a register without reporting an error if it is absent
+  bool lookupRegHandle(localArgs * la, const std::string & regName, RegHandle & reg)
+  {
+    lmdb::val key, db_res;
+    key.assign(regName.c_str());
+    if (!la->dbi.get(la->rtxn,key,db_res))
+      return false;
+    std::string t_db_res = std::string(db_res.data());
+    t_db_res = t_db_res.substr(0,db_res.size());
+    std::vector<std::string> tmp = split(t_db_res,'|');
+    reg.address = stoull(tmp[0], nullptr, 16);
+    reg.mask    = stoull(tmp[2], nullptr, 16);
+    return true;
+  }
+}
+
+RegHandle getRegHandle(localArgs * la, const std::string & regName)
+{
+  RegHandle reg;
+  if (!lookupRegHandle(la, regName, reg)) {
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
+    la->response->set_string("error", "Register not found");
+  }
+  return reg;
+}
+
+uint32_t readRegHandle(const RegHandle & reg, RPCMsg *response)
+{
+  if (reg.address == 0xdeaddead)
+    return 0xdeaddead;
+  uint32_t data = readRawAddress(reg.address, response);
+  if (data == 0xdeaddead || reg.mask == 0xFFFFFFFF)
+    return data;
+  return applyMask(data, reg.mask);
+}
+
+void writeRegHandle(const RegHandle & reg, uint32_t value, RPCMsg *response)
+{
+  if (reg.address == 0xdeaddead) {
+    response->set_string("error", "Write to an unresolved register");
+    return;
+  }
+  if (reg.mask == 0xFFFFFFFF) {
+    writeRawAddress(reg.address, value, response);
+    return;
+  }
+  uint32_t current_value = readRawAddress(reg.address, response);
+  if (current_value == 0xdeaddead) {
+    std::stringstream errmsg;
+    errmsg << "Writing masked register failed due to problem reading: 0x" << std::hex << reg.address;
+    response->set_string("error", errmsg.str());
+    LOGGER->log_message(LogManager::ERROR, errmsg.str().c_str());
+    return;
+  }
+  uint32_t val_to_write = (value << __builtin_ctz(reg.mask)) & reg.mask;
+  writeRawAddress(reg.address, val_to_write | (current_value & ~reg.mask), response);
+}
+
+void readAddressList(const uint32_t * addrs, uint32_t * result, size_t n, RPCMsg *response)
+{
+  if (n == 0)
+    return;
+  // The address table holds AXI byte addresses, the block reads count 32-bit words.
+  // The list is read in address order, so that the contiguous runs inside it are read as blocks and only listed registers are touched
+  std::vector<uint32_t> order(n);
+  for (size_t i = 0; i < n; ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [addrs](uint32_t a, uint32_t b) { return addrs[a] < addrs[b]; });
+  std::vector<uint32_t> sorted(n), words(n);
+  for (size_t i = 0; i < n; ++i)
+    sorted[i] = addrs[order[i]];
+  if (memhub_read_list(memsvc, n, sorted.data(), words.data()) == 0) {
+    for (size_t i = 0; i < n; ++i)
+      result[order[i]] = words[i];
+    return;
+  }
+  LOGGER->log_message(LogManager::ERROR, stdsprintf("read list memsvc error: %s, falling back to single reads", memsvc_get_last_error(memsvc)));
+  for (size_t i = 0; i < n; ++i)
+    result[i] = readRawAddress(addrs[i], response);
+}
+
+void writeAddressList(const uint32_t * addrs, const uint32_t * values, size_t n, RPCMsg *response)
+{
+  if (memhub_write_list(memsvc, n, addrs, values) != 0) {
+    response->set_string("error", std::string("memsvc error: ")+memsvc_get_last_error(memsvc));
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("write list memsvc error: %s", memsvc_get_last_error(memsvc)));
+  }
+}
+
+bool logLevelEnabled(LogManager::LogLevel level)
+{
+  return level <= LOGGER->get_output_level();
+}
+
+namespace {
+  // The identity together with the raw release words it was read with
+  struct firmwareIdentityEntry {
+    firmwareIdentity identity;
+    std::vector<uint32_t> releaseAddrs;
+    std::vector<uint32_t> releaseWords;
+    bool complete = true; ///< false if a register of the address table could not be read
+  };
+
+  std::mutex fwIdentityMutex; ///< guards the cache and the check time, callers get a copy of the identity
+  ATGenerationCache<firmwareIdentityEntry> fwIdentityCache;
+  std::chrono::steady_clock::time_point fwIdentityCheckTime; ///< last time the release words were read
+
+  firmwareIdentityEntry readFirmwareIdentity(localArgs * la)
+  {
+    firmwareIdentityEntry entry;
+    firmwareIdentity & id = entry.identity;
+    const std::pair<const char*, uint32_t*> regs[] = {
+      {"GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR",            &id.releaseMajor},
+      {"GEM_AMC.GEM_SYSTEM.RELEASE.MINOR",            &id.releaseMinor},
+      {"GEM_AMC.GEM_SYSTEM.RELEASE.BUILD",            &id.releaseBuild},
+      {"GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH",         &id.numOfOH},
+      {"GEM_AMC.CONFIG_BLASTER.STATUS.GBT_RAM_SIZE",  &id.gbtRAMSize},
+      {"GEM_AMC.CONFIG_BLASTER.STATUS.OH_RAM_SIZE",   &id.ohRAMSize},
+      {"GEM_AMC.CONFIG_BLASTER.STATUS.VFAT_RAM_SIZE", &id.vfatRAMSize},
+    };
+    const size_t nRelease = 3;
+
+    for (size_t i = 0; i < sizeof(regs)/sizeof(regs[0]); ++i) {
+      RegHandle reg;
+      if (!lookupRegHandle(la, regs[i].first, reg))
+        continue;
+      uint32_t data = readRawAddress(reg.address, la->response);
+      *regs[i].second = (data == 0xdeaddead) ? data : applyMask(data, reg.mask);
+      entry.complete &= (data != 0xdeaddead);
+      if (i < nRelease) {
+        entry.releaseAddrs.push_back(reg.address);
+        entry.releaseWords.push_back(data);
+      }
+    }
+    fwIdentityCheckTime = std::chrono::steady_clock::now();
+
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Firmware release %u.%u.%u, NUM_OF_OH %u, BLASTER RAM sizes GBT %u OH %u VFAT %u",
+                                                     id.releaseMajor, id.releaseMinor, id.releaseBuild, id.numOfOH,
+                                                     id.gbtRAMSize, id.ohRAMSize, id.vfatRAMSize));
+    return entry;
+  }
+
+  // An identity with a failed read is returned to the caller only, the next call reads it again
+  firmwareIdentity uncachedIfIncomplete(firmwareIdentityEntry const& entry)
+  {
+    const firmwareIdentity identity = entry.identity;
+    if (!entry.complete)
+      fwIdentityCache.invalidate();
+    return identity;
+  }
+}
+
+firmwareIdentity getFirmwareIdentity(localArgs * la)
+{
+  std::lock_guard<std::mutex> guard(fwIdentityMutex);
+  firmwareIdentityEntry const& entry = fwIdentityCache.get(la, readFirmwareIdentity);
+  if (!entry.complete)
+    return uncachedIfIncomplete(entry);
+
+  const auto now = std::chrono::steady_clock::now();
+  if (now - fwIdentityCheckTime < std::chrono::milliseconds(FW_IDENTITY_RECHECK_MS))
+    return entry.identity;
+
+  std::vector<uint32_t> words(entry.releaseAddrs.size());
+  readAddressList(entry.releaseAddrs.data(), words.data(), words.size(), la->response);
+  if (words != entry.releaseWords) {
+    LOGGER->log_message(LogManager::INFO, "Firmware release registers changed, reading the firmware identity again");
+    fwIdentityCache.invalidate();
+    return uncachedIfIncomplete(fwIdentityCache.get(la, readFirmwareIdentity));
+  }
+  fwIdentityCheckTime = now;
+  return entry.identity;
+}
+
+void invalidateFirmwareIdentity()
+{
+  std::lock_guard<std::mutex> guard(fwIdentityMutex);
+  fwIdentityCache.invalidate();
+}
+
+namespace {
+  const char* const DATA_FILE_DIRS[] = {"/mnt/persistent/", "/dev/shm/", "/tmp/"};
+
+  // Returns true if path starts with one of the allowed directories, and names something below it
+  bool inDataDir(const std::string & path)
+  {
+    for (auto dir : DATA_FILE_DIRS)
+      if (path.compare(0, strlen(dir), dir) == 0 && path.size() > strlen(dir))
+        return true;
+    return false;
+  }
+}
+
+bool allowedDataPath(const std::string & path)
+{
+  if (path.find("..") != std::string::npos || !inDataDir(path))
+    return false;
+
+  // The allowed directories may themselves be symbolic links, compare against their resolved form
+  const std::string parent = path.substr(0, path.find_last_of('/'));
+  char resolved[PATH_MAX];
+  if (!realpath(parent.c_str(), resolved))
+    return false;
+  const std::string resolvedParent = std::string(resolved) + "/";
+  for (auto dir : DATA_FILE_DIRS) {
+    char resolvedDir[PATH_MAX];
+    if (realpath(dir, resolvedDir) && resolvedParent.compare(0, strlen(resolvedDir)+1, std::string(resolvedDir)+"/") == 0)
+      return true;
+  }
+  return false;
+}
+
+int openDataFile(const std::string & path, int flags, mode_t mode)
+{
+  if (!allowedDataPath(path)) {
+    errno = EACCES;
+    return -1;
+  }
+  return open(path.c_str(), flags|O_NOFOLLOW, mode);
+}
@@ -0,0 +1,67 @@
+/*! \file utils/worker.cpp
+ *  \brief Detached worker processes of the long running RPC methods
+ */
+
+#include "utils/worker.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+uint64_t monotonicNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+}
+
+bool processAlive(pid_t pid)
+{
+  return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+void closeInheritedSockets()
+{
+  std::vector<int> sockets;
+  if (DIR *dir = opendir("/proc/self/fd")) {
+    while (struct dirent *entry = readdir(dir)) {
+      int fd = atoi(entry->d_name);
+      struct stat st;
+      if (fd > 2 && fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode))
+        sockets.push_back(fd);
+    }
+    closedir(dir);
+  }
+  for (int fd : sockets)
+    close(fd);
+}
+
+bool startWorker(const std::function<void()> & body, const std::function<void(pid_t)> & started)
+{
+  // Double fork, so that the worker is neither a child of the client process nor dies with it
+  pid_t pid = fork();
+  if (pid == 0) {
+    setsid();
+    pid_t worker = fork();
+    if (worker == 0) {
+      closeInheritedSockets();
+      signal(SIGPIPE, SIG_IGN);
+      body();
+      _exit(0);
+    }
+    if (worker > 0 && started)
+      started(worker);
+    _exit(worker > 0 ? 0 : 1);
+  }
+
+  int childStatus = 1;
+  if (pid > 0)
+    waitpid(pid, &childStatus, 0);
+  return pid > 0 && WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == 0;
+}
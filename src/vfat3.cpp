@@ -14,20 +14,134 @@
 #include "reedmuller.h"
 #include <iomanip>
 #include <memory>
+#include <array>
+#include "hw_constants.h"
+
+namespace {
+    /*!
+     * \brief LINK_GOOD and SYNC_ERR_CNT registers of the 24 VFATs of one OH, interleaved
+     */
+    struct vfatLinkRegs {
+        bool valid = false;
+        std::array<uint32_t, 2*oh::VFATS_PER_OH> addrs;
+        std::array<uint32_t, 2*oh::VFATS_PER_OH> masks;
+    };
+
+    std::array<ATGenerationCache<vfatLinkRegs>, amc::OH_PER_AMC> vfatLinkRegCache;
+
+    vfatLinkRegs const& getVFATLinkRegs(localArgs * la, uint32_t ohN)
+    {
+        return vfatLinkRegCache[ohN].get(la, [ohN](localArgs * la) {
+                vfatLinkRegs regs;
+                regs.valid = true;
+                for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+                    RegHandle linkGood = getRegHandle(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT%i.LINK_GOOD",ohN,vfatN));
+                    RegHandle syncErr  = getRegHandle(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT%i.SYNC_ERR_CNT",ohN,vfatN));
+                    regs.addrs[2*vfatN]   = linkGood.address;
+                    regs.masks[2*vfatN]   = linkGood.mask;
+                    regs.addrs[2*vfatN+1] = syncErr.address;
+                    regs.masks[2*vfatN+1] = syncErr.mask;
+                    regs.valid &= (linkGood.address != 0xdeaddead) && (syncErr.address != 0xdeaddead);
+                }
+                return regs;
+            });
+    }
+
+    /*!
+     * \brief Sync status of the OHs, used only while a VFATSyncCacheScope is alive
+     */
+    struct vfatSyncCacheState {
+        unsigned int depth = 0;
+        std::chrono::microseconds validity{0};
+        std::array<bool, amc::OH_PER_AMC> valid{};
+        std::array<std::chrono::steady_clock::time_point, amc::OH_PER_AMC> readTime;
+        std::array<uint32_t, amc::OH_PER_AMC> goodVFATs{};
+    } vfatSyncCache;
+}
+
+VFATSyncCacheScope::VFATSyncCacheScope(uint32_t validity)
+{
+    //Nested scopes keep the window of the outermost one
+    if (vfatSyncCache.depth++ == 0) {
+        vfatSyncCache.validity = std::chrono::microseconds(validity);
+        vfatSyncCache.valid.fill(false);
+    }
+}
+
+VFATSyncCacheScope::VFATSyncCacheScope(const RPCMsg *request) :
+    VFATSyncCacheScope(request->get_key_exists("syncCacheValidity") ? request->get_word("syncCacheValidity") : VFAT_SYNC_CACHE_DEFAULT_US)
+{
+}
+
+VFATSyncCacheScope::~VFATSyncCacheScope()
+{
+    if (--vfatSyncCache.depth == 0)
+        vfatSyncCache.valid.fill(false);
+}
+
+void vfatSyncCheckMultiLinkLocal(localArgs * la, uint32_t ohMask, uint32_t * goodVFATs)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const bool useCache = (vfatSyncCache.depth > 0);
+
+    //Collect the registers of the OHs not found in the cache and read them all at once
+    std::vector<uint32_t> ohList, addrs;
+    for (uint32_t ohN = 0; ohN < amc::OH_PER_AMC; ++ohN) {
+        goodVFATs[ohN] = 0;
+        if (!((ohMask >> ohN) & 0x1))
+            continue;
+        if (useCache && vfatSyncCache.valid[ohN] && (now - vfatSyncCache.readTime[ohN]) < vfatSyncCache.validity) {
+            goodVFATs[ohN] = vfatSyncCache.goodVFATs[ohN];
+            continue;
+        }
+
+        vfatLinkRegs const& regs = getVFATLinkRegs(la, ohN);
+        if (!regs.valid) {
+            la->response->set_string("error", stdsprintf("Unable to resolve the VFAT link registers of OH%i",ohN));
+            continue;
+        }
+        ohList.push_back(ohN);
+        addrs.insert(addrs.end(), regs.addrs.begin(), regs.addrs.end());
+    }
+    if (ohList.empty())
+        return;
+
+    std::vector<uint32_t> words(addrs.size());
+    readAddressList(addrs.data(), words.data(), addrs.size(), la->response);
+
+    for (size_t i = 0; i < ohList.size(); ++i) {
+        const uint32_t ohN = ohList[i];
+        vfatLinkRegs const& regs = getVFATLinkRegs(la, ohN);
+        const uint32_t * ohWords = &words[i*regs.addrs.size()];
+        bool readOK = true;
+        for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            if (ohWords[2*vfatN] == 0xdeaddead || ohWords[2*vfatN+1] == 0xdeaddead) {
+                readOK = false;
+                continue;
+            }
+            bool linkGood = applyMask(ohWords[2*vfatN], regs.masks[2*vfatN]);
+            uint32_t linkErrors = applyMask(ohWords[2*vfatN+1], regs.masks[2*vfatN+1]);
+            goodVFATs[ohN] |= ((linkGood && (linkErrors == 0)) << vfatN);
+        }
+
+        if (useCache && readOK) {
+            vfatSyncCache.valid[ohN]     = true;
+            vfatSyncCache.readTime[ohN]  = now;
+            vfatSyncCache.goodVFATs[ohN] = goodVFATs[ohN];
+        }
+    }
+}
 
 uint32_t vfatSyncCheckLocal(localArgs * la, uint32_t ohN)
 {
-    uint32_t goodVFATs = 0;
-    for(int vfatN = 0; vfatN < 24; vfatN++)
-    {
-        char regBase [100];
-        sprintf(regBase, "GEM_AMC.OH_LINKS.OH%i.VFAT%i",ohN, vfatN);
-        bool linkGood = readReg(la, std::string(regBase)+".LINK_GOOD");
-        uint32_t linkErrors = readReg(la, std::string(regBase)+".SYNC_ERR_CNT");
-        goodVFATs = goodVFATs | ((linkGood && (linkErrors == 0)) << vfatN);
+    if (ohN >= amc::OH_PER_AMC) {
+        la->response->set_string("error", stdsprintf("ohN %i is out of range, the AMC has %i optohybrids",ohN,amc::OH_PER_AMC));
+        return 0;
     }
 
-    return goodVFATs;
+    uint32_t goodVFATs[amc::OH_PER_AMC];
+    vfatSyncCheckMultiLinkLocal(la, 0x1 << ohN, goodVFATs);
+    return goodVFATs[ohN];
 }
 
 void vfatSyncCheck(const RPCMsg *request, RPCMsg *response)
@@ -43,6 +157,24 @@ void vfatSyncCheck(const RPCMsg *request, RPCMsg *response)
     rtxn.abort();
 }
 
+void vfatSyncCheckMultiLink(const RPCMsg *request, RPCMsg *response)
+{
+    GETLOCALARGS(response);
+
+    uint32_t ohMask = request->get_word("ohMask");
+
+    unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
+    if (NOH < amc::OH_PER_AMC)
+        ohMask &= (0x1 << NOH) - 1;
+
+    uint32_t goodVFATs[amc::OH_PER_AMC];
+    vfatSyncCheckMultiLinkLocal(&la, ohMask, goodVFATs);
+
+    response->set_word_array("goodVFATs", goodVFATs, amc::OH_PER_AMC);
+
+    rtxn.abort();
+}
+
 void configureVFAT3DacMonitorLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t dacSelect){
     //Check if VFATs are sync'd
     uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
@@ -94,7 +226,7 @@ void configureVFAT3DacMonitorMultiLink(const RPCMsg *request, RPCMsg *response){
     uint32_t ohMask = request->get_word("ohMask");
     uint32_t dacSelect = request->get_word("dacSelect");
 
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -176,56 +308,117 @@ void getChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response){
     LOGGER->log_message(LogManager::INFO, "Getting VFAT3 Channel Registers");
 
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
 
+    uint32_t spacing = request->get_key_exists("spacing") ? request->get_word("spacing") : VFAT_CHANNEL_REG_SPACING_US;
+
     uint32_t chanRegData[24*128];
 
-    getChannelRegistersVFAT3Local(&la, ohN, vfatMask, chanRegData);
+    getChannelRegistersVFAT3Local(&la, ohN, vfatMask, chanRegData, spacing);
 
     response->set_word_array("chanRegData",chanRegData,24*128);
 
     rtxn.abort();
 } //End getChannelRegistersVFAT3()
 
-void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData){
-    //Determine the inverse of the vfatmask
-    uint32_t notmask = ~vfatMask & 0xFFFFFF;
-
-    char regBuf[200];
-    LOGGER->log_message(LogManager::INFO, "Read channel register settings");
-    for(int vfatN=0; vfatN < 24; ++vfatN){
-        // Check if vfat is masked
-        if(!((notmask >> vfatN) & 0x1)){
-            continue;
-        } //End check if VFAT is masked
+namespace {
+    /*!
+     * \brief Channel register addresses of the 24 VFATs of one OH, idx = vfatN * 128 + chan
+     */
+    struct vfatChannelAddrs {
+        bool valid = false;
+        std::array<uint32_t, oh::VFATS_PER_OH*128> addrs;
+    };
+
+    std::array<ATGenerationCache<vfatChannelAddrs>, amc::OH_PER_AMC> vfatChannelAddrCache;
+
+    /*!
+     * \brief Checks the sync of the unmasked VFATs once and resolves their channel register addresses
+     * \returns nullptr, with the error set in the response, if a VFAT is not sync'ed or the registers could not be resolved
+     */
+    vfatChannelAddrs const* prepareChannelRegistersIO(localArgs * la, uint32_t ohN, uint32_t vfatMask)
+    {
+        if (ohN >= amc::OH_PER_AMC) {
+            la->response->set_string("error", stdsprintf("ohN %i is out of range, the AMC has %i optohybrids",ohN,amc::OH_PER_AMC));
+            return nullptr;
+        }
 
-        // Check if vfatN is sync'd
+        uint32_t notmask = ~vfatMask & 0xFFFFFF;
         uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
-            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
-            la->response->set_string("error",regBuf);
-            return;
+        if ((notmask & goodVFATs) != notmask) {
+            la->response->set_string("error", stdsprintf("One of the unmasked VFATs is not synced; goodVFATs: %x\tnotmask: %x; maskOh: %x", goodVFATs, notmask, vfatMask));
+            return nullptr;
         }
 
-        //Loop over the channels
-        uint32_t chanAddr;
-        for(int chan=0; chan < 128; ++chan){
-            //Deterime the idx
-            int idx = vfatN*128 + chan;
+        vfatChannelAddrs const& regs = vfatChannelAddrCache[ohN].get(la, [ohN](localArgs * la) {
+                vfatChannelAddrs regs;
+                regs.valid = true;
+                for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+                    for (unsigned int chan = 0; chan < 128; ++chan) {
+                        RegHandle reg = getRegHandle(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan));
+                        regs.addrs[vfatN*128 + chan] = reg.address;
+                        regs.valid &= (reg.address != 0xdeaddead);
+                    }
+                }
+                return regs;
+            });
+        if (!regs.valid) {
+            la->response->set_string("error", stdsprintf("Unable to resolve the channel registers of OH%i",ohN));
+            return nullptr;
+        }
+        return &regs;
+    }
+
+    /*!
+     * \brief Reads or writes the channel registers of the unmasked VFATs
+     * \details With spacing 0 the 128 channels of a VFAT are transferred in one list transaction, otherwise one channel at a time,
+     *          spacing microseconds apart (no wait after the last channel). The time taken per VFAT is logged.
+     */
+    void transferChannelRegisters(localArgs * la, vfatChannelAddrs const& regs, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, bool write, uint32_t spacing)
+    {
+        uint32_t notmask = ~vfatMask & 0xFFFFFF;
+        for (unsigned int vfatN = 0; vfatN < oh::VFATS_PER_OH; ++vfatN) {
+            if (!((notmask >> vfatN) & 0x1))
+                continue;
+
+            const uint32_t *addrs = &regs.addrs[vfatN*128];
+            uint32_t *data = &chanRegData[vfatN*128];
+            auto start = std::chrono::steady_clock::now();
+            if (spacing == 0) {
+                if (write)
+                    writeAddressList(addrs, data, 128, la->response);
+                else
+                    readAddressList(addrs, data, 128, la->response);
+            } else {
+                for (unsigned int chan = 0; chan < 128; ++chan) {
+                    if (write)
+                        writeRawAddress(addrs[chan], data[chan], la->response);
+                    else
+                        data[chan] = readRawAddress(addrs[chan], la->response);
+                    if (chan + 1 < 128)
+                        std::this_thread::sleep_for(std::chrono::microseconds(spacing));
+                }
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
 
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
+            LOGGER->log_message(LogManager::INFO, stdsprintf("%s the channel registers of OH%i VFAT%i in %i us, spacing %i us",
+                                                             write ? "Wrote" : "Read", ohN, vfatN, int(elapsed), spacing));
+            if (la->response->get_key_exists("error"))
+                return;
+        }
+    }
+}
 
-            //Build the channel register
-            LOGGER->log_message(LogManager::INFO, stdsprintf("Reading channel register for VFAT%i chan %i",vfatN,chan));
-            chanRegData[idx] = readRawAddress(chanAddr, la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
-        } //End Loop over channels
-    } //End Loop over VFATs
+void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, uint32_t spacing){
+    LOGGER->log_message(LogManager::INFO, "Read channel register settings");
+    vfatChannelAddrs const* regs = prepareChannelRegistersIO(la, ohN, vfatMask);
+    if (regs == nullptr)
+        return;
 
+    transferChannelRegisters(la, *regs, ohN, vfatMask, chanRegData, false, spacing);
     return;
 } //end getChannelRegistersVFAT3Local()
 
@@ -267,7 +460,7 @@ void readVFAT3ADCMultiLink(const RPCMsg *request, RPCMsg *response){
     uint32_t ohMask = request->get_word("ohMask");
     bool useExtRefADC = request->get_word("useExtRefADC");
 
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    unsigned int NOH = getFirmwareIdentity(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -300,74 +493,33 @@ void readVFAT3ADCMultiLink(const RPCMsg *request, RPCMsg *response){
     rtxn.abort();
 } //End readVFAT3ADCMultiLink()
 
-void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData){
-    //Determine the inverse of the vfatmask
-    uint32_t notmask = ~vfatMask & 0xFFFFFF;
-
-    char regBuf[200];
+void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, uint32_t spacing){
     LOGGER->log_message(LogManager::INFO, "Write channel register settings");
-    for(int vfatN=0; vfatN < 24; ++vfatN){
-        // Check if vfat is masked
-        if(!((notmask >> vfatN) & 0x1)){
-            continue;
-        } //End check if VFAT is masked
-
-        // Check if vfatN is sync'd
-        uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
-            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
-            la->response->set_string("error",regBuf);
-            return;
-        }
-
-        //Loop over the channels
-        uint32_t chanAddr;
-        for(int chan=0; chan < 128; ++chan){
-            //Deterime the idx
-            int idx = vfatN*128 + chan;
-
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
-            writeRawAddress(chanAddr, chanRegData[idx], la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
-        } //End Loop over channels
-    } //End Loop over VFATs
+    vfatChannelAddrs const* regs = prepareChannelRegistersIO(la, ohN, vfatMask);
+    if (regs == nullptr)
+        return;
 
+    transferChannelRegisters(la, *regs, ohN, vfatMask, chanRegData, true, spacing);
     return;
 } //End setChannelRegistersVFAT3SimpleLocal()
 
-void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol){
+void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMask, uint32_t *calEnable, uint32_t *masks, uint32_t *trimARM, uint32_t *trimARMPol, uint32_t *trimZCC, uint32_t *trimZCCPol, uint32_t spacing){
     //Determine the inverse of the vfatmask
     uint32_t notmask = ~vfatMask & 0xFFFFFF;
 
+    //Build all the channel registers before writing any
+    std::vector<uint32_t> chanRegData(oh::VFATS_PER_OH*128, 0);
     char regBuf[200];
-    LOGGER->log_message(LogManager::INFO, "Write channel register settings");
     for(int vfatN=0; vfatN < 24; ++vfatN){
         // Check if vfat is masked
         if(!((notmask >> vfatN) & 0x1)){
             continue;
         } //End check if VFAT is masked
 
-        // Check if vfatN is sync'd
-        uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
-            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
-            la->response->set_string("error",regBuf);
-            return;
-        }
-
-        //Loop over the channels
-        uint32_t chanAddr;
-        uint32_t chanRegVal;
         for(int chan=0; chan < 128; ++chan){
             //Deterime the idx
             int idx = vfatN*128 + chan;
 
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
-
             //Check trim values make sense
             if ( trimARM[idx] > 0x3F || trimARM[idx] < 0x0){
                 sprintf(regBuf,"arming comparator trim value must be positive in range [0x0,0x3F]. Value given for VFAT%i chan %i: %x",vfatN,chan,trimARM[idx]);
@@ -381,15 +533,13 @@ void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMa
             }
 
             //Build the channel register
-            LOGGER->log_message(LogManager::INFO, stdsprintf("Setting channel register for VFAT%i chan %i",vfatN,chan));
-            chanRegVal = (calEnable[idx] << 15) + (masks[idx] << 14) + \
-                         (trimZCCPol[idx] << 13) + (trimZCC[idx] << 7) + \
-                         (trimARMPol[idx] << 6) + (trimARM[idx]);
-            writeRawAddress(chanAddr, chanRegVal, la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            chanRegData[idx] = (calEnable[idx] << 15) + (masks[idx] << 14) + \
+                               (trimZCCPol[idx] << 13) + (trimZCC[idx] << 7) + \
+                               (trimARMPol[idx] << 6) + (trimARM[idx]);
         } //End Loop over channels
     } //End Loop over VFATs
 
+    setChannelRegistersVFAT3SimpleLocal(la, ohN, vfatMask, chanRegData.data(), spacing);
     return;
 } //end setChannelRegistersVFAT3Local()
 
@@ -397,16 +547,18 @@ void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response){
     LOGGER->log_message(LogManager::INFO, "Setting VFAT3 Channel Registers");
 
     GETLOCALARGS(response);
+    VFATSyncCacheScope syncCache(request);
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
+    uint32_t spacing = request->get_key_exists("spacing") ? request->get_word("spacing") : VFAT_CHANNEL_REG_SPACING_US;
 
     if (request->get_key_exists("simple")){
         uint32_t chanRegData[3072];
 
         request->get_word_array("chanRegData",chanRegData);
 
-        setChannelRegistersVFAT3SimpleLocal(&la, ohN, vfatMask, chanRegData);
+        setChannelRegistersVFAT3SimpleLocal(&la, ohN, vfatMask, chanRegData, spacing);
     } //End Case: user provided a single array
     else{ //Case: user provided multiple arrays
         uint32_t calEnable[3072];
@@ -423,7 +575,7 @@ void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response){
         request->get_word_array("trimZCC",trimZCC);
         request->get_word_array("trimZCCPol",trimZCCPol);
 
-        setChannelRegistersVFAT3Local(&la, ohN, vfatMask, calEnable, masks, trimARM, trimARMPol, trimZCC, trimZCCPol);
+        setChannelRegistersVFAT3Local(&la, ohN, vfatMask, calEnable, masks, trimARM, trimARMPol, trimZCC, trimZCCPol, spacing);
     } //End Case: user provided multiple arrays
 
     rtxn.abort();
@@ -642,5 +794,6 @@ extern "C" {
         modmgr->register_method("vfat3", "setChannelRegistersVFAT3", setChannelRegistersVFAT3);
         modmgr->register_method("vfat3", "statusVFAT3s", statusVFAT3s);
         modmgr->register_method("vfat3", "vfatSyncCheck", vfatSyncCheck);
+        modmgr->register_method("vfat3", "vfatSyncCheckMultiLink", vfatSyncCheckMultiLink);
     }
 }
@@ -0,0 +1,114 @@
+/*! \file scurve_fit_test.cxx
+ *  \brief Checks of the S-curve analysis on synthetic error function curves
+ *
+ *  Built with `make test`; on an ARM target with NEON the vector sums are compared with the scalar ones.
+ *  Returns the number of failed checks.
+ */
+
+#include "calibration_routines/scurve_math.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+    int nFailed = 0;
+
+    void check(bool ok, const char *what, uint32_t nPoints, uint32_t dacStep)
+    {
+        if (!ok) {
+            ++nFailed;
+            printf("FAILED: %s (nPoints %u, dacStep %u)\n", what, nPoints, dacStep);
+        }
+    }
+
+    bool close(float a, float b, float tolerance)
+    {
+        return fabsf(a - b) <= tolerance;
+    }
+
+    /*!
+     * \brief Counts of an error function turn-on, rising or falling
+     */
+    std::vector<uint32_t> erfCurve(const std::vector<float> & x, float threshold, float noise, uint32_t nevts, bool falling)
+    {
+        std::vector<uint32_t> counts(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+            float cdf = 0.5*(1. + erff((x[i] - threshold)/(M_SQRT2*noise)));
+            counts[i] = uint32_t(nevts*(falling ? 1. - cdf : cdf) + 0.5);
+        }
+        return counts;
+    }
+
+    std::vector<float> dacPoints(uint32_t nPoints, uint32_t dacStep)
+    {
+        std::vector<float> x(nPoints);
+        for (uint32_t i = 0; i < nPoints; ++i)
+            x[i] = 10 + i*dacStep;
+        return x;
+    }
+
+    void checkMoments(const std::vector<uint32_t> & counts, const std::vector<float> & x, uint32_t dacStep)
+    {
+        const uint32_t nPoints = x.size();
+        const float centre = 0.5*(x.front() + x.back());
+        scurveMoments scalar = scurveMomentsScalar(counts.data(), x.data(), nPoints, centre);
+        scurveMoments fast   = scurveMomentsFast(counts.data(), x.data(), nPoints, centre);
+        check(close(scalar.sw, fast.sw, 1e-3*(1. + fabsf(scalar.sw))), "sw", nPoints, dacStep);
+        check(close(scalar.swx, fast.swx, 1e-3*(1. + fabsf(scalar.swx))), "swx", nPoints, dacStep);
+        check(close(scalar.swx2, fast.swx2, 1e-3*(1. + fabsf(scalar.swx2))), "swx2", nPoints, dacStep);
+        check(scalar.minCount == fast.minCount, "minCount", nPoints, dacStep);
+        check(scalar.maxCount == fast.maxCount, "maxCount", nPoints, dacStep);
+    }
+}
+
+int main()
+{
+    const uint32_t nevts = 1000;
+
+    //Scalar and vector sums over every tail length of the vector loop
+    for (uint32_t dacStep = 1; dacStep <= 3; dacStep += 2) {
+        for (uint32_t nPoints = 3; nPoints <= 40; ++nPoints) {
+            std::vector<float> x = dacPoints(nPoints, dacStep);
+            float threshold = 0.5*(x.front() + x.back());
+            checkMoments(erfCurve(x, threshold, 1.5*dacStep, nevts, false), x, dacStep);
+            checkMoments(erfCurve(x, threshold, 1.5*dacStep, nevts, true), x, dacStep);
+        }
+    }
+
+    //Threshold and noise of complete turn-ons, rising and falling
+    for (uint32_t dacStep = 1; dacStep <= 3; dacStep += 2) {
+        const uint32_t nPoints = 60/dacStep;
+        std::vector<float> x = dacPoints(nPoints, dacStep);
+        const float threshold = x[nPoints/2] + 0.3, noise = 3.;
+        for (int falling = 0; falling < 2; ++falling) {
+            std::vector<uint32_t> counts = erfCurve(x, threshold, noise, nevts, falling);
+            scurveFitResult fit = fitSCurve(counts.data(), x.data(), nPoints, nevts);
+            check(fit.flags == 0, falling ? "falling flags" : "rising flags", nPoints, dacStep);
+            check(close(fit.threshold, threshold, 0.1), falling ? "falling threshold" : "rising threshold", nPoints, dacStep);
+            check(close(fit.noise, noise, 0.3), falling ? "falling noise" : "rising noise", nPoints, dacStep);
+            check(fit.chi2ndf < 5., falling ? "falling chi2" : "rising chi2", nPoints, dacStep);
+        }
+    }
+
+    //A falling curve starting above 50% is a turn-on, not a noisy channel
+    {
+        std::vector<float> x = dacPoints(40, 1);
+        std::vector<uint32_t> counts = erfCurve(x, 25., 2., nevts, true);
+        scurveFitResult fit = fitSCurve(counts.data(), x.data(), x.size(), nevts);
+        check(!(fit.flags & SCURVE_FLAG_NOISY), "falling curve flagged noisy", x.size(), 1);
+    }
+
+    //Flat curves
+    {
+        std::vector<float> x = dacPoints(20, 1);
+        std::vector<uint32_t> dead(x.size(), 0), noisy(x.size(), 800), flat(x.size(), 300);
+        check(fitSCurve(dead.data(), x.data(), x.size(), nevts).flags == (SCURVE_FLAG_DEAD | SCURVE_FLAG_NO_TURNON), "dead", x.size(), 1);
+        check(fitSCurve(noisy.data(), x.data(), x.size(), nevts).flags == (SCURVE_FLAG_NOISY | SCURVE_FLAG_NO_TURNON), "noisy", x.size(), 1);
+        check(fitSCurve(flat.data(), x.data(), x.size(), nevts).flags == SCURVE_FLAG_NO_TURNON, "flat", x.size(), 1);
+    }
+
+    if (nFailed == 0)
+        printf("All S-curve checks passed\n");
+    return nFailed;
+}